@@ -6,17 +6,86 @@
 CPP_SRCS += \
 ../src/paraverParser.cpp \
 ../src/prv2pjdump.cpp \
-../src/event.cpp 
+../src/event.cpp \
+../src/histogram.cpp \
+../src/record.cpp \
+../src/lineReader.cpp \
+../src/reduction.cpp \
+../src/coalescer.cpp \
+../src/writer.cpp \
+../src/sqliteWriter.cpp \
+../src/rollup.cpp \
+../src/traceConfig.cpp \
+../src/traceIndex.cpp \
+../src/queryServer.cpp \
+../src/eventPairing.cpp \
+../src/sinks.cpp \
+../src/cacheFile.cpp \
+../src/recordCache.cpp \
+../src/compressedStream.cpp \
+../src/rasterWriter.cpp \
+../src/counters.cpp \
+../src/pajeWriter.cpp \
+../src/traceMerger.cpp \
+../src/timeFormat.cpp \
+../src/comparison.cpp \
+../src/selfTrace.cpp 
 
 OBJS += \
 ./src/paraverParser.o \
 ./src/prv2pjdump.o \
-./src/event.o
+./src/event.o \
+./src/histogram.o \
+./src/record.o \
+./src/lineReader.o \
+./src/reduction.o \
+./src/coalescer.o \
+./src/writer.o \
+./src/sqliteWriter.o \
+./src/rollup.o \
+./src/traceConfig.o \
+./src/traceIndex.o \
+./src/queryServer.o \
+./src/eventPairing.o \
+./src/sinks.o \
+./src/cacheFile.o \
+./src/recordCache.o \
+./src/compressedStream.o \
+./src/rasterWriter.o \
+./src/counters.o \
+./src/pajeWriter.o \
+./src/traceMerger.o \
+./src/timeFormat.o \
+./src/comparison.o \
+./src/selfTrace.o
 
 CPP_DEPS += \
 ./src/paraverParser.d \
 ./src/prv2pjdump.d \
-./src/event.d
+./src/event.d \
+./src/histogram.d \
+./src/record.d \
+./src/lineReader.d \
+./src/reduction.d \
+./src/coalescer.d \
+./src/writer.d \
+./src/sqliteWriter.d \
+./src/rollup.d \
+./src/traceConfig.d \
+./src/traceIndex.d \
+./src/queryServer.d \
+./src/eventPairing.d \
+./src/sinks.d \
+./src/cacheFile.d \
+./src/recordCache.d \
+./src/compressedStream.d \
+./src/rasterWriter.d \
+./src/counters.d \
+./src/pajeWriter.d \
+./src/traceMerger.d \
+./src/timeFormat.d \
+./src/comparison.d \
+./src/selfTrace.d
 
 # Each subdirectory must supply rules for building sources it contributes
 src/%.o: ../src/%.cpp
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# sqliteBenchmark.sh
+#
+#  Compare the direct SQLite output with a pjdump conversion followed by a
+#  CSV .import of the states, events and links and the same indexes.
+#
+#  Usage: scripts/sqliteBenchmark.sh TRACE.prv [PRV2PJDUMP]
+#  (needs the sqlite3 shell; the files are written in a temporary directory)
+
+set -e
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 TRACE.prv [PRV2PJDUMP]" >&2
+	exit 1
+fi
+
+TRACE=$1
+PRV2PJDUMP=${2:-prv2pjdump}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+TIMEFORMAT="%R s"
+
+echo "Direct load:"
+time "$PRV2PJDUMP" -f sqlite -o "$WORK/direct.sqlite" "$TRACE" 2> /dev/null
+
+echo "pjdump conversion:"
+time "$PRV2PJDUMP" -o "$WORK/trace.pjdump" "$TRACE" 2> /dev/null
+
+grep '^State,' "$WORK/trace.pjdump" > "$WORK/states.csv" || true
+grep '^Event,' "$WORK/trace.pjdump" > "$WORK/events.csv" || true
+grep '^Link,' "$WORK/trace.pjdump" > "$WORK/links.csv" || true
+
+echo "CSV import and indexes:"
+time sqlite3 "$WORK/import.sqlite" \
+	"CREATE TABLE state (tag, container, state, start INTEGER, end INTEGER, duration INTEGER, imbrication INTEGER, value);" \
+	"CREATE TABLE event (tag, container, event, time INTEGER, value);" \
+	"CREATE TABLE link (tag, sender, type, start INTEGER, end INTEGER, duration INTEGER, name, startContainer, receiver);" \
+	".mode csv" \
+	".import $WORK/states.csv state" \
+	".import $WORK/events.csv event" \
+	".import $WORK/links.csv link" \
+	"CREATE INDEX state_container_start ON state (container, start);" \
+	"CREATE INDEX state_state_start ON state (state, start);" \
+	"CREATE INDEX event_container_time ON event (container, time);" \
+	"CREATE INDEX link_sender_start ON link (sender, start);"
+
+echo "Database sizes (bytes):"
+echo "	direct: $(wc -c < "$WORK/direct.sqlite")"
+echo "	import: $(wc -c < "$WORK/import.sqlite")"
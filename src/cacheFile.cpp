@@ -0,0 +1,36 @@
+/*
+ * cacheFile.cpp
+ *
+ *  Binary cache files written next to the files they were built from.
+ */
+
+#include <sys/stat.h>
+#include "include/cacheFile.h"
+
+bool fileIdentity(const string & filename, long long & size,
+		long long & modification) {
+	struct stat status;
+	if (stat(filename.c_str(), &status) != 0)
+		return false;
+
+	size = status.st_size;
+#if defined(__linux__)
+	modification = status.st_mtim.tv_sec * 1000000000LL
+			+ status.st_mtim.tv_nsec;
+#else
+	modification = status.st_mtime;
+#endif
+	return true;
+}
+
+bool commitCache(CacheFile & cache, const string & cacheFile) {
+	string temporary = cacheFile + ".tmp";
+
+	if (!cache.close()) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	remove(cacheFile.c_str());
+	return rename(temporary.c_str(), cacheFile.c_str()) == 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * coalescer.cpp
+ *
+ *  Merge of the consecutive identical states of a container.
+ */
+
+#include <algorithm>
+#include "include/coalescer.h"
+
+bool Coalescer::isShort(const State & state) const {
+	return absorbDuration > 0
+			&& state.getEndDate() - state.getTimeStamp() < absorbDuration;
+}
+
+bool Coalescer::canMerge(const State & pending, const State & state) const {
+	if (state.getTimeStamp() < pending.getTimeStamp()
+			|| state.getTimeStamp() > pending.getEndDate() + tolerance
+			|| state.getImbrication() != pending.getImbrication())
+		return false;
+
+	// A short state is absorbed by its neighbour, be it the previous or the
+	// following one
+	if (isShort(state) || isShort(pending))
+		return true;
+
+	return state.getName() == pending.getName();
+}
+
+/**
+ * Add a state of a container.
+ *
+ * @return true if the pending state of the container was replaced, it is
+ * then copied in flushed
+ */
+bool Coalescer::add(int containerIndex, const State & state, State & flushed) {
+	if ((unsigned int) containerIndex >= pendingStates.size()) {
+		pendingStates.resize(containerIndex + 1);
+		hasPending.resize(containerIndex + 1);
+	}
+
+	unsigned int level = max(state.getImbrication(), 0);
+	if (level >= pendingStates[containerIndex].size()) {
+		pendingStates[containerIndex].resize(level + 1);
+		hasPending[containerIndex].resize(level + 1, false);
+	}
+
+	State & pending = pendingStates[containerIndex][level];
+
+	if (!hasPending[containerIndex][level]) {
+		pending = state;
+		hasPending[containerIndex][level] = true;
+		return false;
+	}
+
+	if (canMerge(pending, state)) {
+		// The merged state takes the name of the state that is not short
+		if (isShort(pending) && !isShort(state))
+			pending.setName(state.getName());
+		pending.setEndDate(max(pending.getEndDate(), state.getEndDate()));
+		mergedStates++;
+		return false;
+	}
+
+	flushed = pending;
+	pending = state;
+	return true;
+}
+
+/**
+ * Get the remaining pending states, sorted by start time
+ */
+vector<State> Coalescer::flushAll() {
+	vector<State> states;
+
+	for (unsigned int i = 0; i < pendingStates.size(); i++)
+		for (unsigned int level = 0; level < pendingStates[i].size(); level++)
+			if (hasPending[i][level])
+				states.push_back(pendingStates[i][level]);
+
+	pendingStates.clear();
+	hasPending.clear();
+
+	stable_sort(states.begin(), states.end(),
+			[](const State & a, const State & b) {
+				return a.getTimeStamp() < b.getTimeStamp();
+			});
+
+	return states;
+}
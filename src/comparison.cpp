@@ -0,0 +1,182 @@
+/*
+ * comparison.cpp
+ *
+ *  Comparison of a baseline trace and a candidate trace: differences of the
+ *  time spent in each state and of the number of events, per container.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include "include/comparison.h"
+
+unsigned int NameTable::intern(const string & name) {
+#ifndef _WIN32
+	lock_guard<mutex> guard(lock);
+#endif
+	auto it = identifiers.find(name);
+	if (it != identifiers.end())
+		return it->second;
+
+	unsigned int identifier = names.size();
+	names.push_back(name);
+	identifiers[name] = identifier;
+	return identifier;
+}
+
+ComparisonWriter::ComparisonWriter(NameTable & containers, NameTable & names) :
+		containers(containers), names(names) {
+}
+
+unsigned int ComparisonWriter::identify(NameTable & table,
+		unordered_map<string, unsigned int> & cache, const string & name) {
+	auto it = cache.find(name);
+	if (it != cache.end())
+		return it->second;
+
+	unsigned int identifier = table.intern(name);
+	cache[name] = identifier;
+	return identifier;
+}
+
+ComparedTotals & ComparisonWriter::totalsOf(const string & container,
+		const string & name) {
+	unsigned long long key = (unsigned long long) identify(containers,
+			containerIds, container) << 32;
+	key |= identify(names, nameIds, name);
+	return totals[key];
+}
+
+void ComparisonWriter::setTraceUnit(int unit) {
+	traceUnit = unit;
+}
+
+/**
+ * Nothing is written: the totals are read once the trace is converted
+ */
+bool ComparisonWriter::open(const string &) {
+	return true;
+}
+
+void ComparisonWriter::writeContainer(const string &, const string &,
+		const string &, long long, long long) {
+}
+
+void ComparisonWriter::writeState(State & state) {
+	ComparedTotals & total = totalsOf(state.getContainer(), state.getName());
+	total.states++;
+	total.time += state.getEndDate() - state.getTimeStamp();
+}
+
+void ComparisonWriter::writeEvent(Event & event) {
+	totalsOf(event.getContainer(), event.getName()).events++;
+}
+
+void ComparisonWriter::writeLink(Link &) {
+}
+
+void ComparisonWriter::writeVariable(const string &, const string &,
+		long long, long long, double) {
+}
+
+void ComparisonWriter::close() {
+}
+
+TraceComparison::TraceComparison() :
+		base(containers, names), candidate(containers, names) {
+}
+
+/**
+ * Totals of a key in both traces, the times in the compared unit
+ */
+struct Difference {
+	unsigned long long key;
+	ComparedTotals base;
+	ComparedTotals candidate;
+	long long change;
+};
+
+/**
+ * Factor converting the times of a trace into the compared unit
+ */
+static long long unitFactor(int traceUnit, int comparedUnit) {
+	long long factor = 1;
+	for (int i = comparedUnit; i < traceUnit; i++)
+		factor *= 10;
+	return factor;
+}
+
+unsigned long long TraceComparison::writeReport(ostream & out,
+		long long threshold, TimeFormat timeFormat) const {
+	int unit = min(base.getTraceUnit(), candidate.getTraceUnit());
+	long long baseFactor = unitFactor(base.getTraceUnit(), unit);
+	long long candidateFactor = unitFactor(candidate.getTraceUnit(), unit);
+	timeFormat.setTraceUnit(unit);
+
+	vector<Difference> states;
+	vector<Difference> events;
+	auto compare = [&](unsigned long long key, const ComparedTotals & first,
+			const ComparedTotals & second) {
+		Difference difference = { key, first, second, 0 };
+		difference.base.time *= baseFactor;
+		difference.candidate.time *= candidateFactor;
+
+		difference.change = difference.candidate.time - difference.base.time;
+		if (llabs(difference.change) > threshold)
+			states.push_back(difference);
+
+		difference.change = (long long) difference.candidate.events
+				- (long long) difference.base.events;
+		if (llabs(difference.change) > threshold)
+			events.push_back(difference);
+	};
+
+	ComparedTotals none;
+	for (auto & it : base.getTotals()) {
+		auto other = candidate.getTotals().find(it.first);
+		compare(it.first, it.second,
+				(other != candidate.getTotals().end()) ? other->second : none);
+	}
+	for (auto & it : candidate.getTotals())
+		if (base.getTotals().find(it.first) == base.getTotals().end())
+			compare(it.first, none, it.second);
+
+	// Largest changes first, then by container and name
+	auto ranking = [this](const Difference & a, const Difference & b) {
+		if (llabs(a.change) != llabs(b.change))
+			return llabs(a.change) > llabs(b.change);
+		const string & containerA = containers.getName(a.key >> 32);
+		const string & containerB = containers.getName(b.key >> 32);
+		if (containerA != containerB)
+			return containerA < containerB;
+		return names.getName(a.key & 0xffffffff)
+				< names.getName(b.key & 0xffffffff);
+	};
+	sort(states.begin(), states.end(), ranking);
+	sort(events.begin(), events.end(), ranking);
+
+	for (const Difference & difference : states) {
+		out << STATE_DIFFERENCE_TAG << PJDUMP_SEPARATOR;
+		out << containers.getName(difference.key >> 32) << PJDUMP_SEPARATOR;
+		out << names.getName(difference.key & 0xffffffff) << PJDUMP_SEPARATOR;
+		out << difference.base.states << PJDUMP_SEPARATOR;
+		out << difference.candidate.states << PJDUMP_SEPARATOR;
+		timeFormat.write(out, difference.base.time);
+		out << PJDUMP_SEPARATOR;
+		timeFormat.write(out, difference.candidate.time);
+		out << PJDUMP_SEPARATOR;
+		timeFormat.write(out, difference.change);
+		out << '\n';
+	}
+
+	for (const Difference & difference : events) {
+		out << EVENT_DIFFERENCE_TAG << PJDUMP_SEPARATOR;
+		out << containers.getName(difference.key >> 32) << PJDUMP_SEPARATOR;
+		out << names.getName(difference.key & 0xffffffff) << PJDUMP_SEPARATOR;
+		out << difference.base.events << PJDUMP_SEPARATOR;
+		out << difference.candidate.events << PJDUMP_SEPARATOR;
+		out << difference.change << '\n';
+	}
+
+	out.flush();
+	return states.size() + events.size();
+}
@@ -0,0 +1,316 @@
+/*
+ * compressedStream.cpp
+ *
+ *  Output stream compressed by independent blocks (gzip or zstd).
+ */
+
+#include <cstring>
+#include "include/compressedStream.h"
+#include "include/selfTrace.h"
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+static bool endsWith(const string & filename, const string & extension) {
+	return filename.size() > extension.size()
+			&& filename.compare(filename.size() - extension.size(),
+					extension.size(), extension) == 0;
+}
+
+Compression compressionOf(const string & filename) {
+	if (endsWith(filename, GZIP_EXTENSION))
+		return COMPRESSION_GZIP;
+	if (endsWith(filename, ZSTD_EXTENSION))
+		return COMPRESSION_ZSTD;
+	return COMPRESSION_NONE;
+}
+
+CompressedStreamBuffer::~CompressedStreamBuffer() {
+	close();
+}
+
+bool CompressedStreamBuffer::open(const string & filename,
+		Compression compression, const CompressionSettings & settings,
+		string & error) {
+#ifndef WITH_ZLIB
+	if (compression == COMPRESSION_GZIP) {
+		error = "gzip compression is not available in this build";
+		return false;
+	}
+#endif
+#ifndef WITH_ZSTD
+	if (compression == COMPRESSION_ZSTD) {
+		error = "zstd compression is not available in this build";
+		return false;
+	}
+#endif
+
+	// Checked before the file is created
+	if (compression == COMPRESSION_GZIP && settings.level != -1
+			&& (settings.level < 0 || settings.level > MAX_GZIP_LEVEL)) {
+		error = "the gzip compression level must be between 0 and "
+				+ to_string(MAX_GZIP_LEVEL);
+		return false;
+	}
+	if (compression == COMPRESSION_ZSTD && settings.level != -1
+			&& (settings.level < MIN_ZSTD_LEVEL
+					|| settings.level > MAX_ZSTD_LEVEL)) {
+		error = "the zstd compression level must be between "
+				+ to_string(MIN_ZSTD_LEVEL) + " and "
+				+ to_string(MAX_ZSTD_LEVEL);
+		return false;
+	}
+
+	closeFile = filename != STANDARD_STREAM;
+	file = closeFile ? fopen(filename.c_str(), "wb") : stdout;
+	if (file == nullptr) {
+		error = "cannot write " + filename;
+		return false;
+	}
+
+	this->compression = compression;
+	this->settings = settings;
+	if (this->settings.blockSize == 0)
+		this->settings.blockSize = DEFAULT_COMPRESSION_BLOCK_SIZE;
+	failed = false;
+	block.reserve(this->settings.blockSize);
+
+#ifndef _WIN32
+	unsigned int threads = settings.threads;
+	if (threads == 0)
+		threads = max(1u, thread::hardware_concurrency());
+
+	stopping = false;
+	if (compression != COMPRESSION_NONE)
+		for (unsigned int i = 0; i < threads; i++)
+			workers.push_back(thread(&CompressedStreamBuffer::work, this));
+#endif
+
+	return true;
+}
+
+/**
+ * Compress a block into a complete gzip member or zstd frame
+ */
+void CompressedStreamBuffer::compress(CompressedBlock & compressed) {
+	vector<char> & input = compressed.input;
+
+	switch (compression) {
+#ifdef WITH_ZLIB
+	case COMPRESSION_GZIP: {
+		vector<char> & output = compressed.output;
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		// 16 + 15 bits of window: gzip header and trailer
+		if (deflateInit2(&stream, settings.level, Z_DEFLATED, 16 + 15, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK) {
+			compressed.failed = true;
+			break;
+		}
+
+		output.resize(deflateBound(&stream, input.size()));
+		stream.next_in = (Bytef *) input.data();
+		stream.avail_in = input.size();
+		stream.next_out = (Bytef *) output.data();
+		stream.avail_out = output.size();
+
+		compressed.failed = deflate(&stream, Z_FINISH) != Z_STREAM_END;
+		output.resize(stream.total_out);
+		deflateEnd(&stream);
+		break;
+	}
+#endif
+
+#ifdef WITH_ZSTD
+	case COMPRESSION_ZSTD: {
+		vector<char> & output = compressed.output;
+		int level = settings.level < 0 ? ZSTD_CLEVEL_DEFAULT : settings.level;
+		output.resize(ZSTD_compressBound(input.size()));
+		size_t size = ZSTD_compress(output.data(), output.size(), input.data(),
+				input.size(), level);
+		compressed.failed = ZSTD_isError(size);
+		output.resize(compressed.failed ? 0 : size);
+		break;
+	}
+#endif
+
+	default:
+		compressed.failed = true;
+	}
+
+	input.clear();
+	input.shrink_to_fit();
+}
+
+#ifndef _WIN32
+
+void CompressedStreamBuffer::work() {
+	SelfTrace::setThreadName("compression");
+
+	while (true) {
+		shared_ptr<CompressedBlock> compressed;
+		{
+			SelfTrace::switchStage(STAGE_QUEUE_WAIT);
+			unique_lock<mutex> guard(lock);
+			jobReady.wait(guard, [this] {return stopping || !jobs.empty();});
+			if (jobs.empty()) {
+				SelfTrace::switchStage(NO_STAGE);
+				return;
+			}
+			compressed = jobs.front();
+			jobs.pop_front();
+		}
+
+		SelfTrace::switchStage(STAGE_COMPRESS);
+		compress(*compressed);
+
+		{
+			lock_guard<mutex> guard(lock);
+			compressed->done = true;
+		}
+		blockDone.notify_all();
+		SelfTrace::endBatch();
+	}
+}
+
+#endif /* _WIN32 */
+
+/**
+ * Hand the current block to the compression threads
+ */
+void CompressedStreamBuffer::submitBlock() {
+	if (block.empty())
+		return;
+
+	if (compression == COMPRESSION_NONE) {
+		TraceStage stage = SelfTrace::switchStage(STAGE_WRITE);
+		if (fwrite(block.data(), 1, block.size(), file) != block.size())
+			failed = true;
+		SelfTrace::switchStage(stage);
+		block.clear();
+		return;
+	}
+
+	shared_ptr<CompressedBlock> compressed = make_shared<CompressedBlock>();
+	compressed->input.swap(block);
+	block.reserve(settings.blockSize);
+
+#ifndef _WIN32
+	{
+		lock_guard<mutex> guard(lock);
+		pending.push_back(compressed);
+		jobs.push_back(compressed);
+	}
+	jobReady.notify_one();
+
+	// Bound the memory used by the blocks in progress
+	writeBlocks(pending.size() > 2 * workers.size());
+#else
+	TraceStage stage = SelfTrace::switchStage(STAGE_COMPRESS);
+	compress(*compressed);
+	SelfTrace::switchStage(stage);
+	compressed->done = true;
+	pending.push_back(compressed);
+	writeBlocks(false);
+#endif
+}
+
+/**
+ * Write the compressed blocks in order, as long as they are done
+ *
+ * @param wait wait for the first block if it is not done yet
+ */
+void CompressedStreamBuffer::writeBlocks(bool wait) {
+	while (!pending.empty()) {
+		shared_ptr<CompressedBlock> compressed = pending.front();
+		{
+#ifndef _WIN32
+			unique_lock<mutex> guard(lock);
+			if (wait && !compressed->done) {
+				TraceStage stage = SelfTrace::switchStage(STAGE_QUEUE_WAIT);
+				blockDone.wait(guard, [&compressed] {return compressed->done;});
+				SelfTrace::switchStage(stage);
+			}
+#endif
+			if (!compressed->done)
+				return;
+		}
+		pending.pop_front();
+		wait = false;
+
+		TraceStage stage = SelfTrace::switchStage(STAGE_WRITE);
+		if (compressed->failed
+				|| fwrite(compressed->output.data(), 1,
+						compressed->output.size(), file)
+						!= compressed->output.size())
+			failed = true;
+		SelfTrace::switchStage(stage);
+	}
+}
+
+int CompressedStreamBuffer::overflow(int character) {
+	if (file == nullptr)
+		return traits_type::eof();
+
+	if (character != traits_type::eof()) {
+		block.push_back((char) character);
+		if (block.size() >= settings.blockSize)
+			submitBlock();
+	}
+	return failed ? traits_type::eof() : traits_type::not_eof(character);
+}
+
+streamsize CompressedStreamBuffer::xsputn(const char * data,
+		streamsize size) {
+	if (file == nullptr)
+		return 0;
+
+	streamsize written = 0;
+	while (written < size) {
+		size_t length = min((size_t) (size - written),
+				settings.blockSize - block.size());
+		block.insert(block.end(), data + written, data + written + length);
+		written += length;
+		if (block.size() >= settings.blockSize)
+			submitBlock();
+	}
+	return failed ? 0 : written;
+}
+
+/**
+ * Flushing the stream does not cut a block: the data is compressed when the
+ * block is full or when the stream is closed
+ */
+int CompressedStreamBuffer::sync() {
+	return failed ? -1 : 0;
+}
+
+bool CompressedStreamBuffer::close() {
+	if (file == nullptr)
+		return !failed;
+
+	submitBlock();
+	while (!pending.empty())
+		writeBlocks(true);
+
+#ifndef _WIN32
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (thread & worker : workers)
+		worker.join();
+	workers.clear();
+#endif
+
+	if ((closeFile ? fclose(file) : fflush(file)) != 0)
+		failed = true;
+	file = nullptr;
+	return !failed;
+}
@@ -0,0 +1,105 @@
+/*
+ * counters.cpp
+ *
+ *  Hardware counters of the event records converted into Variable time
+ *  series, with optional derived metrics.
+ */
+
+#include <cstdio>
+#include <sstream>
+#include "include/counters.h"
+
+bool CounterSeries::setMetrics(const string & list, string & error) {
+	stringstream items(list);
+	string item;
+
+	while (getline(items, item, ',')) {
+		if (item == "delta")
+			metrics |= METRIC_DELTA;
+		else if (item == "rate")
+			metrics |= METRIC_RATE;
+		else if (item == "ipc")
+			metrics |= METRIC_IPC;
+		else if (item.compare(0, 4, "ipc=") == 0) {
+			if (sscanf(item.c_str() + 4, "%d/%d", &instructionsType,
+					&cyclesType) != 2) {
+				error = "expected ipc=INSTRUCTIONS/CYCLES instead of " + item;
+				return false;
+			}
+			metrics |= METRIC_IPC;
+		} else {
+			error = "unknown counter metric " + item;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+unsigned int CounterSeries::getCounter(int type,
+		const map<int, string> & eventNames) {
+	auto it = counterIndexes.find(type);
+	if (it != counterIndexes.end())
+		return it->second;
+
+	unsigned int number = counterNames.size();
+	counterIndexes[type] = number;
+
+	auto name = eventNames.find(type);
+	counterNames.push_back(
+			(name != eventNames.end()) ? name->second : to_string(type));
+	samples.push_back(vector<CounterSample>());
+	return number;
+}
+
+void CounterSeries::sample(int containerIndex, long long time,
+		const vector<pair<int, long long>> & params,
+		const map<int, string> & eventNames,
+		vector<CounterVariable> & variables) {
+	long long instructions = -1, cycles = -1;
+	long long intervalStart = 0;
+
+	for (auto & param : params) {
+		if (!isCounter(param.first))
+			continue;
+
+		unsigned int counter = getCounter(param.first, eventNames);
+		vector<CounterSample> & counterSamples = samples[counter];
+		if ((unsigned int) containerIndex >= counterSamples.size())
+			counterSamples.resize(containerIndex + 1);
+
+		CounterSample & last = counterSamples[containerIndex];
+		const string & name = counterNames[counter];
+		long long start = last.time;
+
+		variables.push_back( { name, start, time, (double) param.second });
+
+		if ((metrics & METRIC_DELTA) && last.seen)
+			variables.push_back( { name + DELTA_SUFFIX, start, time,
+					(double) (param.second - last.value) });
+
+		if ((metrics & METRIC_RATE) && time > start)
+			variables.push_back( { name + RATE_SUFFIX, start, time,
+					(double) param.second / (time - start) });
+
+		if (param.first == instructionsType) {
+			instructions = param.second;
+			intervalStart = start;
+		} else if (param.first == cyclesType)
+			cycles = param.second;
+
+		last.time = time;
+		last.value = param.second;
+		last.seen = true;
+		sampleCount++;
+	}
+
+	if ((metrics & METRIC_IPC) && instructions >= 0 && cycles > 0)
+		variables.push_back( { IPC_VARIABLE, intervalStart, time,
+				(double) instructions / cycles });
+}
+
+void CounterSeries::writeReport(ostream & out) const {
+	out << "Counter samples: " << sampleCount << " (" << counterNames.size()
+			<< " counters)" << endl;
+}
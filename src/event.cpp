@@ -23,20 +23,6 @@ Event::~Event() {
 	// TODO Auto-generated destructor stub
 }
 
-/**
- * Convert an event to the corresponding pjdump line
- */
-string Event::toPjdump() {
-	stringstream pjDumpLine;
-	pjDumpLine << tag << PJDUMP_SEPARATOR;
-	pjDumpLine << container << PJDUMP_SEPARATOR;
-	pjDumpLine << name << PJDUMP_SEPARATOR;
-	pjDumpLine << timeStamp << PJDUMP_SEPARATOR;
-	pjDumpLine << name << endl;
-
-	return pjDumpLine.str();
-}
-
 State::State() {
 	tag = STATE_TAG;
 }
@@ -51,20 +37,6 @@ State::State(long long timestamp, string container, string name, long long endti
 	tag = STATE_TAG;
 }
 
-string State::toPjdump() {
-	stringstream pjDumpLine;
-	pjDumpLine << tag << PJDUMP_SEPARATOR;
-	pjDumpLine << container << PJDUMP_SEPARATOR;
-	pjDumpLine << name << PJDUMP_SEPARATOR;
-	pjDumpLine << timeStamp << PJDUMP_SEPARATOR;
-	pjDumpLine << endDate << PJDUMP_SEPARATOR;
-	pjDumpLine << (endDate - timeStamp) << PJDUMP_SEPARATOR;
-	pjDumpLine << imbrication << PJDUMP_SEPARATOR;
-	pjDumpLine << name << endl;
-
-	return pjDumpLine.str();
-}
-
 Link::Link(long long timestamp, string container, string name,
 		long long rcvTimestamp, string rcvContainer) {
 	this->timeStamp = timestamp;
@@ -75,18 +47,3 @@ Link::Link(long long timestamp, string container, string name,
 
 	tag = LINK_TAG;
 }
-
-string Link::toPjdump() {
-	stringstream pjDumpLine;
-	pjDumpLine << tag << PJDUMP_SEPARATOR;
-	pjDumpLine << container << PJDUMP_SEPARATOR;
-	pjDumpLine << tag << PJDUMP_SEPARATOR;
-	pjDumpLine << timeStamp << PJDUMP_SEPARATOR;
-	pjDumpLine << receiveTimestamp << PJDUMP_SEPARATOR;
-	pjDumpLine << (receiveTimestamp - timeStamp) << PJDUMP_SEPARATOR;
-	pjDumpLine << tag << PJDUMP_SEPARATOR;
-	pjDumpLine << container << PJDUMP_SEPARATOR;
-	pjDumpLine << receiverContainer << endl;
-
-	return pjDumpLine.str();
-}
@@ -0,0 +1,96 @@
+/*
+ * eventPairing.cpp
+ *
+ *  Conversion of begin/end event pairs into nested states.
+ */
+
+#include <algorithm>
+#include "include/eventPairing.h"
+
+void EventPairing::begin(int containerIndex, int type, const string & container,
+		const string & name, long long time) {
+	if ((unsigned int) containerIndex >= openRegions.size()) {
+		openRegions.resize(containerIndex + 1);
+		droppedDepths.resize(containerIndex + 1);
+	}
+
+	vector<OpenRegion> & regions = openRegions[containerIndex];
+	if (regions.size() >= MAX_REGION_DEPTH) {
+		// Its end must not close the enclosing region of the same type
+		droppedDepths[containerIndex][type]++;
+		droppedRegions++;
+		return;
+	}
+
+	OpenRegion region;
+	region.type = type;
+	region.state = State(time, container, name, time);
+	region.state.setImbrication(regions.size() + 1);
+	regions.push_back(region);
+}
+
+bool EventPairing::end(int containerIndex, int type, long long time,
+		State & closed) {
+	if ((unsigned int) containerIndex < openRegions.size()) {
+		vector<OpenRegion> & regions = openRegions[containerIndex];
+
+		// The last regions opened for the type were dropped
+		auto dropped = droppedDepths[containerIndex].find(type);
+		if (dropped != droppedDepths[containerIndex].end()) {
+			if (--dropped->second == 0)
+				droppedDepths[containerIndex].erase(dropped);
+			return false;
+		}
+
+		for (auto it = regions.rbegin(); it != regions.rend(); ++it)
+			if (it->type == type) {
+				closed = it->state;
+				closed.setEndDate(time);
+				regions.erase(next(it).base());
+				pairedRegions++;
+				return true;
+			}
+	}
+
+	unmatchedEnds++;
+	return false;
+}
+
+/**
+ * Get the regions still open, sorted by start time
+ */
+vector<ClosedRegion> EventPairing::closeAll(long long time) {
+	vector<ClosedRegion> closed;
+
+	for (unsigned int i = 0; i < openRegions.size(); i++)
+		for (OpenRegion & region : openRegions[i]) {
+			closed.push_back( { (int) i, region.state });
+			closed.back().state.setEndDate(
+					max(time, region.state.getTimeStamp()));
+			unclosedRegions++;
+		}
+
+	openRegions.clear();
+	droppedDepths.clear();
+
+	stable_sort(closed.begin(), closed.end(),
+			[](const ClosedRegion & a, const ClosedRegion & b) {
+				return a.state.getTimeStamp() < b.state.getTimeStamp();
+			});
+
+	return closed;
+}
+
+void EventPairing::writeReport(ostream & out) const {
+	out << "Paired regions: " << pairedRegions << endl;
+
+	if (unmatchedEnds > 0)
+		out << "Warning: " << unmatchedEnds
+				<< " end events had no open region of their type." << endl;
+	if (droppedRegions > 0)
+		out << "Warning: " << droppedRegions << " regions nested deeper than "
+				<< MAX_REGION_DEPTH << " levels were dropped." << endl;
+	if (unclosedRegions > 0)
+		out << "Warning: " << unclosedRegions
+				<< " regions were closed at the end of the trace." << endl;
+}
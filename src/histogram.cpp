@@ -0,0 +1,207 @@
+/*
+ * histogram.cpp
+ *
+ *  Log-bucketed duration histograms built while the trace is parsed.
+ */
+
+#include <algorithm>
+#include <functional>
+#include "include/histogram.h"
+
+// Percentiles written in the report
+const double REPORTED_PERCENTILES[] = { 50, 90, 99, 99.9 };
+
+const string STATE_HISTOGRAM_TAG = "StateHistogram";
+const string LINK_HISTOGRAM_TAG = "LinkHistogram";
+const string TOP_STATE_TAG = "TopState";
+const string TOP_LINK_TAG = "TopLink";
+const string ALL_CONTAINERS = "*";
+
+/**
+ * Values lower than the number of sub-buckets are stored exactly, then each
+ * power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets.
+ */
+unsigned int LogHistogram::bucketIndex(long long value) {
+	unsigned long long v = value < 0 ? 0 : value;
+
+	if (v < (unsigned long long) HISTOGRAM_SUB_BUCKETS)
+		return v;
+
+	int exponent = 63 - __builtin_clzll(v);
+	int shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+	unsigned int subBucket = (v >> shift) - HISTOGRAM_SUB_BUCKETS;
+
+	return (shift + 1) * HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+/**
+ * Highest value falling in the bucket
+ */
+long long LogHistogram::bucketUpperValue(unsigned int index) {
+	if (index < (unsigned int) HISTOGRAM_SUB_BUCKETS)
+		return index;
+
+	int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+	unsigned long long subBucket = index % HISTOGRAM_SUB_BUCKETS;
+	unsigned long long lower = (subBucket + HISTOGRAM_SUB_BUCKETS) << shift;
+
+	return lower + (1ULL << shift) - 1;
+}
+
+void LogHistogram::record(long long value) {
+	unsigned int index = bucketIndex(value);
+
+	if (index >= counts.size())
+		counts.resize(index + 1, 0);
+
+	counts[index]++;
+	totalCount++;
+	sum += value;
+
+	if (minValue == -1 || value < minValue)
+		minValue = value;
+	if (maxValue == -1 || value > maxValue)
+		maxValue = value;
+}
+
+/**
+ * Return the value under which the given percentage of the recorded values
+ * fall (up to the precision of the buckets)
+ */
+long long LogHistogram::percentile(double percent) const {
+	if (totalCount == 0)
+		return 0;
+
+	unsigned long long rank = (unsigned long long) (percent / 100.0
+			* totalCount + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	unsigned long long seen = 0;
+	for (unsigned int i = 0; i < counts.size(); i++) {
+		seen += counts[i];
+		if (seen >= rank)
+			return min(max(bucketUpperValue(i), minValue), maxValue);
+	}
+
+	return maxValue;
+}
+
+TopIntervals::TopIntervals(unsigned int capacity) {
+	this->capacity = capacity;
+}
+
+void TopIntervals::offer(long long start, long long end, const string & name,
+		const string & container) {
+	if (capacity == 0)
+		return;
+
+	long long duration = end - start;
+
+	// Not longer than the shortest kept interval
+	if (heap.size() == capacity && duration <= heap.front().duration)
+		return;
+
+	Interval interval = { duration, start, end, name, container };
+
+	if (heap.size() == capacity) {
+		pop_heap(heap.begin(), heap.end(), greater<Interval>());
+		heap.back() = interval;
+	} else {
+		heap.push_back(interval);
+	}
+	push_heap(heap.begin(), heap.end(), greater<Interval>());
+}
+
+/**
+ * Return the kept intervals, longest first
+ */
+vector<Interval> TopIntervals::sorted() const {
+	vector<Interval> result = heap;
+	sort(result.begin(), result.end(), greater<Interval>());
+	return result;
+}
+
+DurationStatistics::DurationStatistics(bool perContainer, unsigned int topCount) :
+		topStates(topCount), topLinks(topCount) {
+	this->perContainer = perContainer;
+}
+
+void DurationStatistics::addState(const string & container, const string & name,
+		long long start, long long end) {
+	stateHistograms[name].record(end - start);
+
+	if (perContainer)
+		containerHistograms[container][name].record(end - start);
+
+	topStates.offer(start, end, name, container);
+}
+
+void DurationStatistics::addLink(int appSend, int taskSend,
+		const string & sender, int appRcv, int taskRcv,
+		const string & receiver, long long start, long long end) {
+	linkHistograms[make_tuple(appSend, taskSend, appRcv, taskRcv)].record(
+			end - start);
+
+	topLinks.offer(start, end, sender, receiver);
+}
+
+/**
+ * Histogram line:
+ * 	tag, container, name, count, min, mean, p50, p90, p99, p99.9, max
+ */
+void DurationStatistics::writeHistogram(ostream & out, const string & tag,
+		const string & container, const string & name,
+		const LogHistogram & histogram) {
+	out << tag << PJDUMP_SEPARATOR;
+	out << container << PJDUMP_SEPARATOR;
+	out << name << PJDUMP_SEPARATOR;
+	out << histogram.getCount() << PJDUMP_SEPARATOR;
+	out << histogram.getMin() << PJDUMP_SEPARATOR;
+	out << (long long) histogram.getMean() << PJDUMP_SEPARATOR;
+
+	for (double p : REPORTED_PERCENTILES)
+		out << histogram.percentile(p) << PJDUMP_SEPARATOR;
+
+	out << histogram.getMax() << endl;
+}
+
+void DurationStatistics::writeReport(ostream & out) {
+	for (auto & it : stateHistograms)
+		writeHistogram(out, STATE_HISTOGRAM_TAG, ALL_CONTAINERS, it.first,
+				it.second);
+
+	for (auto & container : containerHistograms)
+		for (auto & it : container.second)
+			writeHistogram(out, STATE_HISTOGRAM_TAG, container.first,
+					it.first, it.second);
+
+	for (auto & it : linkHistograms) {
+		stringstream pair;
+		pair << "Task " << get<0>(it.first) << "." << get<1>(it.first)
+				<< " -> Task " << get<2>(it.first) << "."
+				<< get<3>(it.first);
+		writeHistogram(out, LINK_HISTOGRAM_TAG, ALL_CONTAINERS, pair.str(),
+				it.second);
+	}
+
+	// Top line: tag, container, name, start, end, duration
+	for (Interval & interval : topStates.sorted()) {
+		out << TOP_STATE_TAG << PJDUMP_SEPARATOR;
+		out << interval.container << PJDUMP_SEPARATOR;
+		out << interval.name << PJDUMP_SEPARATOR;
+		out << interval.start << PJDUMP_SEPARATOR;
+		out << interval.end << PJDUMP_SEPARATOR;
+		out << interval.duration << endl;
+	}
+
+	// For links the sender is stored as name and the receiver as container
+	for (Interval & interval : topLinks.sorted()) {
+		out << TOP_LINK_TAG << PJDUMP_SEPARATOR;
+		out << interval.name << PJDUMP_SEPARATOR;
+		out << interval.container << PJDUMP_SEPARATOR;
+		out << interval.start << PJDUMP_SEPARATOR;
+		out << interval.end << PJDUMP_SEPARATOR;
+		out << interval.duration << endl;
+	}
+}
@@ -0,0 +1,151 @@
+/*
+ * cacheFile.h
+ *
+ *  Binary cache files written next to the files they were built from.
+ */
+
+#ifndef INCLUDE_CACHEFILE_H_
+#define INCLUDE_CACHEFILE_H_
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include "common.h"
+
+// Header of the cache files
+const char CACHE_MAGIC[] = "PRV2PJDUMP";
+const unsigned int CACHE_VERSION = 3;
+
+/**
+ * Binary cache file, written in the native byte order (it is only meant to
+ * be read on the machine that produced it)
+ */
+class CacheFile {
+
+private:
+	FILE * file = nullptr;
+	bool valid = true;
+
+public:
+	~CacheFile() {
+		close();
+	}
+
+	bool open(const string & name, const char * mode) {
+		file = fopen(name.c_str(), mode);
+		valid = (file != nullptr);
+		return valid;
+	}
+
+	bool close() {
+		if (file != nullptr && fclose(file) != 0)
+			valid = false;
+		file = nullptr;
+		return valid;
+	}
+
+	bool isValid() const {
+		return valid;
+	}
+
+	template<typename T> void write(T value) {
+		valid = valid && fwrite(&value, sizeof(T), 1, file) == 1;
+	}
+
+	template<typename T> T read() {
+		T value = T();
+		valid = valid && fread(&value, sizeof(T), 1, file) == 1;
+		return value;
+	}
+
+	void writeBytes(const char * data, size_t size) {
+		valid = valid && fwrite(data, 1, size, file) == size;
+	}
+
+	void readBytes(char * data, size_t size) {
+		valid = valid && fread(data, 1, size, file) == size;
+	}
+
+	void writeVarint(unsigned long long value) {
+		while (value >= 0x80) {
+			write<unsigned char>((unsigned char) (value | 0x80));
+			value >>= 7;
+		}
+		write<unsigned char>((unsigned char) value);
+	}
+
+	unsigned long long readVarint() {
+		unsigned long long value = 0;
+		for (int shift = 0; valid && shift < 64; shift += 7) {
+			unsigned char byte = read<unsigned char>();
+			value |= (unsigned long long) (byte & 0x7f) << shift;
+			if (byte < 0x80)
+				return value;
+		}
+		valid = false;
+		return 0;
+	}
+
+	void writeString(const string & value) {
+		write<unsigned int>(value.size());
+		writeBytes(value.data(), value.size());
+	}
+
+	string readString() {
+		unsigned int size = read<unsigned int>();
+		if (!valid)
+			return "";
+
+		string value(size, '\0');
+		readBytes(&value[0], size);
+		return value;
+	}
+
+	void writeHeader(char kind, long long size, long long modification) {
+		writeBytes(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		write<unsigned int>(CACHE_VERSION);
+		write<char>(kind);
+		write<long long>(size);
+		write<long long>(modification);
+	}
+
+	bool checkHeader(char kind, long long size, long long modification) {
+		char magic[sizeof(CACHE_MAGIC)];
+		readBytes(magic, sizeof(CACHE_MAGIC));
+		valid = valid && memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+
+		return valid && read<unsigned int>() == CACHE_VERSION
+				&& read<char>() == kind && read<long long>() == size
+				&& read<long long>() == modification;
+	}
+
+	void writeNames(const map<int, string> & names) {
+		write<unsigned int>(names.size());
+		for (auto & it : names) {
+			write<int>(it.first);
+			writeString(it.second);
+		}
+	}
+
+	void readNames(map<int, string> & names) {
+		unsigned int count = read<unsigned int>();
+		for (unsigned int i = 0; valid && i < count; i++) {
+			int id = read<int>();
+			names.emplace_hint(names.end(), id, readString());
+		}
+	}
+};
+
+/**
+ * Size and modification time (in nanoseconds when available) identifying the
+ * version of a file
+ */
+bool fileIdentity(const string & filename, long long & size,
+		long long & modification);
+
+/**
+ * Close a cache written in cacheFile + ".tmp" and move it to cacheFile, so
+ * that an interrupted conversion never leaves a truncated cache
+ */
+bool commitCache(CacheFile & cache, const string & cacheFile);
+
+#endif /* INCLUDE_CACHEFILE_H_ */
@@ -0,0 +1,55 @@
+/*
+ * coalescer.h
+ *
+ *  Merge of the consecutive identical states of a container.
+ */
+
+#ifndef INCLUDE_COALESCER_H_
+#define INCLUDE_COALESCER_H_
+#include <vector>
+#include "common.h"
+#include "event.h"
+
+/**
+ * Keep one pending state per container and imbrication level. A new state
+ * with the same name, starting when the pending one ends (up to a
+ * tolerance), extends it; otherwise the pending state is flushed and
+ * replaced. With an absorb duration, a short state is merged into the
+ * adjacent state whatever their names.
+ */
+class Coalescer {
+
+private:
+	// Pending state per container index and imbrication level (the nested
+	// states of --event-pairs are merged with the states of their level)
+	vector<vector<State>> pendingStates;
+	vector<vector<bool>> hasPending;
+
+	// Maximal gap between two states that are merged
+	long long tolerance = 0;
+	// States shorter than this are merged whatever their name (0 to disable)
+	long long absorbDuration = 0;
+
+	unsigned long long mergedStates = 0;
+
+	bool isShort(const State & state) const;
+	bool canMerge(const State & pending, const State & state) const;
+
+public:
+	bool add(int containerIndex, const State & state, State & flushed);
+	vector<State> flushAll();
+
+	unsigned long long getMergedStates() const {
+		return mergedStates;
+	}
+
+	void setTolerance(long long tolerance) {
+		this->tolerance = tolerance;
+	}
+
+	void setAbsorbDuration(long long absorbDuration) {
+		this->absorbDuration = absorbDuration;
+	}
+};
+
+#endif /* INCLUDE_COALESCER_H_ */
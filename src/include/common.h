@@ -16,4 +16,7 @@ using namespace std;
 const char PRV_SEPARATOR = ':';
 const char PJDUMP_SEPARATOR = ',';
 
+// File name standing for the standard input or output
+const string STANDARD_STREAM = "-";
+
 #endif /* INCLUDE_COMMON_H_ */
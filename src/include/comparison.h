@@ -0,0 +1,140 @@
+/*
+ * comparison.h
+ *
+ *  Comparison of a baseline trace and a candidate trace: differences of the
+ *  time spent in each state and of the number of events, per container.
+ */
+
+#ifndef INCLUDE_COMPARISON_H_
+#define INCLUDE_COMPARISON_H_
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "timeFormat.h"
+#include "writer.h"
+
+#ifndef _WIN32
+#include <mutex>
+#endif
+
+const string STATE_DIFFERENCE_TAG = "StateDiff";
+const string EVENT_DIFFERENCE_TAG = "EventDiff";
+
+/**
+ * Identifiers of the names, shared by the writers of the two traces so that
+ * the same container or state gets the same identifier in both
+ */
+class NameTable {
+
+private:
+	vector<string> names;
+	unordered_map<string, unsigned int> identifiers;
+#ifndef _WIN32
+	mutex lock;
+#endif
+
+public:
+	unsigned int intern(const string & name);
+
+	/**
+	 * Name of an identifier (once the traces have been read)
+	 */
+	const string & getName(unsigned int identifier) const {
+		return names[identifier];
+	}
+};
+
+/**
+ * Totals of a (container, name) pair of a trace
+ */
+struct ComparedTotals {
+	unsigned long long states = 0;
+	long long time = 0;
+	unsigned long long events = 0;
+};
+
+/**
+ * Add up the states and events of one trace, by container and name. The
+ * identifiers are first looked up in a table of the writer, the shared table
+ * (and its lock) being used only for the names not seen yet.
+ */
+class ComparisonWriter: public TraceWriter {
+
+private:
+	NameTable & containers;
+	NameTable & names;
+	unordered_map<string, unsigned int> containerIds;
+	unordered_map<string, unsigned int> nameIds;
+
+	// Container identifier in the high half, name identifier in the low half
+	unordered_map<unsigned long long, ComparedTotals> totals;
+	int traceUnit = DEFAULT_TRACE_UNIT;
+
+	unsigned int identify(NameTable & table,
+			unordered_map<string, unsigned int> & cache, const string & name);
+	ComparedTotals & totalsOf(const string & container, const string & name);
+
+public:
+	ComparisonWriter(NameTable & containers, NameTable & names);
+
+	void setTraceUnit(int unit);
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void close();
+
+	const unordered_map<unsigned long long, ComparedTotals> & getTotals() const {
+		return totals;
+	}
+
+	int getTraceUnit() const {
+		return traceUnit;
+	}
+};
+
+/**
+ * The writers of the baseline and candidate traces, and the report of their
+ * differences:
+ *
+ * StateDiff,container,state,baseCount,candidateCount,baseTime,candidateTime,change
+ * EventDiff,container,event,baseCount,candidateCount,change
+ *
+ * The states are ranked by absolute change of time, then the events by
+ * absolute change of count. The times are compared in the finer unit of the
+ * two traces.
+ */
+class TraceComparison {
+
+private:
+	NameTable containers;
+	NameTable names;
+	ComparisonWriter base;
+	ComparisonWriter candidate;
+
+public:
+	TraceComparison();
+
+	ComparisonWriter * getBaseWriter() {
+		return &base;
+	}
+
+	ComparisonWriter * getCandidateWriter() {
+		return &candidate;
+	}
+
+	/**
+	 * Write the differences whose absolute value (time for the states, count
+	 * for the events) is above the threshold, the times with the given format
+	 *
+	 * @return the number of differences written
+	 */
+	unsigned long long writeReport(ostream & out, long long threshold,
+			TimeFormat timeFormat) const;
+};
+
+#endif /* INCLUDE_COMPARISON_H_ */
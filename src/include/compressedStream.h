@@ -0,0 +1,123 @@
+/*
+ * compressedStream.h
+ *
+ *  Output stream compressed by independent blocks (gzip or zstd).
+ *  gzip needs WITH_ZLIB (and -lz), zstd needs WITH_ZSTD (and -lzstd).
+ */
+
+#ifndef INCLUDE_COMPRESSEDSTREAM_H_
+#define INCLUDE_COMPRESSEDSTREAM_H_
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <streambuf>
+#include <vector>
+#include "common.h"
+
+#ifndef _WIN32
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+const string GZIP_EXTENSION = ".gz";
+const string ZSTD_EXTENSION = ".zst";
+
+// Default size of the compressed blocks
+const size_t DEFAULT_COMPRESSION_BLOCK_SIZE = 4 * 1024 * 1024;
+// Largest size of the compressed blocks, in kilobytes
+const long long MAX_COMPRESSION_BLOCK_KB = 1024 * 1024;
+
+// Levels accepted by the formats (0 to 9 for gzip, 1 to 22 for zstd)
+const int MAX_GZIP_LEVEL = 9;
+const int MIN_ZSTD_LEVEL = 1;
+const int MAX_ZSTD_LEVEL = 22;
+
+enum Compression {
+	COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD
+};
+
+struct CompressionSettings {
+	// Compression level (-1 for the default level of the format)
+	int level = -1;
+	size_t blockSize = DEFAULT_COMPRESSION_BLOCK_SIZE;
+	// Number of compression threads (0 for one per core)
+	unsigned int threads = 0;
+};
+
+/**
+ * Compression of a file, given by its extension
+ */
+Compression compressionOf(const string & filename);
+
+/**
+ * Block of the output, compressed by one of the threads
+ */
+struct CompressedBlock {
+	vector<char> input;
+	vector<char> output;
+	bool done = false;
+	bool failed = false;
+};
+
+/**
+ * Stream buffer cutting the output into blocks that are compressed
+ * independently, each block giving a complete gzip member or zstd frame.
+ * The concatenation of the blocks is a standard stream that gzip and zstd
+ * decompress as a whole.
+ *
+ * The blocks are compressed in parallel and written in order; the writing
+ * thread waits when too many blocks are in progress. Without compression,
+ * the blocks are written as they are filled (used for the standard output,
+ * given as "-").
+ */
+class CompressedStreamBuffer: public streambuf {
+
+private:
+	FILE * file = nullptr;
+	// The standard output is flushed instead of being closed
+	bool closeFile = true;
+	Compression compression = COMPRESSION_NONE;
+	CompressionSettings settings;
+	bool failed = false;
+
+	// Block being filled
+	vector<char> block;
+	// Blocks being compressed, in output order
+	deque<shared_ptr<CompressedBlock>> pending;
+
+#ifndef _WIN32
+	vector<thread> workers;
+	deque<shared_ptr<CompressedBlock>> jobs;
+	bool stopping = false;
+	mutex lock;
+	condition_variable jobReady;
+	condition_variable blockDone;
+
+	void work();
+#endif
+
+	void compress(CompressedBlock & compressed);
+	void submitBlock();
+	void writeBlocks(bool wait);
+
+protected:
+	int overflow(int character);
+	streamsize xsputn(const char * data, streamsize size);
+	int sync();
+
+public:
+	~CompressedStreamBuffer();
+
+	bool open(const string & filename, Compression compression,
+			const CompressionSettings & settings, string & error);
+
+	/**
+	 * Compress and write the remaining data
+	 *
+	 * @return false if an error occurred since the opening
+	 */
+	bool close();
+};
+
+#endif /* INCLUDE_COMPRESSEDSTREAM_H_ */
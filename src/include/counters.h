@@ -0,0 +1,108 @@
+/*
+ * counters.h
+ *
+ *  Hardware counters of the event records converted into Variable time
+ *  series, with optional derived metrics.
+ */
+
+#ifndef INCLUDE_COUNTERS_H_
+#define INCLUDE_COUNTERS_H_
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+
+// Event types of the hardware counters written by Extrae (PAPI and native)
+const int COUNTER_TYPE_MIN = 42000000;
+const int COUNTER_TYPE_MAX = 42999999;
+
+// Default counters of the IPC
+const int PAPI_TOT_INS = 42000050;
+const int PAPI_TOT_CYC = 42000059;
+
+const string IPC_VARIABLE = "IPC";
+const string DELTA_SUFFIX = " delta";
+const string RATE_SUFFIX = " rate";
+
+/**
+ * Metrics derived from consecutive samples
+ */
+enum CounterMetric {
+	METRIC_DELTA = 1, METRIC_RATE = 2, METRIC_IPC = 4
+};
+
+/**
+ * Last sample of a counter in a container
+ */
+struct CounterSample {
+	long long time = 0;
+	long long value = 0;
+	bool seen = false;
+};
+
+/**
+ * Value of a counter or metric over an interval of a container
+ */
+struct CounterVariable {
+	string name;
+	long long start;
+	long long end;
+	double value;
+};
+
+/**
+ * As written by Extrae, the value of a counter is the count since the
+ * previous sample of the same thread, so each sample gives a Variable from
+ * the previous sample (or the start of the trace) to the sample time. The
+ * derived metrics are:
+ *
+ * - delta: difference with the previous value (for counters that are not
+ *   reset after each sample),
+ * - rate: value divided by the duration of the interval (per time unit of
+ *   the trace),
+ * - IPC: instructions divided by cycles, when both counters are in the same
+ *   record.
+ *
+ * The last samples are kept per counter in arrays indexed by container.
+ */
+class CounterSeries {
+
+private:
+	unsigned int metrics = 0;
+	int instructionsType = PAPI_TOT_INS;
+	int cyclesType = PAPI_TOT_CYC;
+
+	// Dense number of each counter type met in the trace
+	unordered_map<int, unsigned int> counterIndexes;
+	vector<string> counterNames;
+	// Last sample per counter, per container index
+	vector<vector<CounterSample>> samples;
+
+	unsigned long long sampleCount = 0;
+
+	unsigned int getCounter(int type, const map<int, string> & eventNames);
+
+public:
+	/**
+	 * Read the metrics as "delta,rate,ipc" (ipc=INS/CYC to choose the event
+	 * types of the IPC counters)
+	 */
+	bool setMetrics(const string & list, string & error);
+
+	static bool isCounter(int type) {
+		return type >= COUNTER_TYPE_MIN && type <= COUNTER_TYPE_MAX;
+	}
+
+	/**
+	 * Add the counters of an event record of a container (the parameters of
+	 * other types are ignored) and get the resulting variables
+	 */
+	void sample(int containerIndex, long long time,
+			const vector<pair<int, long long>> & params,
+			const map<int, string> & eventNames,
+			vector<CounterVariable> & variables);
+
+	void writeReport(ostream & out) const;
+};
+
+#endif /* INCLUDE_COUNTERS_H_ */
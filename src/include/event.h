@@ -31,7 +31,6 @@ public:
 	Event();
 	Event(long long timestamp, string container, string name);
 	virtual ~Event();
-	virtual string toPjdump();
 
 	// Getters and Setters
 	const string& getContainer() const {
@@ -87,7 +86,6 @@ private:
 public:
 	State();
 	State(long long timestamp, string container, string name, long long endtimeStamp);
-	string toPjdump();
 
 	// Getters and Setters
 	long long getEndDate() const {
@@ -115,7 +113,15 @@ private:
 public:
 	Link(long long timestamp, string container, string name,
 			long long endtimeStamp, string receiverContainer);
-	string toPjdump();
+
+	// Getters
+	long long getReceiveTimestamp() const {
+		return receiveTimestamp;
+	}
+
+	const string& getReceiverContainer() const {
+		return receiverContainer;
+	}
 };
 
 #endif /* INCLUDE_EVENT_H_ */
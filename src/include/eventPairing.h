@@ -0,0 +1,77 @@
+/*
+ * eventPairing.h
+ *
+ *  Conversion of begin/end event pairs into nested states.
+ */
+
+#ifndef INCLUDE_EVENTPAIRING_H_
+#define INCLUDE_EVENTPAIRING_H_
+#include <map>
+#include <vector>
+#include "common.h"
+#include "event.h"
+
+// Maximal number of regions open at the same time in a container
+const unsigned int MAX_REGION_DEPTH = 256;
+
+/**
+ * Region opened by an event with a non-zero value
+ */
+struct OpenRegion {
+	int type;
+	// State of the region, without its end date
+	State state;
+};
+
+/**
+ * Region closed at the end of the trace
+ */
+struct ClosedRegion {
+	int containerIndex;
+	State state;
+};
+
+/**
+ * Keep the open regions of each container in opening order. An event with a
+ * non-zero value opens a region, an event of the same type with the value 0
+ * closes the last region opened for this type. The imbrication of a region
+ * is the number of regions of its container that are open when it starts.
+ * The end events of the regions dropped at MAX_REGION_DEPTH are ignored.
+ */
+class EventPairing {
+
+private:
+	// Open regions per container index
+	vector<vector<OpenRegion>> openRegions;
+	// Number of regions dropped and not closed yet, per container index and
+	// type
+	vector<map<int, unsigned int>> droppedDepths;
+
+	unsigned long long pairedRegions = 0;
+	// End events without an open region of their type
+	unsigned long long unmatchedEnds = 0;
+	// Regions exceeding MAX_REGION_DEPTH
+	unsigned long long droppedRegions = 0;
+	// Regions still open at the end of the trace
+	unsigned long long unclosedRegions = 0;
+
+public:
+	void begin(int containerIndex, int type, const string & container,
+			const string & name, long long time);
+
+	/**
+	 * Close the last region of the given type opened in the container
+	 *
+	 * @return true if a region was closed, it is then copied in closed
+	 */
+	bool end(int containerIndex, int type, long long time, State & closed);
+
+	/**
+	 * Close the regions still open at the given time (end of the trace)
+	 */
+	vector<ClosedRegion> closeAll(long long time);
+
+	void writeReport(ostream & out) const;
+};
+
+#endif /* INCLUDE_EVENTPAIRING_H_ */
@@ -0,0 +1,124 @@
+/*
+ * histogram.h
+ *
+ *  Log-bucketed duration histograms built while the trace is parsed.
+ */
+
+#ifndef INCLUDE_HISTOGRAM_H_
+#define INCLUDE_HISTOGRAM_H_
+#include <map>
+#include <vector>
+#include <tuple>
+#include <fstream>
+#include "common.h"
+
+// Number of linear sub-buckets per power of two (relative error ~ 1/32)
+const int HISTOGRAM_SUB_BUCKET_BITS = 5;
+const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+
+/**
+ * HDR-style histogram: values are grouped in buckets whose width grows
+ * with the magnitude of the value, so the memory footprint only depends on
+ * the largest recorded value and not on the number of recorded values.
+ */
+class LogHistogram {
+
+private:
+	vector<unsigned long long> counts;
+	unsigned long long totalCount = 0;
+	long long minValue = -1;
+	long long maxValue = -1;
+	// Sum of the values, kept as a double to avoid overflowing
+	double sum = 0;
+
+	static unsigned int bucketIndex(long long value);
+	static long long bucketUpperValue(unsigned int index);
+
+public:
+	void record(long long value);
+	long long percentile(double percent) const;
+
+	unsigned long long getCount() const {
+		return totalCount;
+	}
+
+	long long getMin() const {
+		return minValue;
+	}
+
+	long long getMax() const {
+		return maxValue;
+	}
+
+	double getMean() const {
+		return totalCount == 0 ? 0 : sum / totalCount;
+	}
+};
+
+/**
+ * An interval kept by the top-K tracker
+ */
+struct Interval {
+	long long duration;
+	long long start;
+	long long end;
+	string name;
+	string container;
+
+	bool operator>(const Interval & other) const {
+		return duration > other.duration;
+	}
+};
+
+/**
+ * Keep the K longest intervals seen so far (min-heap on the duration)
+ */
+class TopIntervals {
+
+private:
+	unsigned int capacity;
+	vector<Interval> heap;
+
+public:
+	TopIntervals(unsigned int capacity = 10);
+	void offer(long long start, long long end, const string & name,
+			const string & container);
+	vector<Interval> sorted() const;
+};
+
+/**
+ * Collect the distributions of the state durations (per state type, and
+ * optionally per container) and of the link latencies (per pair of
+ * sender/receiver tasks).
+ */
+class DurationStatistics {
+
+private:
+	// Histograms of state durations, per state name
+	map<string, LogHistogram> stateHistograms;
+	// Histograms of state durations, per container then per state name
+	map<string, map<string, LogHistogram>> containerHistograms;
+	// Histograms of link latencies per (sender app, sender task, receiver app, receiver task)
+	map<tuple<int, int, int, int>, LogHistogram> linkHistograms;
+
+	TopIntervals topStates;
+	TopIntervals topLinks;
+
+	// Also build the histograms per container
+	bool perContainer = false;
+
+	void writeHistogram(ostream & out, const string & tag,
+			const string & container, const string & name,
+			const LogHistogram & histogram);
+
+public:
+	DurationStatistics(bool perContainer, unsigned int topCount);
+	void addState(const string & container, const string & name,
+			long long start, long long end);
+	void addLink(int appSend, int taskSend, const string & sender, int appRcv,
+			int taskRcv, const string & receiver, long long start,
+			long long end);
+	void writeReport(ostream & out);
+};
+
+#endif /* INCLUDE_HISTOGRAM_H_ */
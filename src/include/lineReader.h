@@ -0,0 +1,64 @@
+/*
+ * lineReader.h
+ *
+ *  Read a text file line by line through large blocks.
+ */
+
+#ifndef INCLUDE_LINEREADER_H_
+#define INCLUDE_LINEREADER_H_
+#include <cstdio>
+#include <vector>
+#include "common.h"
+
+// Size of the blocks read from the file
+const size_t LINE_READER_BLOCK_SIZE = 4 * 1024 * 1024;
+
+/**
+ * Split a file (or the standard input, given as "-") into lines without
+ * copying them: the returned pointers stay valid until the next call to
+ * nextLine().
+ */
+class LineReader {
+
+private:
+	FILE * file = nullptr;
+	vector<char> buffer;
+	// Unread data in the buffer
+	size_t dataBegin = 0;
+	size_t dataEnd = 0;
+	// Offset in the file of the beginning of the buffer
+	unsigned long long bufferOffset = 0;
+	bool endOfFile = false;
+
+	// Position of the last returned line
+	unsigned long long lineOffset = 0;
+	unsigned long long lineNumber = 0;
+
+	bool fill();
+
+public:
+	LineReader();
+	~LineReader();
+
+	bool open(const string & filename);
+	void close();
+
+	/**
+	 * Get the next line (without its end of line characters)
+	 *
+	 * @return false when there is no more line
+	 */
+	bool nextLine(const char *& line, size_t & length);
+
+	// Byte offset of the last returned line
+	unsigned long long getLineOffset() const {
+		return lineOffset;
+	}
+
+	// Number (starting at 1) of the last returned line
+	unsigned long long getLineNumber() const {
+		return lineNumber;
+	}
+};
+
+#endif /* INCLUDE_LINEREADER_H_ */
@@ -0,0 +1,148 @@
+/*
+ * pajeWriter.h
+ *
+ *  Native Paje trace output, read by pajeng and ViTE.
+ */
+
+#ifndef INCLUDE_PAJEWRITER_H_
+#define INCLUDE_PAJEWRITER_H_
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "writer.h"
+
+const string PAJE_OUTPUT_FORMAT = "paje";
+
+/**
+ * Alias and type of a declared container
+ */
+struct PajeContainer {
+	string alias;
+	unsigned int type;
+};
+
+/**
+ * Line of the trace body, waiting for the lines written before it
+ */
+struct PajeRecord {
+	long long time;
+	// Order of the lines at the same time: ends, starts, then ends of the
+	// records without duration
+	unsigned int order;
+	// Order in which the lines were received
+	unsigned long long sequence;
+	string line;
+};
+
+/**
+ * Order of the pending lines, the first one to write being at the top of the
+ * heap
+ */
+struct PajeRecordAfter {
+	bool operator()(const PajeRecord & a, const PajeRecord & b) const {
+		if (a.time != b.time)
+			return a.time > b.time;
+		if (a.order != b.order)
+			return a.order > b.order;
+		return a.sequence > b.sequence;
+	}
+};
+
+/**
+ * Paje lines: a header of event definitions, the declarations of the types,
+ * values and containers, then PajePushState / PajePopState, PajeNewEvent,
+ * PajeStartLink / PajeEndLink and PajeSetVariable lines.
+ *
+ * The container types follow the hierarchy of the header (Application, Node,
+ * Task, Thread). Each imbrication level of the states has its own state type,
+ * so that the nested states of event pairs are kept on separate stacks. The
+ * types, containers and values are referenced by short aliases, the state
+ * values getting the colors of the .pcf file.
+ *
+ * Paje readers need the lines in time order. The records are received by
+ * start time, so the start lines are written as they are received, while the
+ * lines at the end of the states and links wait in a heap until the next
+ * start line reaches their time: the memory used only depends on the number
+ * of open states and links. When the records may be received late (see
+ * TraceWriter::setUnsortedRecords), all the lines wait in the heap until the
+ * writer is closed. The declarations are written before the lines using
+ * them.
+ */
+class PajeFormat {
+
+private:
+	shared_ptr<const TraceConfig> config;
+	TimeFormat timeFormat;
+
+	unordered_map<string, PajeContainer> containers;
+	// Container types by parent type (0 for the root) and kind
+	map<pair<unsigned int, string>, unsigned int> containerTypes;
+	// State types by container type and imbrication level
+	map<pair<unsigned int, int>, unsigned int> stateTypes;
+	map<unsigned int, unsigned int> eventTypes;
+	map<pair<unsigned int, string>, unsigned int> variableTypes;
+	map<pair<unsigned int, unsigned int>, unsigned int> linkTypes;
+	// Alias of each type (type 0 being the root), and of the values of each
+	// type by name
+	vector<string> typeAliases = { "0" };
+	vector<unordered_map<string, string>> values;
+
+	// Declarations not written yet, and whether the header was written
+	string declarations;
+	bool headerWritten = false;
+
+	// Write all the lines when the writer is closed
+	bool unsorted = false;
+	// Line being built, lines waiting to be written, and time of the last
+	// written line
+	PajeRecord record;
+	priority_queue<PajeRecord, vector<PajeRecord>, PajeRecordAfter> pending;
+	unsigned long long recordCount = 0;
+	long long lastTime = 0;
+	unsigned long long valueCount = 0;
+	unsigned long long linkCount = 0;
+
+	unsigned int addType(int event, const string & fields, const string & name);
+	unsigned int stateType(unsigned int containerType, int imbrication);
+	unsigned int eventType(unsigned int containerType);
+	unsigned int variableType(unsigned int containerType, const string & name);
+	unsigned int linkType(unsigned int startType, unsigned int endType);
+	const string & valueOf(unsigned int type, const string & name);
+	const PajeContainer * findContainer(const string & name) const;
+	void startRecord(long long time, unsigned int order, int event);
+	void endRecord(ostream & out);
+	void writeDeclarations(ostream & out);
+	void writeLine(ostream & out, const PajeRecord & line);
+
+public:
+	void setConfig(shared_ptr<const TraceConfig> config);
+
+	void setTimeFormat(const TimeFormat & timeFormat) {
+		this->timeFormat = timeFormat;
+	}
+
+	void setTraceUnit(int unit) {
+		timeFormat.setTraceUnit(unit);
+	}
+
+	void setUnsortedRecords() {
+		unsorted = true;
+	}
+
+	void writeContainer(ostream & out, const string & parent,
+			const string & name, const string & kind, long long start,
+			long long end);
+	void writeState(ostream & out, const State & state);
+	void writeEvent(ostream & out, const Event & event);
+	void writeLink(ostream & out, const Link & link);
+	void writeVariable(ostream & out, const string & container,
+			const string & name, long long start, long long end,
+			double value);
+	void finish(ostream & out);
+};
+
+typedef TextWriter<PajeFormat> PajeWriter;
+
+#endif /* INCLUDE_PAJEWRITER_H_ */
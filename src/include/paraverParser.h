@@ -1,30 +1,50 @@
 #ifndef PARAVER_PARSER_H
 #define PARAVER_PARSER_H
 #include <map>
+#include <memory>
 #include <regex>
 #include <fstream>
 #include <vector>
 #include <sstream>
 #include <set>
+#include <tuple>
 #include "common.h"
 #include "event.h"
+#include "histogram.h"
+#include "record.h"
+#include "reduction.h"
+#include "coalescer.h"
+#include "writer.h"
+#include "rollup.h"
+#include "eventPairing.h"
+#include "counters.h"
+#include "traceConfig.h"
+#include "recordCache.h"
+#include "traceIndex.h"
 
 using namespace std;
 
+// The records are in the unit of the header
+const int NO_RECORD_UNIT = 1;
+
 /**
  * Note: works only for one application
  */
 class ParaverParser {
 
 private:
-	// Match the names of the states with their IDs
-	map<int, string> stateNames;
-	// Match the names of the events with their IDs
-	map<int, string> eventNames;
-	// Match the names of the event value with their IDs
-	map<int, map<int, string>> eventTypes;
+	// Names read from the .pcf and .row files (shared between the parsers of
+	// the query server)
+	shared_ptr<const TraceConfig> config = make_shared<TraceConfig>();
+	// Use the binary cache of the .pcf and .row files
+	bool useConfigCache = false;
+	// Use the binary cache of the parsed records of the .prv file
+	bool useRecordCache = false;
 
 	long long traceDuration = 0;
+	// Unit of the times of the records, when they were converted from the
+	// unit of the header (NO_RECORD_UNIT otherwise)
+	int recordUnit = NO_RECORD_UNIT;
 	int numberOfTasks = 0;
 	int numberofApplications = 0;
 	int numberOfNodes = 0;
@@ -38,18 +58,12 @@ private:
 	// Path to the output file
 	string outputFile;
 
-	// The output file
-	ofstream pjdumpFile;
-
-	// Match the name of the resources from the row file
-	// The first key is the level (CPU, NODE, THREAD, etc.)
-	map<string, vector<string>> resourceNames;
+	// Backend writing the output file
+	TraceWriter * writer = nullptr;
 
 	// Contains the names of the leave producer in the hierarchy (typically the threads)
 	map<int, map<int, map<int, string>>> threadProducers;
 
-	// Store keywords of the .cfg configuration file
-	set<string> keyWords;
 	// Number of processors per node
 	vector<int> nbProcPerNode;
 
@@ -57,32 +71,154 @@ private:
 	vector<int> taskThread;
 	// Node executing the task
 	vector<int> taskNode;
+	// Number of threads of each task declared in the header, per application
+	vector<vector<int>> applicationThreads;
+	// Node executing each task, per application
+	vector<vector<int>> applicationNodes;
+	// Dense index of the first thread of each task, per application
+	vector<vector<int>> threadOffsets;
+	int containerCount = 0;
+	// Dense index of the threads that are not declared in the header
+	map<tuple<int, int, int>, int> undeclaredContainers;
 
 	// Specify if we use the paraver events to build the pjdump states
 	bool useEventForState = false;
 
-	void parseConf(string confFile);
-	void parseTrace(string traceFile);
-	void parseResource(string resourceFile);
-	string trim(string aString);
-	bool contains(set<string> v, string element);
-	void parseEventConf(ifstream * file, string line);
-	void parseHeader(string headerLine);
-	string parseEvent(string line);
-	string parseState(string line);
-	string parseLink(string line);
-	string parseRecord(string line);
+	// Duration and latency distributions (optional)
+	DurationStatistics * statistics = nullptr;
+
+	// Reduction of the output (optional)
+	Reducer * reducer = nullptr;
+
+	// Merge of the consecutive identical states (optional)
+	Coalescer * coalescer = nullptr;
+
+	// Conversion of the begin/end events into nested states (optional)
+	EventPairing * eventPairing = nullptr;
+
+	// Index of the records by container, saved next to the trace (optional)
+	TraceIndex * index = nullptr;
+
+	// Conversion of the hardware counters into variables (optional)
+	CounterSeries * counters = nullptr;
+	vector<CounterVariable> counterVariables;
+
+	// Aggregation of the thread states at a higher level (optional)
+	RollUp * rollUp = nullptr;
+	RollUpLevel level = LEVEL_THREAD;
+	// Names of the parent containers at the roll-up level, per parent index
+	vector<string> parentNames;
+
+	// Prefix of the container names, keeping apart the traces merged into
+	// one output
+	string containerPrefix = "";
+
+	// Skip the malformed records instead of stopping the conversion
+	bool skipErrors = false;
+	unsigned long long skippedRecords = 0;
+
+	bool parseTrace(string traceFile);
+	bool contains(const set<string> & s, const string & element);
+	string qualify(const string & name);
+	void parseEvent(const PrvRecord & record);
+	void parseState(const PrvRecord & record);
+	void writeThreadState(int containerIndex, State & state);
+	void parseLink(const PrvRecord & record);
+	bool pairRegions(const PrvRecord & record, int & otherType);
+	bool sampleCounters(const PrvRecord & record, int & otherType);
+	string checkObject(int cpuID, int appID, int taskID, int threadID);
 	string getStateName(int type);
 	string getEventName(int type);
 	string getContainerName(int cpuID, unsigned int taskID, int threadID);
+	string getNodeName(unsigned int nodeNumber);
+	string getOutputContainerName(int appID, int taskID, int threadID);
+	int getParentIndex(int appID, int taskID);
+	int getContainerIndex(int appID, int taskID, int threadID);
 
 	string buildProducers();
 	void buildContainer(int cpuID, int taskID, int threadID, string parent);
-	void buildContainer(string name, string parentName);
+	void buildContainer(string name, string parentName, const string & kind);
 
 public:
 	ParaverParser(bool eventForState);
-	void parse(string traceFile, string confFile, string resourceFile, string outputFile);
+	~ParaverParser();
+	bool parse(string traceFile, string confFile, string resourceFile, string outputFile);
+
+	bool validate(string traceFile, unsigned int maxReported);
+
+	// Conversion of a subset of the records (used by the query server and the
+	// merge of traces): the header must be parsed before the records, through
+	// an opened writer, and finish() called after them
+	void parseHeader(string headerLine);
+	void parseRecord(const PrvRecord & record);
+	void finish();
+
+	void setConfig(shared_ptr<const TraceConfig> config) {
+		this->config = config;
+	}
+
+	void setWriter(TraceWriter * writer) {
+		this->writer = writer;
+	}
+
+	void setStatistics(DurationStatistics * statistics) {
+		this->statistics = statistics;
+	}
+
+	void setReducer(Reducer * reducer) {
+		this->reducer = reducer;
+	}
+
+	void setCoalescer(Coalescer * coalescer) {
+		this->coalescer = coalescer;
+	}
+
+	void setEventPairing(EventPairing * eventPairing) {
+		this->eventPairing = eventPairing;
+	}
+
+	void setIndex(TraceIndex * index) {
+		this->index = index;
+	}
+
+	void setCounters(CounterSeries * counters) {
+		this->counters = counters;
+	}
+
+	void setRollUp(RollUp * rollUp, RollUpLevel level) {
+		this->rollUp = rollUp;
+		this->level = level;
+	}
+
+	void setUseConfigCache(bool useConfigCache) {
+		this->useConfigCache = useConfigCache;
+	}
+
+	void setUseRecordCache(bool useRecordCache) {
+		this->useRecordCache = useRecordCache;
+	}
+
+	void setContainerPrefix(const string & containerPrefix) {
+		this->containerPrefix = containerPrefix;
+	}
+
+	/**
+	 * Unit of the times of the records given to parseRecord, finer than the
+	 * unit of the header (set before parseHeader)
+	 */
+	void setRecordUnit(int recordUnit) {
+		this->recordUnit = recordUnit;
+	}
+
+	/**
+	 * Time unit given by a header, DEFAULT_TRACE_UNIT if it has none or an
+	 * unknown one
+	 */
+	static int readTraceUnit(string headerLine);
+
+	void setSkipErrors(bool skipErrors) {
+		this->skipErrors = skipErrors;
+	}
 
 	// Default values for the states as described in www.bsc.es/media/1370.pdf
 	static map<int, string> create_map() {
@@ -1,23 +1,115 @@
 #ifndef INCLUDE_PRV2PJDUMP_H_
 #define INCLUDE_PRV2PJDUMP_H_
 #include <getopt.h>
+#ifndef _WIN32
+#include <thread>
+#endif
 #include "common.h"
 #include "paraverParser.h"
+#include "queryServer.h"
+#include "sinks.h"
 
 class Prv2Pjdump {
 private:
 	string inputFile = "";
+	// Traces given on the command line, merged into one output if several
+	vector<string> inputFiles;
 	string confFile = "";
 	string outputFile = "";
 	string resourceFile = "";
+	// .pcf and .row files given explicitly (needed for the standard input)
+	string pcfFile = "";
+	string rowFile = "";
 	bool useEventForState = false;
+	// Build nested states from the begin/end events
+	bool pairEvents = false;
+	// Write the hardware counters as variables, with the derived metrics
+	bool useCounters = false;
+	string counterMetrics = "";
+	// Format of the output file
+	string outputFormat = PJDUMP_OUTPUT_FORMAT;
+	// Outputs produced together (TYPE:FILE), replacing the output file
+	vector<string> outputs;
+	// Run each output on its own thread
+	bool sinkThreads = false;
+	// Compression of the .gz and .zst outputs
+	CompressionSettings compression;
+	// Unit and decimals of the times in the text outputs (empty unit to keep
+	// the times of the trace)
+	string timeUnit = "";
+	int timePrecision = EXACT_PRECISION;
+	TimeFormat timeFormat;
+	// Duration histograms report (empty if disabled)
+	string histogramFile = "";
+	bool histogramPerContainer = false;
+	unsigned int histogramTopCount = 10;
+	// Only check the trace
+	bool validateOnly = false;
+	// Maximum number of problems printed by the validation
+	unsigned int maxReportedErrors = 100;
+	bool skipErrors = false;
+	// Reduction of the output
+	long long minDuration = 0;
+	long long eventRateCount = 0;
+	long long eventRateWindow = 0;
+	unsigned int sampleInterval = 0;
+	unsigned int reservoirSize = 0;
+	// Merge of the consecutive identical states
+	bool coalesce = false;
+	long long coalesceGap = 0;
+	// Aggregation of the thread states
+	RollUpLevel level = LEVEL_THREAD;
+	RollUpMode rollUpMode = ROLLUP_DOMINANT;
+	// Use a binary cache of the .pcf and .row files
+	bool useConfigCache = false;
+	// Use a binary cache of the parsed records
+	bool useRecordCache = false;
+	// Write the index of the records by container next to the trace
+	bool useIndex = false;
+	// Container extracted through the index (app.task.thread, empty if
+	// disabled)
+	string extractedContainer = "";
+	// Query server (empty socket path if disabled)
+	string serverSocket = "";
+	// Number of threads answering the queries (0 for one per core)
+	unsigned int serverThreads = 0;
+	size_t queryCacheSize = DEFAULT_QUERY_CACHE_SIZE;
+	// Baseline trace compared with the input file (empty if disabled), and
+	// smallest difference written
+	string baselineFile = "";
+	long long compareThreshold = 0;
+	// Timeline of the stages of the converter (empty if disabled)
+	string selfTraceFile = "";
+
+	// Optional stages of the conversion, built by setUpParser
+	DurationStatistics * statistics = nullptr;
+	Reducer * reducer = nullptr;
+	Coalescer * coalescer = nullptr;
+	CounterSeries * counters = nullptr;
+	EventPairing * eventPairing = nullptr;
+	RollUp * rollUp = nullptr;
 
 public:
-	void launch(int argc, char **argv);
+	int launch(int argc, char **argv);
 	int handleFilenames();
+	int findConfigFiles();
+	int serve();
+	int extract(TraceWriter * writer);
+	bool setUpParser(ParaverParser & parser, TraceWriter * writer);
+	void writeReports();
+	bool checkMergeOptions();
+	bool checkStreamOptions();
+	bool checkCompareOptions();
+	int compare();
+	void writeSelfTrace();
+	int merge(TraceWriter * writer);
+	shared_ptr<TraceConfig> loadConfig();
+	TraceWriter * createOutputs();
 };
 
 void printHelp();
+bool parseInteger(const string & option, const char * text, long long minimum,
+		long long maximum, long long & value);
 bool exist(string filename);
 
 #endif /* INCLUDE_PRV2PJDUMP_H_ */
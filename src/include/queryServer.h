@@ -0,0 +1,126 @@
+/*
+ * queryServer.h
+ *
+ *  Answer queries on an indexed trace through a Unix domain socket.
+ */
+
+#ifndef INCLUDE_QUERYSERVER_H_
+#define INCLUDE_QUERYSERVER_H_
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "traceConfig.h"
+#include "traceIndex.h"
+
+// Default size of the query cache (in bytes)
+const size_t DEFAULT_QUERY_CACHE_SIZE = 64 * 1024 * 1024;
+
+#ifndef _WIN32
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <unordered_map>
+
+/**
+ * Query read from a request line:
+ *
+ * window START END [threads=LIST] [format=pjdump|binary]
+ * summary START END [threads=LIST]
+ * info
+ *
+ * LIST is a comma separated list of app.task.thread, app.task or app.
+ */
+struct Query {
+	string command;
+	long long start = 0;
+	long long end = 0;
+	string format;
+	// Dense indexes of the selected threads (sorted, empty for all)
+	vector<int> containers;
+};
+
+/**
+ * Record of a binary window result, in the native byte order. The
+ * containers are the dense indexes listed by the info query; an event with
+ * several (type, value) pairs gives one record per pair.
+ */
+struct QueryRecord {
+	int category;
+	int container;
+	// Receiver of a link, -1 otherwise
+	int receiver;
+	// State type, event type or link tag
+	int type;
+	long long start;
+	long long end;
+	// Event value or link size
+	long long value;
+};
+
+/**
+ * Results of the last queries, evicted in least recently used order once
+ * their total size exceeds the capacity
+ */
+class QueryCache {
+
+private:
+	size_t capacity;
+	size_t size = 0;
+	mutex lock;
+	list<pair<string, shared_ptr<const string>>> entries;
+	unordered_map<string,
+			list<pair<string, shared_ptr<const string>>>::iterator> positions;
+
+public:
+	QueryCache(size_t capacity);
+
+	shared_ptr<const string> get(const string & key);
+	void put(const string & key, shared_ptr<const string> result);
+};
+
+/**
+ * Serve the queries with a pool of threads. Each connection is handled by
+ * one thread, which answers its requests in order; the index and the names
+ * of the trace are shared read-only between the threads.
+ */
+class QueryServer {
+
+private:
+	const TraceIndex & index;
+	shared_ptr<const TraceConfig> config;
+	bool useEventForState;
+	unsigned int threadCount;
+	QueryCache cache;
+
+	// Accepted connections waiting for a thread (-1 stops a thread)
+	queue<int> connections;
+	mutex connectionLock;
+	condition_variable connectionReady;
+	// Connections being served
+	set<int> activeConnections;
+
+	void work();
+	void serveConnection(int connection);
+	shared_ptr<const string> answer(const string & request, string & error);
+	bool parseQuery(const string & request, Query & query, string & error);
+	string runWindow(const Query & query);
+	string runSummary(const Query & query);
+	string runInfo();
+
+public:
+	QueryServer(const TraceIndex & index, shared_ptr<const TraceConfig> config,
+			bool useEventForState, unsigned int threadCount,
+			size_t cacheSize);
+
+	/**
+	 * Listen on the socket until SIGINT or SIGTERM is received
+	 */
+	bool run(const string & socketPath);
+};
+
+#endif /* _WIN32 */
+
+#endif /* INCLUDE_QUERYSERVER_H_ */
@@ -0,0 +1,102 @@
+/*
+ * rasterWriter.h
+ *
+ *  Timeline image of the states, rendered while the trace is converted.
+ */
+
+#ifndef INCLUDE_RASTERWRITER_H_
+#define INCLUDE_RASTERWRITER_H_
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "writer.h"
+
+const string IMAGE_OUTPUT_FORMAT = "image";
+const string PNG_EXTENSION = ".png";
+
+// Default number of time buckets (columns) of the image
+const unsigned int DEFAULT_IMAGE_WIDTH = 1024;
+// Number of rows rasterized together at the end
+const unsigned int RASTER_BAND_ROWS = 1024;
+// Color of the pixels without state (0xRRGGBB)
+const unsigned int RASTER_BACKGROUND = 0x000000;
+
+/**
+ * Time spent in one state in a column that it only partly covers
+ */
+struct PartialPixel {
+	unsigned int column;
+	unsigned short state;
+	long long duration;
+};
+
+/**
+ * Accumulators of one row (container) of the image
+ */
+struct RasterRow {
+	string name;
+	// Containers having children get a row only if they hold states
+	bool hasChildren = false;
+	// State covering the whole bucket of each column (0 if none, otherwise
+	// the state number + 1), allocated with the first state
+	vector<unsigned short> pixels;
+	vector<PartialPixel> partials;
+	// Number of partial pixels above which they are merged, raised after
+	// each merge so that a row with many states per column is not merged
+	// again after every state
+	size_t partialLimit = 0;
+};
+
+/**
+ * Render the trace as an image (PNG if the file ends with .png, which needs
+ * WITH_ZLIB, binary PPM otherwise): one row per container, in the order of
+ * the hierarchy built from the header, and one column per time bucket of the
+ * trace duration. Each pixel gets the color of the state taking the most
+ * time in its bucket, from the STATES_COLOR section of the .pcf file.
+ *
+ * The states are accumulated per row in a single pass: the columns fully
+ * covered by a state are set directly, the partly covered ones keep the time
+ * of each state until the rows are rasterized, in parallel, when the writer
+ * is closed. Only the leaf containers and the containers holding states get
+ * a row.
+ */
+class RasterWriter: public TraceWriter {
+
+private:
+	string outputFile;
+	unsigned int width;
+	long long duration = 0;
+
+	vector<RasterRow> rows;
+	unordered_map<string, unsigned int> rowIndexes;
+
+	shared_ptr<const TraceConfig> config;
+	// Colors of the states, in the order they were first met
+	vector<unsigned int> stateColors;
+	unordered_map<string, unsigned short> stateIndexes;
+
+	RasterRow & getRow(const string & name);
+	unsigned short getState(const string & name);
+	long long bucketStart(unsigned int column) const;
+	unsigned int columnOf(long long time) const;
+	void rasterize(const RasterRow & row, vector<unsigned char> & line) const;
+	void rasterizeBand(const vector<const RasterRow *> & band,
+			vector<vector<unsigned char>> & lines) const;
+	bool writeImage(const vector<const RasterRow *> & kept);
+
+public:
+	RasterWriter(unsigned int width = DEFAULT_IMAGE_WIDTH);
+
+	void setConfig(shared_ptr<const TraceConfig> config);
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void close();
+};
+
+#endif /* INCLUDE_RASTERWRITER_H_ */
@@ -0,0 +1,76 @@
+/*
+ * record.h
+ *
+ *  Tokenizer for the records of a .prv file.
+ */
+
+#ifndef INCLUDE_RECORD_H_
+#define INCLUDE_RECORD_H_
+#include <vector>
+#include "common.h"
+
+const int STATE_CATEGORY = 1;
+const int EVENT_CATEGORY = 2;
+const int LINK_CATEGORY = 3;
+
+/**
+ * Fields of a record, as integers
+ *
+ * State: 1:cpuID:appID:taskID:threadID:startTime:endTime:type
+ * Event: 2:cpuID:appID:taskID:threadID:time:type:value[:type:value]*
+ * Link:  3:cpuID:appID:taskID:threadID:wantedSendTime:actualSendTime:
+ *        cpuID:appID:taskID:threadID:wantedReceiveTime:actualReceiveTime:size:tag
+ */
+struct PrvRecord {
+	int category = 0;
+
+	// Object producing the record (sender for links)
+	int cpuID = 0;
+	int appID = 0;
+	int taskID = 0;
+	int threadID = 0;
+
+	// Start time of a state, time of an event, actual send time of a link
+	long long time = 0;
+	// End time of a state, actual receive time of a link
+	long long endTime = 0;
+
+	// State type
+	int stateType = 0;
+
+	// Event (type, value) pairs
+	vector<pair<int, long long>> params;
+
+	// Link specific fields
+	long long wantedSendTime = 0;
+	int cpuIDReceive = 0;
+	int appIDReceive = 0;
+	int taskIDReceive = 0;
+	int threadIDReceive = 0;
+	long long wantedReceiveTime = 0;
+	long long size = 0;
+	int tag = 0;
+};
+
+enum TokenizeResult {
+	// The record was tokenized
+	RECORD_OK,
+	// Line that is not a record (empty, comment, communicator...)
+	RECORD_IGNORED,
+	// Record of a category that is not handled
+	RECORD_UNSUPPORTED,
+	// The line is not a valid record
+	RECORD_MALFORMED
+};
+
+/**
+ * Tokenize the line [begin, end) into the given record.
+ *
+ * The line is read in place and no memory is allocated (apart from the
+ * growth of the event parameters). On RECORD_MALFORMED, error describes the
+ * problem.
+ */
+TokenizeResult tokenizeRecord(const char * begin, const char * end,
+		PrvRecord & record, string & error);
+
+#endif /* INCLUDE_RECORD_H_ */
@@ -0,0 +1,114 @@
+/*
+ * recordCache.h
+ *
+ *  Binary cache of the parsed records of a .prv file.
+ */
+
+#ifndef INCLUDE_RECORDCACHE_H_
+#define INCLUDE_RECORDCACHE_H_
+#include <map>
+#include <tuple>
+#include <vector>
+#include "common.h"
+#include "cacheFile.h"
+#include "record.h"
+
+// Suffix of the record cache written next to the .prv file
+const string RECORD_CACHE_EXTENSION = ".cache";
+
+// Number of records per block of the cache
+const unsigned int RECORD_CACHE_BLOCK_RECORDS = 65536;
+
+/**
+ * The cache starts with the header of the CacheFile (identifying the .prv
+ * file) and the header line of the trace, followed by blocks:
+ *
+ * unsigned int size, unsigned int count, long long firstTime, long long lastTime
+ * size bytes holding count records
+ *
+ * A block without record ends the cache. Each record starts with its
+ * category, or 0 for the definition of an object (cpu, application, task,
+ * thread), which is then referenced by its number in the block. Integers are
+ * varints (zigzag encoded when signed) and the times are encoded as the
+ * difference with the previous record of the block, so that blocks can be
+ * decoded independently.
+ */
+class RecordCacheWriter {
+
+private:
+	CacheFile cache;
+	string cacheFile;
+	bool opened = false;
+
+	// Block being built
+	string payload;
+	unsigned int recordCount = 0;
+	long long firstTime = 0;
+	long long lastTime = 0;
+	long long previousTime = 0;
+	map<tuple<int, int, int, int>, unsigned int> objects;
+
+	unsigned int getObject(int cpuID, int appID, int taskID, int threadID);
+	void flushBlock();
+
+public:
+	/**
+	 * Start the cache of a trace (in a temporary file until commit)
+	 */
+	bool open(const string & traceFile, const string & header);
+	void add(const PrvRecord & record);
+
+	/**
+	 * End the cache and make it available to the next conversions
+	 */
+	bool commit();
+
+	/**
+	 * Drop an incomplete cache
+	 */
+	void discard();
+};
+
+class RecordCacheReader {
+
+private:
+	CacheFile cache;
+	string header;
+	bool valid = true;
+
+	// Block being decoded
+	vector<char> payload;
+	size_t position = 0;
+	unsigned int remaining = 0;
+	long long previousTime = 0;
+	vector<tuple<int, int, int, int>> objects;
+
+	bool readBlock();
+
+public:
+	/**
+	 * Open the cache of a trace
+	 *
+	 * @return false if there is no cache, or if it does not match the
+	 * current version of the trace
+	 */
+	bool open(const string & traceFile);
+
+	/**
+	 * Decode the next record
+	 *
+	 * @return false at the end of the cache or if it is corrupted
+	 */
+	bool next(PrvRecord & record);
+
+	const string & getHeader() const {
+		return header;
+	}
+
+	// False if the cache was corrupted
+	bool isValid() const {
+		return valid;
+	}
+};
+
+#endif /* INCLUDE_RECORDCACHE_H_ */
@@ -0,0 +1,93 @@
+/*
+ * reduction.h
+ *
+ *  Reduction of the states and events written in the output.
+ */
+
+#ifndef INCLUDE_REDUCTION_H_
+#define INCLUDE_REDUCTION_H_
+#include <map>
+#include <vector>
+#include <random>
+#include "common.h"
+#include "event.h"
+
+/**
+ * Decide, before they are formatted, which states and events are kept:
+ * 	- states shorter than a minimum duration are dropped
+ * 	- events of a given type are limited to a number per time window
+ * 	- events are sampled per container, either deterministically (1 in N)
+ * 	  or with a reservoir of K events per container
+ */
+class Reducer {
+
+private:
+	// States strictly shorter than this are dropped (0 to keep all)
+	long long minDuration = 0;
+
+	// At most eventRateCount events of each type per eventRateWindow
+	long long eventRateCount = 0;
+	long long eventRateWindow = 0;
+	// Current window and number of events in it, per event type
+	map<int, pair<long long, long long>> eventRates;
+
+	// Keep 1 event in sampleInterval per container (0 or 1 to keep all)
+	unsigned int sampleInterval = 0;
+	vector<unsigned long long> sampleCounters;
+
+	// Number of events kept per container by reservoir sampling (0 to disable)
+	unsigned int reservoirSize = 0;
+	vector<vector<Event>> reservoirs;
+	vector<unsigned long long> reservoirSeen;
+	mt19937_64 generator;
+
+	// Report
+	unsigned long long keptStates = 0;
+	unsigned long long droppedStates = 0;
+	long long droppedStateTime = 0;
+	unsigned long long keptEvents = 0;
+	unsigned long long rateLimitedEvents = 0;
+	unsigned long long sampledOutEvents = 0;
+	map<int, unsigned long long> rateLimitedPerType;
+
+public:
+	Reducer();
+
+	bool keepState(long long start, long long end);
+	bool keepEvent(int containerIndex, int type, long long time);
+	void offerReservoir(int containerIndex, const Event & event);
+	vector<Event> takeReservoirs();
+	void writeReport(ostream & out);
+
+	bool isActive() const {
+		return minDuration > 0 || eventRateWindow > 0 || sampleInterval > 1
+				|| reservoirSize > 0;
+	}
+
+	bool useReservoir() const {
+		return reservoirSize > 0;
+	}
+
+	long long getMinDuration() const {
+		return minDuration;
+	}
+
+	void setMinDuration(long long minDuration) {
+		this->minDuration = minDuration;
+	}
+
+	void setEventRate(long long count, long long window) {
+		this->eventRateCount = count;
+		this->eventRateWindow = window;
+	}
+
+	void setSampleInterval(unsigned int sampleInterval) {
+		this->sampleInterval = sampleInterval;
+	}
+
+	void setReservoirSize(unsigned int reservoirSize) {
+		this->reservoirSize = reservoirSize;
+	}
+};
+
+#endif /* INCLUDE_REDUCTION_H_ */
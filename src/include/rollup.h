@@ -0,0 +1,78 @@
+/*
+ * rollup.h
+ *
+ *  Aggregation of the thread states at the task, node or application level.
+ */
+
+#ifndef INCLUDE_ROLLUP_H_
+#define INCLUDE_ROLLUP_H_
+#include <map>
+#include <queue>
+#include <vector>
+#include "common.h"
+#include "writer.h"
+
+enum RollUpLevel {
+	LEVEL_THREAD, LEVEL_TASK, LEVEL_NODE, LEVEL_APPLICATION
+};
+
+enum RollUpMode {
+	// State of the parent = state of the largest number of threads
+	ROLLUP_DOMINANT,
+	// One variable per state giving the number of threads in this state
+	ROLLUP_OCCUPANCY
+};
+
+/**
+ * Timeline of a parent container, built from the states of its threads
+ */
+struct ParentTimeline {
+	string name;
+	// End of the thread states in progress (end time, state index)
+	priority_queue<pair<long long, int>, vector<pair<long long, int>>,
+			greater<pair<long long, int>>> ends;
+	// Number of threads per state index
+	vector<int> counts;
+	// Occupancy mode: the count of each state has not changed since countSince
+	vector<long long> countSince;
+	// Occupancy mode: written value in progress for each state
+	vector<int> openValue;
+	vector<long long> openValueStart;
+	// Dominant mode: the counts have not changed since segmentStart
+	long long segmentStart = -1;
+	// Dominant mode: written state in progress (-1 if none)
+	int openState = -1;
+	long long openStart = 0;
+};
+
+/**
+ * Merge the states of the threads into their parent container in a single
+ * pass. Thread states arrive sorted by start time; the ends of the states in
+ * progress are kept per parent and processed when a later state starts.
+ */
+class RollUp {
+
+private:
+	RollUpMode mode;
+	TraceWriter * writer;
+
+	vector<ParentTimeline> parents;
+
+	// Dense index of the state types
+	map<int, int> stateIndexes;
+	vector<string> stateNames;
+
+	int getStateIndex(int type, const string & name);
+	void advance(ParentTimeline & parent, long long time);
+	void settle(ParentTimeline & parent, long long time);
+	void settleCount(ParentTimeline & parent, int state, long long time);
+	void change(ParentTimeline & parent, long long time, int state, int delta);
+
+public:
+	RollUp(RollUpMode mode, TraceWriter * writer);
+	void addState(int parentIndex, const string & parentName, long long start,
+			long long end, int type, const string & typeName);
+	void flush();
+};
+
+#endif /* INCLUDE_ROLLUP_H_ */
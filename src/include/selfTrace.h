@@ -0,0 +1,156 @@
+/*
+ * selfTrace.h
+ *
+ *  Timeline of the stages of the converter itself, per thread, written as a
+ *  pjdump or Paraver trace.
+ */
+
+#ifndef INCLUDE_SELFTRACE_H_
+#define INCLUDE_SELFTRACE_H_
+#include <memory>
+#include <vector>
+#include "common.h"
+
+/**
+ * Stages of the conversion, NO_STAGE when the thread is not traced
+ */
+enum TraceStage {
+	STAGE_READ,
+	STAGE_TOKENIZE,
+	STAGE_RESOLVE,
+	STAGE_FORMAT,
+	STAGE_WRITE,
+	STAGE_COMPRESS,
+	STAGE_QUEUE_WAIT,
+	// Time of records that were not timed stage by stage, in a batch
+	// without sampled record to share it
+	STAGE_RECORDS,
+	NO_STAGE
+};
+
+// Number of records whose interleaved stages give one span per stage
+const unsigned int SELF_TRACE_BATCH_SIZE = 4096;
+// One record out of SELF_TRACE_SAMPLING is timed stage by stage
+const unsigned int SELF_TRACE_SAMPLING = 16;
+
+/**
+ * Time spent by a thread in a stage
+ */
+struct TraceSpan {
+	long long start;
+	long long end;
+	TraceStage stage;
+};
+
+/**
+ * Spans of one thread, only written by the thread itself
+ */
+struct ThreadSpans {
+	string name;
+	vector<TraceSpan> spans;
+
+	// Stage being timed, since the time of the last switch
+	TraceStage stage = NO_STAGE;
+	long long switchTime = 0;
+	// Times of the stages since the start of the batch, and the stages in the
+	// order they were first entered
+	long long batchStart = 0;
+	long long stageTimes[NO_STAGE] = { };
+	vector<TraceStage> stageOrder;
+	unsigned int records = 0;
+
+	// The stages of the record being converted are timed (sampled record),
+	// otherwise its time is shared at the end of the batch between the
+	// stages of the records, in the proportions of the sampled records
+	bool sampled = true;
+	long long unsampledTime = 0;
+};
+
+/**
+ * Self-tracing of the converter (enabled by --self-trace): each thread times
+ * its stages in its own buffer, without lock, by switching from one stage to
+ * the next. The records are converted stage by stage in an interleaved way,
+ * so the times of the stages are added up over a batch of records (or a
+ * block, for the threads working by blocks) and written as consecutive spans
+ * covering the batch.
+ *
+ * Reading the clock at each stage of each record would double the time of
+ * the conversion: only one record out of SELF_TRACE_SAMPLING is timed stage
+ * by stage (switchRecordStage), the blocks read and written and the waits
+ * always being timed (switchStage). When the tracing is disabled, each
+ * switch only tests a flag.
+ */
+class SelfTrace {
+
+private:
+	static bool enabled;
+	static long long origin;
+
+	static ThreadSpans & current();
+	static void account(ThreadSpans & thread, long long time);
+	static void flush(ThreadSpans & thread, long long time);
+	static TraceStage switchTracedStage(TraceStage stage);
+	static TraceStage switchTracedRecordStage(TraceStage stage);
+	static void countTracedRecord();
+	static void endTracedBatch();
+
+public:
+	/**
+	 * Start the tracing (before the threads of the conversion are started),
+	 * the calling thread being named main
+	 */
+	static void enable();
+
+	static bool isEnabled() {
+		return enabled;
+	}
+
+	/**
+	 * Name the calling thread with its role, numbered ("compression 2")
+	 */
+	static void setThreadName(const string & role);
+
+	/**
+	 * Time the following work of the calling thread as the given stage
+	 * (NO_STAGE ends the current batch)
+	 *
+	 * @return the previous stage, to switch back to it
+	 */
+	static TraceStage switchStage(TraceStage stage) {
+		return enabled ? switchTracedStage(stage) : NO_STAGE;
+	}
+
+	/**
+	 * Switch between the stages of a record (tokenize, resolve, format),
+	 * timed only for the sampled records
+	 */
+	static TraceStage switchRecordStage(TraceStage stage) {
+		return enabled ? switchTracedRecordStage(stage) : NO_STAGE;
+	}
+
+	/**
+	 * Count a converted record, ending the batch every SELF_TRACE_BATCH_SIZE
+	 * records
+	 */
+	static void countRecord() {
+		if (enabled)
+			countTracedRecord();
+	}
+
+	/**
+	 * End the current batch of the calling thread
+	 */
+	static void endBatch() {
+		if (enabled)
+			endTracedBatch();
+	}
+
+	/**
+	 * Write the spans of all the threads, once they have stopped: as a
+	 * Paraver trace (with its .pcf and .row files) if the file ends with
+	 * .prv, in pjdump otherwise
+	 */
+	static bool write(const string & outputFile);
+};
+
+#endif /* INCLUDE_SELFTRACE_H_ */
@@ -0,0 +1,290 @@
+/*
+ * sinks.h
+ *
+ *  Outputs receiving the converted trace besides the pjdump and SQLite
+ *  backends: summaries, filters, and the fan-out to several outputs.
+ */
+
+#ifndef INCLUDE_SINKS_H_
+#define INCLUDE_SINKS_H_
+#include <climits>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "writer.h"
+
+const string SUMMARY_OUTPUT_FORMAT = "summary";
+const string MATRIX_OUTPUT_FORMAT = "matrix";
+const string FILTER_OUTPUT_FORMAT = "filter";
+
+// Number of calls grouped in a batch by the threaded outputs
+const unsigned int SINK_BATCH_SIZE = 4096;
+// Number of batches waiting for a threaded output before the conversion waits
+const unsigned int SINK_QUEUE_LENGTH = 16;
+
+/**
+ * Number of states and time spent in each state, per container, optionally
+ * restricted to a time window. The report is written in the output file
+ * when the writer is closed:
+ *
+ * StateSummary,container,state,count,duration
+ */
+class SummaryWriter: public TraceWriter {
+
+private:
+	string outputFile;
+	long long windowStart = LLONG_MIN;
+	long long windowEnd = LLONG_MAX;
+	// (container, state) -> (count, duration)
+	map<pair<string, string>, pair<unsigned long long, long long>> totals;
+
+public:
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void close();
+
+	void writeReport(ostream & out) const;
+
+	void setWindow(long long start, long long end) {
+		windowStart = start;
+		windowEnd = end;
+	}
+};
+
+/**
+ * Number of links and total duration per (sender, receiver) pair:
+ *
+ * LinkMatrix,sender,receiver,count,duration
+ */
+class LinkMatrixWriter: public TraceWriter {
+
+private:
+	string outputFile;
+	map<pair<string, string>, pair<unsigned long long, long long>> totals;
+
+public:
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void close();
+};
+
+/**
+ * Forward to another writer the records of some threads and of a time
+ * window. The threads are matched on their container name (THREAD
+ * app.task.thread, or Task_N at the task level); the other containers of
+ * the hierarchy are always kept. Links are kept with their sender.
+ */
+class FilterWriter: public TraceWriter {
+
+private:
+	TraceWriter * target;
+
+	// Ranges of the kept IDs and times (inclusive)
+	int taskMin = INT_MIN;
+	int taskMax = INT_MAX;
+	int threadMin = INT_MIN;
+	int threadMax = INT_MAX;
+	long long timeMin = LLONG_MIN;
+	long long timeMax = LLONG_MAX;
+
+	unordered_map<string, bool> keptContainers;
+
+	bool keepContainer(const string & name);
+	bool keepInterval(long long start, long long end) const {
+		return start <= timeMax && end >= timeMin;
+	}
+
+public:
+	FilterWriter(TraceWriter * target);
+	~FilterWriter();
+
+	/**
+	 * Read conditions such as "task=0..63,thread=1,time=0..1000000"
+	 */
+	bool setConditions(const string & conditions, string & error);
+
+	void setConfig(shared_ptr<const TraceConfig> config);
+	void setTraceUnit(int unit);
+	void setUnsortedRecords();
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void setIncomplete();
+	void close();
+};
+
+/**
+ * Send the converted trace to several writers, each one with its own output
+ * file
+ */
+class MultiWriter: public TraceWriter {
+
+private:
+	vector<pair<TraceWriter *, string>> sinks;
+
+public:
+	~MultiWriter();
+
+	void addSink(TraceWriter * sink, const string & outputFile);
+
+	void setConfig(shared_ptr<const TraceConfig> config);
+	void setTraceUnit(int unit);
+	void setUnsortedRecords();
+
+	/**
+	 * Open every sink on its own file (the given file is ignored)
+	 */
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void setIncomplete();
+	void close();
+};
+
+/**
+ * Time the calls to a writer as the format stage of the self-tracing (and
+ * its closing as the write stage)
+ */
+class TracedWriter: public TraceWriter {
+
+private:
+	TraceWriter * target;
+
+public:
+	TracedWriter(TraceWriter * target);
+	~TracedWriter();
+
+	void setConfig(shared_ptr<const TraceConfig> config);
+	void setTraceUnit(int unit);
+	void setUnsortedRecords();
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void setIncomplete();
+	void close();
+};
+
+#ifndef _WIN32
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+/**
+ * Calls to a writer recorded in the order they were made
+ */
+struct WriterBatch {
+	enum Call {
+		CALL_CONTAINER, CALL_STATE, CALL_EVENT, CALL_LINK, CALL_VARIABLE,
+		CALL_TRACE_UNIT, CALL_UNSORTED_RECORDS
+	};
+
+	struct Interval {
+		string parent;
+		string name;
+		// Kind of a container
+		string kind;
+		long long start;
+		long long end;
+		double value;
+	};
+
+	vector<Call> calls;
+	// Containers and variables
+	vector<Interval> intervals;
+	vector<State> states;
+	vector<Event> events;
+	vector<Link> links;
+	vector<int> traceUnits;
+
+	void replay(TraceWriter * writer);
+};
+
+/**
+ * Run a writer on its own thread: the calls are grouped in batches, which
+ * are passed through a bounded queue
+ */
+class AsyncWriter: public TraceWriter {
+
+private:
+	TraceWriter * target;
+	thread worker;
+	WriterBatch * batch = nullptr;
+	// Passed to the target once the thread has stopped
+	bool incomplete = false;
+
+	// Full batches, nullptr marks the end of the output
+	queue<WriterBatch *> batches;
+	mutex lock;
+	condition_variable batchReady;
+	condition_variable batchTaken;
+
+	void push(WriterBatch * full);
+	void flushBatch();
+	void work();
+
+public:
+	AsyncWriter(TraceWriter * target);
+	~AsyncWriter();
+
+	void setConfig(shared_ptr<const TraceConfig> config);
+	void setTraceUnit(int unit);
+	void setUnsortedRecords();
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void setIncomplete();
+	void close();
+};
+
+#endif /* _WIN32 */
+
+/**
+ * Create the writer of an output given as TYPE:FILE, where TYPE is pjdump,
+ * sqlite, summary, matrix, image or image(WIDTH), or filter(CONDITIONS)
+ * (pjdump output, or SQLite if the file ends with .sqlite). The pjdump
+ * outputs use the given compression settings when their file ends with .gz
+ * or .zst, and the pjdump and Paje outputs write their times with the given
+ * time format.
+ *
+ * @return nullptr if the output is not valid (error gives the reason)
+ */
+TraceWriter * createSink(const string & output, string & outputFile,
+		string & error,
+		const CompressionSettings & compression = CompressionSettings(),
+		const TimeFormat & timeFormat = TimeFormat());
+
+#endif /* INCLUDE_SINKS_H_ */
@@ -0,0 +1,77 @@
+/*
+ * sqliteWriter.h
+ *
+ *  Bulk load of the converted trace into a SQLite database.
+ *  Only available when built with WITH_SQLITE (and linked with -lsqlite3).
+ */
+
+#ifndef INCLUDE_SQLITEWRITER_H_
+#define INCLUDE_SQLITEWRITER_H_
+#ifdef WITH_SQLITE
+#include <unordered_map>
+#include <sqlite3.h>
+#include "writer.h"
+
+// Number of rows inserted per transaction
+const unsigned int SQLITE_ROWS_PER_TRANSACTION = 1000000;
+
+/**
+ * Write containers, states, events and links in SQLite tables. Names are
+ * stored once in dictionary tables and referenced by their ID.
+ *
+ * The tables are filled with prepared statements inside large transactions,
+ * with journaling and synchronization disabled; the indexes are only built
+ * once everything is loaded. An existing database is only replaced once the
+ * new one is complete.
+ */
+class SqliteWriter: public TraceWriter {
+
+private:
+	sqlite3 * database = nullptr;
+
+	sqlite3_stmt * insertContainer = nullptr;
+	sqlite3_stmt * insertStateName = nullptr;
+	sqlite3_stmt * insertEventName = nullptr;
+	sqlite3_stmt * insertState = nullptr;
+	sqlite3_stmt * insertEvent = nullptr;
+	sqlite3_stmt * insertLink = nullptr;
+	sqlite3_stmt * insertVariableName = nullptr;
+	sqlite3_stmt * insertVariable = nullptr;
+
+	// Name dictionaries: name -> ID
+	unordered_map<string, long long> containerIDs;
+	unordered_map<string, long long> stateIDs;
+	unordered_map<string, long long> eventIDs;
+	unordered_map<string, long long> variableIDs;
+
+	unsigned int pendingRows = 0;
+
+	// Database being built, renamed into the output file when it is closed
+	// without error after a complete conversion
+	string outputFile;
+	string temporaryFile;
+	bool failed = false;
+
+	bool execute(const string & sql);
+	sqlite3_stmt * prepare(const string & sql);
+	void step(sqlite3_stmt * statement);
+	long long getContainerID(const string & name);
+	long long getNameID(unordered_map<string, long long> & ids,
+			sqlite3_stmt * insert, const string & name);
+	void rowInserted();
+
+public:
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void setIncomplete();
+	void close();
+};
+
+#endif /* WITH_SQLITE */
+#endif /* INCLUDE_SQLITEWRITER_H_ */
@@ -0,0 +1,95 @@
+/*
+ * timeFormat.h
+ *
+ *  Exact conversion of the timestamps into another time unit, written as
+ *  fixed-point decimals.
+ */
+
+#ifndef INCLUDE_TIMEFORMAT_H_
+#define INCLUDE_TIMEFORMAT_H_
+#include "common.h"
+
+// Time units, as the decimal exponent of the second
+const int UNIT_SECONDS = 0;
+const int UNIT_MILLISECONDS = -3;
+const int UNIT_MICROSECONDS = -6;
+const int UNIT_NANOSECONDS = -9;
+
+// Unit of the traces whose header gives the duration without unit
+const int DEFAULT_TRACE_UNIT = UNIT_MICROSECONDS;
+
+// Keep all the digits of the converted times
+const int EXACT_PRECISION = -1;
+const int MAX_TIME_PRECISION = 18;
+
+// Size of the buffer given to TimeFormat::format
+const size_t TIME_BUFFER_SIZE = 48;
+
+/**
+ * Unit of a name: s, ms, us or ns
+ *
+ * @return false if the name is not a unit
+ */
+bool parseTimeUnit(const string & name, int & unit);
+
+/**
+ * Write the integer timestamps of the trace in the output unit, with a fixed
+ * number of decimals: the digits are computed with integer divisions by
+ * powers of ten (rounded half away from zero when decimals are dropped), so
+ * the times are exact and written without floating point nor iostream
+ * formatting. Without output unit, the timestamps are written unchanged.
+ */
+class TimeFormat {
+
+private:
+	bool converted = false;
+	int outputUnit = UNIT_SECONDS;
+	int precision = EXACT_PRECISION;
+	int traceUnit = DEFAULT_TRACE_UNIT;
+
+	// Derived from the units: the timestamp is multiplied, then divided
+	// (rounded), then padded with zeros to get the decimals
+	unsigned long long multiplier = 1;
+	unsigned int multiplierExponent = 0;
+	unsigned long long divisor = 1;
+	unsigned int decimals = 0;
+	unsigned int padding = 0;
+
+	void update();
+
+public:
+	/**
+	 * Convert the times into the given unit, with the given number of
+	 * decimals (EXACT_PRECISION for all the digits of the trace unit)
+	 */
+	void setOutputUnit(int unit, int precision);
+
+	/**
+	 * Unit of the timestamps, read from the header of the trace
+	 */
+	void setTraceUnit(int unit);
+
+	bool isConverted() const {
+		return converted;
+	}
+
+	/**
+	 * Write a time in the buffer (of TIME_BUFFER_SIZE characters, not
+	 * terminated)
+	 *
+	 * @return the number of characters written
+	 */
+	size_t format(long long time, char * buffer) const;
+
+	void write(ostream & out, long long time) const {
+		char buffer[TIME_BUFFER_SIZE];
+		out.write(buffer, format(time, buffer));
+	}
+
+	void append(string & out, long long time) const {
+		char buffer[TIME_BUFFER_SIZE];
+		out.append(buffer, format(time, buffer));
+	}
+};
+
+#endif /* INCLUDE_TIMEFORMAT_H_ */
@@ -0,0 +1,54 @@
+/*
+ * traceConfig.h
+ *
+ *  Names of the states, events and resources read from the .pcf and .row
+ *  files, with an optional binary cache.
+ */
+
+#ifndef INCLUDE_TRACECONFIG_H_
+#define INCLUDE_TRACECONFIG_H_
+#include <map>
+#include <vector>
+#include "common.h"
+
+// Suffix of the binary cache written next to a .pcf or .row file
+const string CONFIG_CACHE_EXTENSION = ".cache";
+
+struct TraceConfig {
+	// Match the names of the states with their IDs
+	map<int, string> stateNames;
+	// Colors of the states (0xRRGGBB) with their IDs
+	map<int, unsigned int> stateColors;
+	// Match the names of the events with their IDs
+	map<int, string> eventNames;
+	// Match the names of the event value with their IDs
+	map<int, map<int, string>> eventTypes;
+
+	// Match the name of the resources from the row file
+	// The first key is the level (CPU, NODE, THREAD, etc.)
+	map<string, vector<string>> resourceNames;
+};
+
+/**
+ * Read the configuration file (.pcf): names and colors of the states, names
+ * of the event types and of their values.
+ *
+ * With useCache, the content is read from the cache file if it matches the
+ * size and modification time of the .pcf file; otherwise the cache is
+ * (re)written after parsing.
+ */
+bool loadPcf(const string & pcfFile, TraceConfig & config, bool useCache);
+
+/**
+ * Read the resource file (.row): names of the nodes, threads, etc.
+ */
+bool loadRow(const string & rowFile, TraceConfig & config, bool useCache);
+
+/**
+ * Color (0xRRGGBB) of a state: the one of the .pcf file if the state has one,
+ * otherwise the color of the given number in a default palette
+ */
+unsigned int stateColor(const TraceConfig * config, const string & name,
+		unsigned int number);
+
+#endif /* INCLUDE_TRACECONFIG_H_ */
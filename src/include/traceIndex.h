@@ -0,0 +1,201 @@
+/*
+ * traceIndex.h
+ *
+ *  Memory-mapped .prv file with an index of its records by time and by
+ *  container.
+ */
+
+#ifndef INCLUDE_TRACEINDEX_H_
+#define INCLUDE_TRACEINDEX_H_
+#include <functional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "record.h"
+
+// Number of lines between two checkpoints of the index
+const unsigned int INDEX_BLOCK_LINES = 4096;
+
+// Suffix of the index file written next to the .prv file
+const string INDEX_EXTENSION = ".idx";
+
+/**
+ * Read-only mapping of a whole file in memory
+ */
+class MappedFile {
+
+private:
+	const char * data = nullptr;
+	size_t size = 0;
+
+public:
+	~MappedFile();
+
+	bool open(const string & filename);
+	void close();
+
+	const char * getData() const {
+		return data;
+	}
+
+	size_t getSize() const {
+		return size;
+	}
+};
+
+/**
+ * Hash of the (application, task, thread) identifiers
+ */
+struct ThreadHash {
+	size_t operator()(const tuple<int, int, int> & key) const {
+		return ((size_t) get<0>(key) * 1000003 + get<1>(key)) * 1000003
+				+ get<2>(key);
+	}
+};
+
+/**
+ * Checkpoint of the index: a range of lines of the trace
+ */
+struct IndexBlock {
+	// Byte range of the lines of the block
+	size_t begin = 0;
+	size_t end = 0;
+	// Lowest start time and highest end time of the records of the block
+	long long firstTime = 0;
+	long long lastEnd = 0;
+	// Lowest start time of this block and of the following ones
+	long long minTime = 0;
+	// Highest end time of this block and of the previous ones
+	long long maxEnd = 0;
+};
+
+/**
+ * Index of a .prv file built in a single pass: the trace is cut into blocks
+ * of INDEX_BLOCK_LINES lines, and for each thread the list of the blocks
+ * holding its records is kept. A query only tokenizes the blocks that may
+ * contain records of the requested time window and threads.
+ *
+ * The index can be saved next to the trace (<trace>.prv.idx), with the
+ * block lists of the threads encoded as varint differences, and loaded
+ * back instead of scanning the trace.
+ */
+class TraceIndex {
+
+private:
+	MappedFile file;
+	string header;
+	vector<IndexBlock> blocks;
+
+	// Dense index of the threads (application, task, thread)
+	unordered_map<tuple<int, int, int>, int, ThreadHash> containerIndexes;
+	vector<tuple<int, int, int>> containers;
+	// Blocks holding records of each thread (senders and receivers of links)
+	vector<vector<unsigned int>> containerBlocks;
+
+	unsigned long long recordCount = 0;
+	unsigned long long skippedRecords = 0;
+
+	// Block being built
+	IndexBlock block;
+	unsigned int blockLines = 0;
+
+	int addContainer(int appID, int taskID, int threadID);
+	void addToBlock(int container, unsigned int block);
+	void clear();
+
+public:
+	/**
+	 * Map and index the trace. Malformed records stop the indexing unless
+	 * skipErrors is set.
+	 */
+	bool build(const string & traceFile, bool skipErrors);
+
+	/**
+	 * Incremental building (used by build and during a conversion): each line
+	 * following the header is given with its byte offset, followed by its
+	 * record if it is valid, and the index is completed with the size of the
+	 * trace
+	 */
+	void setHeader(const string & header) {
+		this->header = header;
+	}
+	void addLine(size_t offset);
+	void addRecord(const PrvRecord & record);
+	void skipRecord() {
+		skippedRecords++;
+	}
+	void finish(size_t fileSize);
+
+	/**
+	 * Write the index next to the trace
+	 */
+	bool save(const string & traceFile) const;
+
+	/**
+	 * Map the trace and read its index
+	 *
+	 * @return false if there is no index, or if it does not match the
+	 * current version of the trace
+	 */
+	bool load(const string & traceFile);
+
+	/**
+	 * Call process on the records overlapping [start, end] and belonging to
+	 * the given threads (all the threads if empty), in the order of the trace
+	 */
+	void forEachRecord(long long start, long long end,
+			const vector<int> & selected,
+			const function<void(const PrvRecord &)> & process) const;
+
+	/**
+	 * Blocks that may contain records overlapping [start, end], restricted to
+	 * the given threads (all the threads if empty)
+	 */
+	vector<unsigned int> findBlocks(long long start, long long end,
+			const vector<int> & selected) const;
+
+	/**
+	 * Threads matching (appID, taskID, threadID), where 0 matches any ID
+	 */
+	vector<int> findContainers(int appID, int taskID, int threadID) const;
+
+	/**
+	 * Dense index of a thread, -1 if it has no record
+	 */
+	int getContainerIndex(int appID, int taskID, int threadID) const;
+
+	const tuple<int, int, int> & getContainer(int index) const {
+		return containers[index];
+	}
+
+	unsigned int getContainerCount() const {
+		return containers.size();
+	}
+
+	const IndexBlock & getBlock(unsigned int index) const {
+		return blocks[index];
+	}
+
+	unsigned int getBlockCount() const {
+		return blocks.size();
+	}
+
+	const char * getData() const {
+		return file.getData();
+	}
+
+	const string & getHeader() const {
+		return header;
+	}
+
+	unsigned long long getRecordCount() const {
+		return recordCount;
+	}
+
+	unsigned long long getSkippedRecords() const {
+		return skippedRecords;
+	}
+};
+
+#endif /* INCLUDE_TRACEINDEX_H_ */
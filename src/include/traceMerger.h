@@ -0,0 +1,172 @@
+/*
+ * traceMerger.h
+ *
+ *  Conversion of several traces into one output, merged by time.
+ */
+
+#ifndef INCLUDE_TRACEMERGER_H_
+#define INCLUDE_TRACEMERGER_H_
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "lineReader.h"
+#include "paraverParser.h"
+#include "record.h"
+
+#ifndef _WIN32
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#endif
+
+// Number of records tokenized together by the thread reading a trace
+const size_t MERGE_BATCH_SIZE = 4096;
+// Maximum number of tokenized batches waiting per trace
+const size_t MERGE_QUEUE_LENGTH = 4;
+
+/**
+ * Records tokenized in advance, reused once they have been converted
+ */
+struct RecordBatch {
+	vector<PrvRecord> records;
+	size_t count = 0;
+};
+
+/**
+ * One of the merged traces: its parser (with its own header and names) and
+ * the batches of records read ahead
+ */
+class MergeInput {
+
+private:
+	string traceFile;
+	ParaverParser * parser;
+	bool skipErrors;
+
+	LineReader reader;
+	string header;
+	// Time unit of the header, and factor converting the times of the
+	// records into the unit of the merge
+	int traceUnit = DEFAULT_TRACE_UNIT;
+	long long timeScale = 1;
+
+	// Batch being converted, and position of the next record in it
+	RecordBatch * current = nullptr;
+	size_t position = 0;
+
+	// Set by the reading when it stops on a malformed record
+	string error;
+	unsigned long long skippedRecords = 0;
+
+#ifndef _WIN32
+	thread worker;
+	// Full batches, nullptr marks the end of the trace
+	queue<RecordBatch *> batches;
+	// Converted batches given back to the reading
+	vector<RecordBatch *> freeBatches;
+	bool stopping = false;
+	mutex lock;
+	condition_variable batchReady;
+	condition_variable batchTaken;
+
+	void work();
+#endif
+
+	bool readBatch(RecordBatch & batch);
+	RecordBatch * takeBatch();
+
+public:
+	MergeInput(const string & traceFile, ParaverParser * parser,
+			bool skipErrors);
+	~MergeInput();
+
+	/**
+	 * Open the trace and read its header
+	 */
+	bool open();
+	/**
+	 * Convert the times of the records into the given unit, finer than the
+	 * unit of the trace (called before start)
+	 */
+	void setRecordUnit(int unit);
+	/**
+	 * Start reading the records ahead (on a thread, except on Windows)
+	 */
+	void start();
+	/**
+	 * Stop reading (before the end of the trace) and wait for the thread
+	 */
+	void stop();
+
+	/**
+	 * Move to the next record
+	 *
+	 * @return false at the end of the trace, or on a malformed record
+	 */
+	bool next();
+
+	const PrvRecord & getRecord() const {
+		return current->records[position - 1];
+	}
+
+	const string & getTraceFile() const {
+		return traceFile;
+	}
+
+	const string & getHeader() const {
+		return header;
+	}
+
+	int getTraceUnit() const {
+		return traceUnit;
+	}
+
+	ParaverParser * getParser() const {
+		return parser;
+	}
+
+	const string & getError() const {
+		return error;
+	}
+
+	unsigned long long getSkippedRecords() const {
+		return skippedRecords;
+	}
+};
+
+/**
+ * Convert several traces into one output: each trace has its own parser,
+ * whose containers are named with the prefix of the trace, and the records
+ * are converted in the order of their time (start of the states, time of the
+ * events, send time of the links) through a heap holding the next record of
+ * each trace. The times of the traces are converted into the finest unit of
+ * their headers before being compared. The traces are read and tokenized
+ * ahead on their own threads, each keeping at most MERGE_QUEUE_LENGTH
+ * batches, so the memory does not depend on the size of the traces.
+ */
+class TraceMerger {
+
+private:
+	vector<unique_ptr<MergeInput>> inputs;
+	TraceWriter * writer;
+
+public:
+	TraceMerger(TraceWriter * writer);
+
+	/**
+	 * Add a trace, converted by the given parser (which writes in the writer
+	 * of the merger, and is deleted with the merger)
+	 */
+	void addInput(const string & traceFile, ParaverParser * parser,
+			bool skipErrors);
+
+	/**
+	 * Convert the traces into the output file
+	 *
+	 * @return false if a trace could not be read completely
+	 */
+	bool merge(const string & outputFile);
+};
+
+#endif /* INCLUDE_TRACEMERGER_H_ */
@@ -0,0 +1,178 @@
+/*
+ * writer.h
+ *
+ *  Output backends of the converted trace.
+ */
+
+#ifndef INCLUDE_WRITER_H_
+#define INCLUDE_WRITER_H_
+#include <fstream>
+#include <memory>
+#include "common.h"
+#include "compressedStream.h"
+#include "event.h"
+#include "timeFormat.h"
+#include "traceConfig.h"
+
+const string PJDUMP_OUTPUT_FORMAT = "pjdump";
+const string SQLITE_OUTPUT_FORMAT = "sqlite";
+
+// Kinds of the containers given to writeContainer, following the hierarchy
+// of the header of the trace
+const string APPLICATION_CONTAINER_KIND = "Application";
+const string NODE_CONTAINER_KIND = "Node";
+const string TASK_CONTAINER_KIND = "Task";
+const string THREAD_CONTAINER_KIND = "Thread";
+
+/**
+ * Receive the converted containers, states, events and links
+ */
+class TraceWriter {
+
+public:
+	virtual ~TraceWriter();
+
+	/**
+	 * Receive the names and colors of the .pcf and .row files before the
+	 * output is opened (ignored by default)
+	 */
+	virtual void setConfig(shared_ptr<const TraceConfig>) {
+	}
+
+	/**
+	 * Receive the time unit read from the header of the trace, before its
+	 * containers (ignored by default)
+	 */
+	virtual void setTraceUnit(int) {
+	}
+
+	/**
+	 * Called before the records when some of them may be received after
+	 * records starting later, the delaying stages of the conversion being
+	 * used (ignored by default)
+	 */
+	virtual void setUnsortedRecords() {
+	}
+
+	virtual bool open(const string & outputFile) = 0;
+	virtual void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end) = 0;
+	virtual void writeState(State & state) = 0;
+	virtual void writeEvent(Event & event) = 0;
+	virtual void writeLink(Link & link) = 0;
+	virtual void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value) = 0;
+
+	/**
+	 * Called before close() when the conversion stopped on an error (ignored
+	 * by default: what was written is kept)
+	 */
+	virtual void setIncomplete() {
+	}
+
+	virtual void close() = 0;
+};
+
+/**
+ * Write the trace as text, in a file (the standard output for "-") or in a
+ * given stream. Files ending with .gz or .zst are compressed while they are
+ * written.
+ *
+ * The lines are produced by the Format policy (PjdumpFormat, PajeFormat),
+ * resolved at compile time: the records are formatted from their fields, the
+ * times being written in the unit of the TimeFormat.
+ */
+template<typename Format>
+class TextWriter: public TraceWriter {
+
+private:
+	ofstream file;
+	// Stream receiving the output (file unless given at construction)
+	ostream * output;
+
+	CompressionSettings compression;
+	unique_ptr<CompressedStreamBuffer> compressedBuffer;
+	unique_ptr<ostream> compressedFile;
+
+	Format format;
+
+public:
+	TextWriter(const CompressionSettings & compression =
+			CompressionSettings(), const TimeFormat & timeFormat = TimeFormat());
+	TextWriter(ostream & stream);
+
+	void setConfig(shared_ptr<const TraceConfig> config);
+	void setTraceUnit(int unit);
+	void setUnsortedRecords();
+	bool open(const string & outputFile);
+	void writeContainer(const string & parent, const string & name,
+			const string & kind, long long start, long long end);
+	void writeState(State & state);
+	void writeEvent(Event & event);
+	void writeLink(Link & link);
+	void writeVariable(const string & container, const string & name,
+			long long start, long long end, double value);
+	void close();
+};
+
+/**
+ * pjdump CSV lines, written as soon as the records are received
+ */
+class PjdumpFormat {
+
+private:
+	TimeFormat timeFormat;
+
+public:
+	void setConfig(shared_ptr<const TraceConfig>) {
+	}
+
+	void setTimeFormat(const TimeFormat & timeFormat) {
+		this->timeFormat = timeFormat;
+	}
+
+	void setTraceUnit(int unit) {
+		timeFormat.setTraceUnit(unit);
+	}
+
+	void setUnsortedRecords() {
+	}
+
+	void writeContainer(ostream & out, const string & parent,
+			const string & name, const string & kind, long long start,
+			long long end);
+	void writeState(ostream & out, const State & state);
+	void writeEvent(ostream & out, const Event & event);
+	void writeLink(ostream & out, const Link & link);
+	void writeVariable(ostream & out, const string & container,
+			const string & name, long long start, long long end,
+			double value);
+	void finish(ostream &) {
+	}
+};
+
+typedef TextWriter<PjdumpFormat> PjdumpWriter;
+
+// Size of the buffer of formatVariableValue
+const size_t VARIABLE_BUFFER_SIZE = 32;
+
+/**
+ * Write the value of a variable in the buffer: the integral values (the
+ * counts of the counters) as integers, the other ones with 15 significant
+ * digits
+ *
+ * @return the length of the value
+ */
+int formatVariableValue(double value, char * buffer);
+
+/**
+ * Create the writer of the given format (the text formats writing the times
+ * with the given time format)
+ *
+ * @return nullptr if the format is unknown or not available in this build
+ */
+TraceWriter * createWriter(const string & format,
+		const CompressionSettings & compression = CompressionSettings(),
+		const TimeFormat & timeFormat = TimeFormat());
+
+#endif /* INCLUDE_WRITER_H_ */
@@ -0,0 +1,106 @@
+/*
+ * lineReader.cpp
+ *
+ *  Read a text file line by line through large blocks.
+ */
+
+#include <cstring>
+#include "include/lineReader.h"
+#include "include/selfTrace.h"
+
+LineReader::LineReader() {
+	buffer.resize(LINE_READER_BLOCK_SIZE);
+}
+
+LineReader::~LineReader() {
+	close();
+}
+
+bool LineReader::open(const string & filename) {
+	close();
+
+	file = (filename == STANDARD_STREAM) ?
+			stdin : fopen(filename.c_str(), "rb");
+
+	dataBegin = dataEnd = 0;
+	bufferOffset = lineOffset = lineNumber = 0;
+	endOfFile = false;
+
+	return file != nullptr;
+}
+
+void LineReader::close() {
+	if (file != nullptr && file != stdin)
+		fclose(file);
+	file = nullptr;
+}
+
+/**
+ * Move the unread data at the beginning of the buffer and read the next
+ * block after it. The buffer grows if a single line does not fit in it.
+ */
+bool LineReader::fill() {
+	if (endOfFile || file == nullptr)
+		return false;
+
+	if (dataBegin > 0) {
+		memmove(buffer.data(), buffer.data() + dataBegin, dataEnd - dataBegin);
+		bufferOffset += dataBegin;
+		dataEnd -= dataBegin;
+		dataBegin = 0;
+	}
+
+	if (dataEnd == buffer.size())
+		buffer.resize(buffer.size() * 2);
+
+	TraceStage stage = SelfTrace::switchStage(STAGE_READ);
+	size_t read = fread(buffer.data() + dataEnd, 1, buffer.size() - dataEnd,
+			file);
+	SelfTrace::switchStage(stage);
+	if (read == 0) {
+		endOfFile = true;
+		return false;
+	}
+
+	dataEnd += read;
+	return true;
+}
+
+bool LineReader::nextLine(const char *& line, size_t & length) {
+	size_t searchFrom = dataBegin;
+
+	while (true) {
+		const char * start = buffer.data() + dataBegin;
+		const char * newLine = (const char *) memchr(
+				buffer.data() + searchFrom, '\n', dataEnd - searchFrom);
+
+		if (newLine != nullptr) {
+			line = start;
+			length = newLine - start;
+			lineOffset = bufferOffset + dataBegin;
+			dataBegin = newLine - buffer.data() + 1;
+			break;
+		}
+
+		// No end of line in the remaining data
+		size_t pending = dataEnd - dataBegin;
+		if (!fill()) {
+			if (dataEnd == dataBegin)
+				return false;
+
+			// Last line without end of line
+			line = buffer.data() + dataBegin;
+			length = dataEnd - dataBegin;
+			lineOffset = bufferOffset + dataBegin;
+			dataBegin = dataEnd;
+			break;
+		}
+		searchFrom = dataBegin + pending;
+	}
+
+	if (length > 0 && line[length - 1] == '\r')
+		length--;
+
+	lineNumber++;
+	return true;
+}
@@ -0,0 +1,394 @@
+/*
+ * pajeWriter.cpp
+ *
+ *  Native Paje trace output, read by pajeng and ViTE.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "include/pajeWriter.h"
+
+/**
+ * Identifiers of the events defined in the header
+ */
+enum PajeEvent {
+	PAJE_DEFINE_CONTAINER_TYPE, PAJE_DEFINE_STATE_TYPE, PAJE_DEFINE_EVENT_TYPE,
+	PAJE_DEFINE_LINK_TYPE, PAJE_DEFINE_VARIABLE_TYPE, PAJE_DEFINE_ENTITY_VALUE,
+	PAJE_CREATE_CONTAINER, PAJE_PUSH_STATE, PAJE_POP_STATE, PAJE_NEW_EVENT,
+	PAJE_START_LINK, PAJE_END_LINK, PAJE_SET_VARIABLE
+};
+
+static const char PAJE_HEADER[] = "%EventDef PajeDefineContainerType 0\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% Name string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeDefineStateType 1\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% Name string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeDefineEventType 2\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% Name string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeDefineLinkType 3\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% StartContainerType string\n"
+		"% EndContainerType string\n"
+		"% Name string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeDefineVariableType 4\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% Name string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeDefineEntityValue 5\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% Name string\n"
+		"% Color color\n"
+		"%EndEventDef\n"
+		"%EventDef PajeCreateContainer 6\n"
+		"% Time date\n"
+		"% Alias string\n"
+		"% Type string\n"
+		"% Container string\n"
+		"% Name string\n"
+		"%EndEventDef\n"
+		"%EventDef PajePushState 7\n"
+		"% Time date\n"
+		"% Type string\n"
+		"% Container string\n"
+		"% Value string\n"
+		"%EndEventDef\n"
+		"%EventDef PajePopState 8\n"
+		"% Time date\n"
+		"% Type string\n"
+		"% Container string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeNewEvent 9\n"
+		"% Time date\n"
+		"% Type string\n"
+		"% Container string\n"
+		"% Value string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeStartLink 10\n"
+		"% Time date\n"
+		"% Type string\n"
+		"% Container string\n"
+		"% Value string\n"
+		"% StartContainer string\n"
+		"% Key string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeEndLink 11\n"
+		"% Time date\n"
+		"% Type string\n"
+		"% Container string\n"
+		"% Value string\n"
+		"% EndContainer string\n"
+		"% Key string\n"
+		"%EndEventDef\n"
+		"%EventDef PajeSetVariable 12\n"
+		"% Time date\n"
+		"% Type string\n"
+		"% Container string\n"
+		"% Value double\n"
+		"%EndEventDef\n";
+
+// Orders of the records at the same time
+const unsigned int ORDER_END = 0;
+const unsigned int ORDER_START = 1;
+const unsigned int ORDER_EMPTY_END = 2;
+
+/**
+ * Append a name between double quotes (the quotes of the name are dropped)
+ */
+static void appendQuoted(string & out, const string & name) {
+	out += '"';
+	for (char character : name)
+		if (character != '"')
+			out += character;
+	out += '"';
+}
+
+void PajeFormat::setConfig(shared_ptr<const TraceConfig> config) {
+	this->config = config;
+}
+
+/**
+ * Declare a type: "EVENT ALIAS FIELDS NAME"
+ */
+unsigned int PajeFormat::addType(int event, const string & fields,
+		const string & name) {
+	unsigned int type = typeAliases.size();
+	string alias = "T" + to_string(type);
+
+	// The fields may refer to the aliases, declared before adding this one
+	declarations += to_string(event) + " " + alias + " " + fields + " ";
+	appendQuoted(declarations, name);
+	declarations += '\n';
+
+	typeAliases.push_back(alias);
+	values.resize(typeAliases.size());
+	return type;
+}
+
+unsigned int PajeFormat::stateType(unsigned int containerType,
+		int imbrication) {
+	auto key = make_pair(containerType, imbrication);
+	auto it = stateTypes.find(key);
+	if (it != stateTypes.end())
+		return it->second;
+
+	string name = (imbrication == 0) ?
+			"State" : "State level " + to_string(imbrication);
+	unsigned int type = addType(PAJE_DEFINE_STATE_TYPE,
+			typeAliases[containerType], name);
+	stateTypes[key] = type;
+	return type;
+}
+
+unsigned int PajeFormat::eventType(unsigned int containerType) {
+	auto it = eventTypes.find(containerType);
+	if (it != eventTypes.end())
+		return it->second;
+
+	unsigned int type = addType(PAJE_DEFINE_EVENT_TYPE,
+			typeAliases[containerType], "Event");
+	eventTypes[containerType] = type;
+	return type;
+}
+
+unsigned int PajeFormat::variableType(unsigned int containerType,
+		const string & name) {
+	auto key = make_pair(containerType, name);
+	auto it = variableTypes.find(key);
+	if (it != variableTypes.end())
+		return it->second;
+
+	unsigned int type = addType(PAJE_DEFINE_VARIABLE_TYPE,
+			typeAliases[containerType], name);
+	variableTypes[key] = type;
+	return type;
+}
+
+/**
+ * Links are declared in the root container, between any two containers
+ */
+unsigned int PajeFormat::linkType(unsigned int startType,
+		unsigned int endType) {
+	auto key = make_pair(startType, endType);
+	auto it = linkTypes.find(key);
+	if (it != linkTypes.end())
+		return it->second;
+
+	unsigned int type = addType(PAJE_DEFINE_LINK_TYPE,
+			typeAliases[0] + " " + typeAliases[startType] + " "
+					+ typeAliases[endType], "Link");
+	linkTypes[key] = type;
+	return type;
+}
+
+/**
+ * Alias of a value of a type, declared with its color the first time
+ */
+const string & PajeFormat::valueOf(unsigned int type, const string & name) {
+	unordered_map<string, string> & typeValues = values[type];
+	auto it = typeValues.find(name);
+	if (it != typeValues.end())
+		return it->second;
+
+	string & alias = typeValues[name];
+	alias = "V" + to_string(valueCount);
+
+	unsigned int color = stateColor(config.get(), name, typeValues.size() - 1);
+	char rgb[32];
+	snprintf(rgb, sizeof(rgb), "\"%.3f %.3f %.3f\"", (color >> 16) / 255.0,
+			((color >> 8) & 0xff) / 255.0, (color & 0xff) / 255.0);
+
+	declarations += to_string(PAJE_DEFINE_ENTITY_VALUE) + " " + alias + " "
+			+ typeAliases[type] + " ";
+	appendQuoted(declarations, name);
+	declarations += string(" ") + rgb + '\n';
+
+	valueCount++;
+	return alias;
+}
+
+const PajeContainer * PajeFormat::findContainer(const string & name) const {
+	auto it = containers.find(name);
+	return (it != containers.end()) ? &it->second : nullptr;
+}
+
+/**
+ * Begin a line of the body: "EVENT TIME"
+ */
+void PajeFormat::startRecord(long long time, unsigned int order, int event) {
+	record.time = time;
+	record.order = order;
+	record.sequence = recordCount++;
+	record.line = to_string(event);
+	record.line += ' ';
+	timeFormat.append(record.line, time);
+}
+
+/**
+ * Write a start line after the pending lines preceding it, or keep the line
+ * in the heap
+ */
+void PajeFormat::endRecord(ostream & out) {
+	record.line += '\n';
+	if (record.order != ORDER_START || unsorted) {
+		pending.push(move(record));
+		return;
+	}
+
+	while (!pending.empty()
+			&& (pending.top().time < record.time
+					|| (pending.top().time == record.time
+							&& pending.top().order < ORDER_START))) {
+		writeLine(out, pending.top());
+		pending.pop();
+	}
+	writeLine(out, record);
+}
+
+/**
+ * Write the header and the declarations made since the last line
+ */
+void PajeFormat::writeDeclarations(ostream & out) {
+	if (!headerWritten) {
+		out << PAJE_HEADER;
+		headerWritten = true;
+	}
+	out << declarations;
+	declarations.clear();
+}
+
+void PajeFormat::writeLine(ostream & out, const PajeRecord & line) {
+	if (!declarations.empty() || !headerWritten)
+		writeDeclarations(out);
+	out << line.line;
+	lastTime = max(lastTime, line.time);
+}
+
+/**
+ * Containers are declared with their type as they are received (at the time
+ * of the last written line if they come after it)
+ */
+void PajeFormat::writeContainer(ostream &, const string & parent,
+		const string & name, const string & kind, long long start,
+		long long) {
+	if (containers.find(name) != containers.end())
+		return;
+
+	const PajeContainer * parentContainer = findContainer(parent);
+	unsigned int parentType = (parentContainer != nullptr) ?
+			parentContainer->type : 0;
+	string parentAlias = (parentContainer != nullptr) ?
+			parentContainer->alias : typeAliases[0];
+
+	auto key = make_pair(parentType, kind);
+	auto type = containerTypes.find(key);
+	if (type == containerTypes.end())
+		type = containerTypes.insert(make_pair(key,
+				addType(PAJE_DEFINE_CONTAINER_TYPE, typeAliases[parentType],
+						key.second))).first;
+
+	PajeContainer & container = containers[name];
+	container.alias = "C" + to_string(containers.size());
+	container.type = type->second;
+
+	declarations += to_string(PAJE_CREATE_CONTAINER) + " ";
+	timeFormat.append(declarations, max(start, lastTime));
+	declarations += " " + container.alias + " " + typeAliases[container.type]
+			+ " " + parentAlias + " ";
+	appendQuoted(declarations, name);
+	declarations += '\n';
+}
+
+/**
+ * Each state is pushed at its start and popped at its end
+ */
+void PajeFormat::writeState(ostream & out, const State & state) {
+	const PajeContainer * container = findContainer(state.getContainer());
+	if (container == nullptr)
+		return;
+
+	unsigned int type = stateType(container->type, state.getImbrication());
+	const string & value = valueOf(type, state.getName());
+
+	startRecord(state.getTimeStamp(), ORDER_START, PAJE_PUSH_STATE);
+	record.line += ' ' + typeAliases[type] + ' ' + container->alias + ' ' + value;
+	endRecord(out);
+
+	startRecord(state.getEndDate(),
+			(state.getEndDate() > state.getTimeStamp()) ?
+					ORDER_END : ORDER_EMPTY_END, PAJE_POP_STATE);
+	record.line += ' ' + typeAliases[type] + ' ' + container->alias;
+	endRecord(out);
+}
+
+void PajeFormat::writeEvent(ostream & out, const Event & event) {
+	const PajeContainer * container = findContainer(event.getContainer());
+	if (container == nullptr)
+		return;
+
+	unsigned int type = eventType(container->type);
+	const string & value = valueOf(type, event.getName());
+
+	startRecord(event.getTimeStamp(), ORDER_START, PAJE_NEW_EVENT);
+	record.line += ' ' + typeAliases[type] + ' ' + container->alias + ' ' + value;
+	endRecord(out);
+}
+
+void PajeFormat::writeLink(ostream & out, const Link & link) {
+	const PajeContainer * sender = findContainer(link.getContainer());
+	const PajeContainer * receiver = findContainer(
+			link.getReceiverContainer());
+	if (sender == nullptr || receiver == nullptr)
+		return;
+
+	unsigned int type = linkType(sender->type, receiver->type);
+	const string & value = valueOf(type, link.getTag());
+	string key = to_string(linkCount++);
+
+	startRecord(link.getTimeStamp(), ORDER_START, PAJE_START_LINK);
+	record.line += ' ' + typeAliases[type] + ' ' + typeAliases[0] + ' ' + value + ' '
+			+ sender->alias + ' ' + key;
+	endRecord(out);
+
+	startRecord(link.getReceiveTimestamp(), ORDER_END, PAJE_END_LINK);
+	record.line += ' ' + typeAliases[type] + ' ' + typeAliases[0] + ' ' + value + ' '
+			+ receiver->alias + ' ' + key;
+	endRecord(out);
+}
+
+/**
+ * The variable takes its value at the start of its interval
+ */
+void PajeFormat::writeVariable(ostream & out, const string & container,
+		const string & name, long long start, long long, double value) {
+	const PajeContainer * found = findContainer(container);
+	if (found == nullptr)
+		return;
+
+	unsigned int type = variableType(found->type, name);
+	char number[VARIABLE_BUFFER_SIZE];
+	formatVariableValue(value, number);
+
+	startRecord(start, ORDER_START, PAJE_SET_VARIABLE);
+	record.line += ' ' + typeAliases[type] + ' ' + found->alias + ' ' + number;
+	endRecord(out);
+}
+
+void PajeFormat::finish(ostream & out) {
+	while (!pending.empty()) {
+		writeLine(out, pending.top());
+		pending.pop();
+	}
+	writeDeclarations(out);
+}
@@ -1,11 +1,8 @@
+#include <climits>
 #include "include/paraverParser.h"
+#include "include/lineReader.h"
+#include "include/selfTrace.h"
 
-const string STATE_CFG = "STATES";
-const string EVENT_CFG = "EVENT_TYPE";
-const string VALUE_CFG = "VALUES";
-const string TYPE_CFG = "TYPE";
-
-const string RESOURCE_LEVEL = "LEVEL";
 const string RESOURCE_LEVEL_CPU = "CPU";
 const string RESOURCE_LEVEL_THREAD = "THREAD";
 const string RESOURCE_LEVEL_NODE = "NODE";
@@ -13,10 +10,6 @@ const string RESOURCE_LEVEL_APPLICATION = "APPL";
 const string RESOURCE_LEVEL_SYSTEM = "SYSTEM";
 const string RESOURCE_LEVEL_WORKLOAD = "WORKLOAD";
 
-const int STATE_CATEGORY = 1;
-const int EVENT_CATEGORY = 2;
-const int LINK_CATEGORY = 3;
-
 const string UNKNOWN_STATE_TYPE = "UNKNOWN_TYPE";
 
 const string TASK_CONTAINER_PREFIX = "Task";
@@ -26,229 +19,446 @@ const string NODE_CONTAINER_PREFIX = "Node";
 const map<int, string> ParaverParser::defaultStateValues = ParaverParser::create_map();
 
 ParaverParser::ParaverParser(bool eventForState) {
-	keyWords.insert(STATE_CFG);
-	keyWords.insert(EVENT_CFG);
-	keyWords.insert(VALUE_CFG);
-	keyWords.insert(TYPE_CFG);
 	lastState = nullptr;
 
 	this->useEventForState = eventForState;
 }
 
-void ParaverParser::parse(string traceFile, string confFile,
+ParaverParser::~ParaverParser() {
+	delete lastState;
+}
+
+bool ParaverParser::parse(string traceFile, string confFile,
 		string resourceFile, string outputFile) {
 
 	this->outputFile = outputFile;
 
-	if (!confFile.empty())
-		parseConf(confFile);
+	shared_ptr<TraceConfig> loaded = make_shared<TraceConfig>();
 
-	if (!resourceFile.empty())
-		parseResource(resourceFile);
+	if (!confFile.empty() && !loadPcf(confFile, *loaded, useConfigCache))
+		cerr << "Warning: could not read the configuration file " << confFile
+				<< endl;
 
-	parseTrace(traceFile);
+	if (!resourceFile.empty()
+			&& !loadRow(resourceFile, *loaded, useConfigCache))
+		cerr << "Warning: could not read the resource file " << resourceFile
+				<< endl;
+
+	config = loaded;
+	writer->setConfig(config);
+
+	return parseTrace(traceFile);
 }
 
 /**
- * Parsing the configuration file (.pcf) in order to get the name of the events and of the states
+ * Name of a container in the output: the root keeps its name, the others get
+ * the prefix of the trace
  */
-void ParaverParser::parseConf(string confFile) {
-	ifstream file;
-	file.open(confFile.c_str());
-	string line;
-
-	while (getline(file, line)) {
-		if (line.empty())
-			continue;
+string ParaverParser::qualify(const string & name) {
+	if (containerPrefix.empty() || name == "0")
+		return name;
+	return containerPrefix + name;
+}
 
-		// If the line describes a state
-		if (line.compare(STATE_CFG) == 0) {
-			while (getline(file, line) && !contains(keyWords, line)
-					&& !line.empty()) {
+/**
+ * Check if a set contains a string
+ */
+bool ParaverParser::contains(const set<string> & s, const string & element) {
+	return (s.find(element) != s.end());
+}
 
-				string id = line.substr(0, line.find(" "));
-				int stateId = stoi(id, nullptr);
-				line.erase(0, line.find(" ") + 1);
+/**
+ * Parse the .prv file
+ *
+ * @return false if the trace could not be converted completely
+ */
+bool ParaverParser::parseTrace(string traceFile) {
+	LineReader reader;
+	RecordCacheReader cacheReader;
+	const char * line = nullptr;
+	size_t length = 0;
+
+	// Read the parsed records from the cache if it is up to date
+	bool cached = useRecordCache && cacheReader.open(traceFile);
+
+	if (!cached && !reader.open(traceFile)) {
+		cerr << "Error: could not open trace file " << traceFile << endl;
+		return false;
+	}
 
-				string stateName = trim(line);
+	// Open the output file
+	if (!writer->open(outputFile)) {
+		cerr << "Error: could not open output file " << outputFile << endl;
+		return false;
+	}
 
-				stateNames.insert(make_pair(stateId, stateName));
-			}
+	string header;
+	if (cached) {
+		header = cacheReader.getHeader();
+	} else {
+		// Get the first non empty line
+		bool found;
+		while ((found = reader.nextLine(line, length)) && length == 0) {
 		}
-
-		// If the line describes an event
-		if (line.compare(EVENT_CFG) == 0) {
-			parseEventConf(&file, line);
+		if (!found) {
+			cerr << "Error: the trace file " << traceFile << " is empty" << endl;
+			writer->setIncomplete();
+			writer->close();
+			return false;
 		}
+		header.assign(line, length);
+	}
+
+	// Handle the header
+	try {
+		parseHeader(header);
+	} catch (const exception & e) {
+		cerr << "Error: malformed header: " << header << endl;
+		writer->setIncomplete();
+		writer->close();
+		return false;
 	}
-	file.close();
-}
 
-void ParaverParser::parseEventConf(ifstream *file, string line) {
-	bool valuePresent = false;
-	int eventId = -1;
+	// process the producers
+	//pjdumpFile << buildProducers();
 
-	while (getline(*file, line)
-			&& (line.compare(EVENT_CFG) == 0 || line.compare(VALUE_CFG) == 0
-					|| (!contains(keyWords, line) && !line.empty()))) {
-		if (line.compare(VALUE_CFG) == 0) {
-			valuePresent = true;
-			break;
-		}
-		if (line.compare(EVENT_CFG) == 0) {
-			continue;
+	// handle the trace records
+	PrvRecord record;
+	string error;
+	bool complete = true;
+
+	if (cached) {
+		// The records are decoded from the cache instead of being tokenized
+		SelfTrace::switchStage(STAGE_TOKENIZE);
+		while (cacheReader.next(record)) {
+			SelfTrace::switchRecordStage(STAGE_RESOLVE);
+			parseRecord(record);
+			SelfTrace::switchRecordStage(STAGE_TOKENIZE);
+			SelfTrace::countRecord();
 		}
 
-		// Remove color gradient ID
-		line.erase(0, line.find(" "));
-		line = trim(line);
+		if (!cacheReader.isValid()) {
+			cerr << "Error: the record cache of " << traceFile
+					<< " is corrupted, remove it and convert the trace again."
+					<< endl;
+			complete = false;
+		}
+	}
 
-		// Get id
-		string id = line.substr(0, line.find(" "));
-		eventId = stoi(id, nullptr);
-		line.erase(0, line.find(" ") + 1);
+	// Save the parsed records for the next conversions
+	RecordCacheWriter cacheWriter;
+	bool caching = useRecordCache && !cached
+			&& cacheWriter.open(traceFile, header);
+
+	// Index the lines by container for the extractions
+	if (index != nullptr) {
+		if (cached)
+			cerr << "Warning: the index of " << traceFile
+					<< " cannot be built from the record cache." << endl;
+		else
+			index->setHeader(header);
+	}
 
-		// Get name
-		string eventName = trim(line);
+	// The lines are split as part of the tokenization
+	SelfTrace::switchStage(STAGE_TOKENIZE);
+	while (!cached && reader.nextLine(line, length)) {
+		TokenizeResult result = tokenizeRecord(line, line + length, record,
+				error);
+
+		if (index != nullptr) {
+			index->addLine(reader.getLineOffset());
+			if (result == RECORD_OK)
+				index->addRecord(record);
+			else if (result == RECORD_MALFORMED)
+				index->skipRecord();
+		}
 
-		eventNames.insert(make_pair(eventId, eventName));
-	}
+		if (result == RECORD_MALFORMED) {
+			if (skipErrors) {
+				skippedRecords++;
+				continue;
+			}
 
-	// handle VALUES
-	if (valuePresent) {
-		while (getline(*file, line) && !contains(keyWords, line)
-				&& !line.empty()) {
+			cerr << "Error: malformed record at line " << reader.getLineNumber()
+					<< " (byte offset " << reader.getLineOffset() << "): "
+					<< error << endl;
+			cerr << "Use --skip-errors to ignore malformed records." << endl;
+			complete = false;
+			break;
+		}
 
-			string id = line.substr(0, line.find(" "));
-			int eventValueId = stoi(id, nullptr);
-			line.erase(0, line.find(" ") + 1);
+		if (result == RECORD_UNSUPPORTED)
+			cerr << "Unsupported type of event: " + string(line, length) << endl;
 
-			string eventType = trim(line);
+		if (result != RECORD_OK)
+			continue;
 
-			if(eventTypes.find(eventId) == eventTypes.end())
-				eventTypes[eventId] = map<int, string>();
+		if (caching)
+			cacheWriter.add(record);
 
-			eventTypes[eventId][eventValueId] = eventType;
-		}
+		SelfTrace::switchRecordStage(STAGE_RESOLVE);
+		parseRecord(record);
+		SelfTrace::switchRecordStage(STAGE_TOKENIZE);
+		SelfTrace::countRecord();
 	}
 
-	// If we left VALUE for another EVENT_TYPE
-	if (line.compare(EVENT_CFG) == 0)
-		parseEventConf(file, line);
-}
+	if (caching) {
+		if (!complete)
+			cacheWriter.discard();
+		else if (!cacheWriter.commit())
+			cerr << "Warning: could not write the record cache of " << traceFile
+					<< endl;
+	}
 
-// trim from start
-static inline string &ltrim(string &s) {
-	s.erase(s.begin(),
-			find_if(s.begin(), s.end(), not1(ptr_fun<int, int>(isspace))));
-	return s;
-}
+	long long size, modification;
+	if (index != nullptr && !cached && complete
+			&& fileIdentity(traceFile, size, modification)) {
+		index->finish(size);
+		if (index->save(traceFile))
+			cerr << "Index written in " << traceFile + INDEX_EXTENSION << endl;
+		else
+			cerr << "Warning: could not write the index of " << traceFile
+					<< endl;
+	}
 
-// trim from end
-static inline string &rtrim(string &s) {
-	s.erase(
-			find_if(s.rbegin(), s.rend(), not1(ptr_fun<int, int>(isspace))).base(),
-			s.end());
-	return s;
+	SelfTrace::switchStage(STAGE_RESOLVE);
+	finish();
+	if (!complete)
+		writer->setIncomplete();
+	writer->close();
+	SelfTrace::switchStage(NO_STAGE);
+	return complete;
 }
 
 /**
- * Remove white spaces at the beginning and at the end of a string
+ * Write the records still held by the optional stages at the end of the
+ * trace (the writer is not closed)
  */
-string ParaverParser::trim(string aString) {
-	return ltrim(rtrim(aString));
+void ParaverParser::finish() {
+	if (rollUp != nullptr)
+		rollUp->flush();
+
+	// The regions still open may be merged by the coalescer
+	if (eventPairing != nullptr)
+		for (ClosedRegion & region : eventPairing->closeAll(traceDuration))
+			writeThreadState(region.containerIndex, region.state);
+
+	if (coalescer != nullptr)
+		for (State & state : coalescer->flushAll())
+			if (reducer == nullptr
+					|| reducer->keepState(state.getTimeStamp(),
+							state.getEndDate()))
+				writer->writeState(state);
+
+	if (reducer != nullptr && reducer->useReservoir())
+		for (Event & event : reducer->takeReservoirs())
+			writer->writeEvent(event);
+
+	if (skippedRecords > 0)
+		cerr << "Warning: " << skippedRecords
+				<< " malformed records were skipped." << endl;
 }
 
 /**
- * Check if a vector contains a string
+ * Check an object (cpu, application, task, thread) against the header
  */
-bool ParaverParser::contains(set<string> s, string element) {
-	return (s.find(element) != s.end());
-}
+string ParaverParser::checkObject(int cpuID, int appID, int taskID,
+		int threadID) {
+	int cpuCount = 0;
+	for (int cpus : nbProcPerNode)
+		cpuCount += cpus;
 
-/**
- * Parse the resource file (.row) to get the names of the producers
- */
-void ParaverParser::parseResource(string resourceFile) {
-	ifstream file;
-	file.open(resourceFile.c_str());
-	string line;
-
-	while (getline(file, line)) {
-		// If the line describes a state
-		if (line.compare(0, 5, RESOURCE_LEVEL) == 0) {
-			line.erase(0, line.find(" ") + 1);
-			line = trim(line);
-			string resourceType = line.substr(0, line.find(" "));
-
-			resourceNames.insert(make_pair(resourceType, vector<string>()));
-
-			while (getline(file, line) && !line.empty()) {
-				resourceNames.at(resourceType).push_back(line);
-			}
-		}
-	}
+	if (cpuID < 0 || cpuID > cpuCount)
+		return "cpu " + to_string(cpuID) + " not declared in the header";
+
+	if (appID < 1 || appID > (int) applicationThreads.size())
+		return "application " + to_string(appID)
+				+ " not declared in the header";
+
+	const vector<int> & tasks = applicationThreads.at(appID - 1);
+	if (taskID < 1 || taskID > (int) tasks.size())
+		return "task " + to_string(appID) + "." + to_string(taskID)
+				+ " not declared in the header";
+
+	if (threadID < 1 || threadID > tasks.at(taskID - 1))
+		return "thread " + to_string(appID) + "." + to_string(taskID) + "."
+				+ to_string(threadID) + " not declared in the header";
+
+	return "";
 }
 
 /**
- * Parse the .prv file
+ * Check the trace without converting it: malformed records, timestamps that
+ * are not sorted, states ending before they start and objects that are not
+ * declared in the header.
+ *
+ * @return true if no problem was found
  */
-void ParaverParser::parseTrace(string traceFile) {
-	ifstream file;
-	file.open(traceFile.c_str());
-	string line;
-
-	// Open the output file
-	pjdumpFile.open(outputFile);
-
-	if (!pjdumpFile.good()) {
-		cout << "Error: could not open output file " << outputFile << endl;
-		return;
+bool ParaverParser::validate(string traceFile, unsigned int maxReported) {
+	LineReader reader;
+	const char * line = nullptr;
+	size_t length = 0;
+
+	if (!reader.open(traceFile)) {
+		cerr << "Error: could not open trace file " << traceFile << endl;
+		return false;
 	}
 
-	// Get the first non empty line
-	while (getline(file, line) && line.empty()) {
+	bool found;
+	while ((found = reader.nextLine(line, length)) && length == 0) {
+	}
+	if (!found) {
+		cerr << "Error: the trace file " << traceFile << " is empty" << endl;
+		return false;
 	}
 
-	// Handle the header
-	parseHeader(line);
+	try {
+		parseHeader(string(line, length));
+	} catch (const exception & e) {
+		cerr << "Error: malformed header: " << string(line, length) << endl;
+		return false;
+	}
 
-	// process the producers
-	//pjdumpFile << buildProducers();
+	PrvRecord record;
+	string error;
+	long long lastTime = LLONG_MIN;
+	unsigned long long recordCount = 0;
+	unsigned long long malformed = 0;
+	unsigned long long unsorted = 0;
+	unsigned long long negativeStates = 0;
+	unsigned long long undeclared = 0;
+	unsigned long long reported = 0;
+
+	while (reader.nextLine(line, length)) {
+		vector<string> problems;
+		TokenizeResult result = tokenizeRecord(line, line + length, record,
+				error);
+
+		if (result == RECORD_MALFORMED) {
+			malformed++;
+			problems.push_back("malformed record: " + error);
+		} else if (result == RECORD_OK) {
+			recordCount++;
+
+			// Records are sorted on their first time
+			long long time = (record.category == LINK_CATEGORY) ?
+					record.wantedSendTime : record.time;
+			if (time < lastTime) {
+				unsorted++;
+				problems.push_back(
+						"timestamp " + to_string(time)
+								+ " is lower than the previous one ("
+								+ to_string(lastTime) + ")");
+			}
+			lastTime = max(lastTime, time);
+
+			if (record.category == STATE_CATEGORY
+					&& record.endTime < record.time) {
+				negativeStates++;
+				problems.push_back(
+						"state ends (" + to_string(record.endTime)
+								+ ") before it starts ("
+								+ to_string(record.time) + ")");
+			}
 
-	// handle the trace records
-	while (getline(file, line)) {
-		string pjdumpLine = parseRecord(line);
+			string objectError = checkObject(record.cpuID, record.appID,
+					record.taskID, record.threadID);
+			if (objectError.empty() && record.category == LINK_CATEGORY)
+				objectError = checkObject(record.cpuIDReceive,
+						record.appIDReceive, record.taskIDReceive,
+						record.threadIDReceive);
+			if (!objectError.empty()) {
+				undeclared++;
+				problems.push_back(objectError);
+			}
+		}
 
-		if (!pjdumpLine.empty())
-			pjdumpFile << pjdumpLine;
+		for (string & problem : problems) {
+			if (reported < maxReported)
+				cerr << "Line " << reader.getLineNumber() << " (byte offset "
+						<< reader.getLineOffset() << "): " << problem << endl;
+			reported++;
+		}
 	}
 
-	pjdumpFile.close();
+	if (reported > maxReported)
+		cerr << "(" << reported - maxReported << " more problems not shown)"
+				<< endl;
+
+	cerr << "Checked " << reader.getLineNumber() << " lines, " << recordCount
+			<< " records" << endl;
+	cerr << "Malformed records: " << malformed << endl;
+	cerr << "Unsorted timestamps: " << unsorted << endl;
+	cerr << "States ending before their start: " << negativeStates << endl;
+	cerr << "Records with undeclared objects: " << undeclared << endl;
+
+	return reported == 0;
 }
 
 /**
- * Parse the header of a .prv file
+ * Remove the date from the start of a header
  */
-void ParaverParser::parseHeader(string headerLine) {
-
+static void skipHeaderDate(string & headerLine) {
 	string date = headerLine.substr(0, headerLine.find(PRV_SEPARATOR));
-	// Skip date metadata
 	headerLine.erase(0, headerLine.find(PRV_SEPARATOR) + 1);
 	if (date.find("(") != string::npos && date.find(")") == string::npos) {
 		// Another one because of the ":" in the hour
 		headerLine.erase(0, headerLine.find(PRV_SEPARATOR) + 1);
 	}
+}
+
+int ParaverParser::readTraceUnit(string headerLine) {
+	skipHeaderDate(headerLine);
+
+	string durationStr = headerLine.substr(0, headerLine.find(PRV_SEPARATOR));
+	int traceUnit = DEFAULT_TRACE_UNIT;
+	if (durationStr.find("_") != string::npos)
+		parseTimeUnit(durationStr.substr(durationStr.find("_") + 1),
+				traceUnit);
+	return traceUnit;
+}
+
+/**
+ * Parse the header of a .prv file
+ */
+void ParaverParser::parseHeader(string headerLine) {
 
-	// Get duration
+	// Skip date metadata
+	skipHeaderDate(headerLine);
+
+	// Get duration, and the time unit of the trace
 	string durationStr = headerLine.substr(0, headerLine.find(PRV_SEPARATOR));
+	int traceUnit = DEFAULT_TRACE_UNIT;
 	if (durationStr.find_first_of("_") == string::npos)
 		traceDuration = stoll(durationStr);
 	else {
+		string unitName = durationStr.substr(durationStr.find("_") + 1);
+		if (!parseTimeUnit(unitName, traceUnit))
+			cerr << "Warning: unknown time unit " << unitName
+					<< " in the header, the times are read in us." << endl;
 		durationStr = durationStr.substr(0, headerLine.find("_"));
 		traceDuration = stoll(durationStr);
 	}
 
+	// The records are given in a finer unit than the header
+	if (recordUnit != NO_RECORD_UNIT) {
+		for (int unit = recordUnit; unit < traceUnit; unit++)
+			traceDuration *= 10;
+		traceUnit = recordUnit;
+	}
+
+	// No writer when the trace is only validated
+	if (writer != nullptr) {
+		writer->setTraceUnit(traceUnit);
+
+		// These stages write records after records starting later
+		if (useEventForState || eventPairing != nullptr
+				|| coalescer != nullptr || counters != nullptr
+				|| rollUp != nullptr
+				|| (reducer != nullptr && reducer->useReservoir()))
+			writer->setUnsortedRecords();
+	}
+
 	headerLine.erase(0, headerLine.find(PRV_SEPARATOR) + 1);
 
 	// Handle number of nodes and processor per node
@@ -272,8 +482,10 @@ void ParaverParser::parseHeader(string headerLine) {
 	// Parse tasks and threads for each application
 	for (int appNumber = 0; appNumber < numberofApplications; appNumber++) {
 		string appName = APPLICATION_CONTAINER_PREFIX + "_" + to_string(appNumber);
-		buildContainer(appName, "0");
+		buildContainer(appName, "0", APPLICATION_CONTAINER_KIND);
 		int taskCount = 1;
+		applicationThreads.push_back(vector<int>());
+		applicationNodes.push_back(vector<int>());
 
 		//Parse task
 		string taskStr = headerLine.substr(0, headerLine.find(")"));
@@ -286,24 +498,22 @@ void ParaverParser::parseHeader(string headerLine) {
 			// Number of thread in the task
 			taskThread.push_back(
 					stoi(taskConfig.substr(0, taskConfig.find(PRV_SEPARATOR))));
+			applicationThreads.back().push_back(taskThread.back());
 
 			unsigned int nodeNumber = stoi(
 					taskConfig.substr(taskConfig.find(PRV_SEPARATOR) + 1,
 							taskConfig.length()));
 
-			string nodeName = NODE_CONTAINER_PREFIX + "_" + to_string(nodeNumber);
-			// Check for a substitute name
-			if (resourceNames.at(RESOURCE_LEVEL_NODE).size() >= nodeNumber) {
-				nodeName = resourceNames.at(RESOURCE_LEVEL_NODE).at(nodeNumber - 1);
-			}
+			string nodeName = getNodeName(nodeNumber);
 
-			buildContainer(nodeName, appName);
+			buildContainer(nodeName, appName, NODE_CONTAINER_KIND);
 
 			// Node executing the task
 			taskNode.push_back(nodeNumber);
+			applicationNodes.back().push_back(nodeNumber);
 
 			string taskName = TASK_CONTAINER_PREFIX + "_" + to_string(taskCount);
-			buildContainer(taskName, nodeName);
+			buildContainer(taskName, nodeName, TASK_CONTAINER_KIND);
 			taskCount++;
 
 			taskStr.erase(0, taskStr.find(",") + 1);
@@ -312,64 +522,73 @@ void ParaverParser::parseHeader(string headerLine) {
 		unsigned int nodeNumber = stoi(
 				taskStr.substr(taskStr.find(PRV_SEPARATOR) + 1,
 						taskStr.length()));
-		string nodeName = NODE_CONTAINER_PREFIX + "_" + to_string(nodeNumber);
-		// Check for a substitute name
-		if (resourceNames.at(RESOURCE_LEVEL_NODE).size() >= nodeNumber) {
-			nodeName = resourceNames.at(RESOURCE_LEVEL_NODE).at(nodeNumber - 1);
-		}
+		string nodeName = getNodeName(nodeNumber);
+
+		buildContainer(nodeName, appName, NODE_CONTAINER_KIND);
 
 		// Handle the last task
 		taskThread.push_back(
 				stoi(taskStr.substr(0, taskStr.find(PRV_SEPARATOR))));
-		taskNode.push_back(
-				stoi(
-						taskStr.substr(taskStr.find(PRV_SEPARATOR) + 1,
-								taskStr.length())));
+		applicationThreads.back().push_back(taskThread.back());
+		taskNode.push_back(nodeNumber);
+		applicationNodes.back().push_back(nodeNumber);
 
 		string taskName = TASK_CONTAINER_PREFIX + "_" + to_string(taskCount);
-		buildContainer(taskName, nodeName);
+		buildContainer(taskName, nodeName, TASK_CONTAINER_KIND);
+
+		// Skip the communicators and go to the next application
+		headerLine.erase(0, headerLine.find(")") + 1);
+		if (headerLine.find(PRV_SEPARATOR) != string::npos)
+			headerLine.erase(0, headerLine.find(PRV_SEPARATOR) + 1);
+		else
+			headerLine.clear();
+	}
+
+	// Number the declared threads
+	for (vector<int> & tasks : applicationThreads) {
+		threadOffsets.push_back(vector<int>());
+		for (int threads : tasks) {
+			threadOffsets.back().push_back(containerCount);
+			containerCount += threads;
+		}
 	}
 }
 
 /**
- * Parse one line of the .prv file
+ * Name of a node, taken from the .row file if available
  */
-string ParaverParser::parseRecord(string line) {
-
-	string pjdumpLine = "";
-
-	if (line.empty())
-		return pjdumpLine;
-
-	string token = line.substr(0, line.find(PRV_SEPARATOR));
-
-	if (!isdigit(token.at(0)))
-		return pjdumpLine;
+string ParaverParser::getNodeName(unsigned int nodeNumber) {
+	// Check for a substitute name
+	if (config->resourceNames.find(RESOURCE_LEVEL_NODE) != config->resourceNames.end()
+			&& nodeNumber >= 1
+			&& config->resourceNames.at(RESOURCE_LEVEL_NODE).size() >= nodeNumber)
+		return config->resourceNames.at(RESOURCE_LEVEL_NODE).at(nodeNumber - 1);
+
+	return NODE_CONTAINER_PREFIX + "_" + to_string(nodeNumber);
+}
 
-	int category = stoi(token);
+/**
+ * Convert one tokenized record of the .prv file
+ */
+void ParaverParser::parseRecord(const PrvRecord & record) {
 
-	switch (category) {
+	switch (record.category) {
 	case STATE_CATEGORY:
-		pjdumpLine = parseState(line);
+		parseState(record);
 		break;
 
 	case EVENT_CATEGORY:
-		pjdumpLine = parseEvent(line);
+		parseEvent(record);
 		break;
 
 	case LINK_CATEGORY:
-		pjdumpLine = parseLink(line);
+		parseLink(record);
 		break;
-
-	default:
-		cerr << "Unsupported type of event: " + line << endl;
 	}
-
-	return pjdumpLine;
 }
 
 /**
- * Parse a line representing a type state
+ * Convert a record representing a type state
  *
  * from:
  *	1:cpuID:appID:taskID:threadID:startTime:endTime:type
@@ -377,44 +596,63 @@ string ParaverParser::parseRecord(string line) {
  * to:
  *	State, container, state type, startTime, endTime, duration, imbricationLevel, value
  */
-string ParaverParser::parseState(string line) {
+void ParaverParser::parseState(const PrvRecord & record) {
 
-	// remove token
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int cpuID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int appID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int taskID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	if(lastState != nullptr)
+		delete lastState;
 
-	int threadID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	lastState = new State(record.time,
+			getOutputContainerName(record.appID, record.taskID, record.threadID),
+			getStateName(record.stateType), record.endTime);
 
-	long long startTimestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	// The state is merged into the timeline of its parent container
+	if (rollUp != nullptr) {
+		if (statistics != nullptr)
+			statistics->addState(lastState->getContainer(),
+					lastState->getName(), record.time, record.endTime);
 
-	long long endTimestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+		int parentIndex = getParentIndex(record.appID, record.taskID);
+		rollUp->addState(parentIndex, parentNames[parentIndex], record.time,
+				record.endTime, record.stateType, lastState->getName());
+		return;
+	}
 
-	int type = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	int containerIndex = (coalescer != nullptr) ?
+			getContainerIndex(record.appID, record.taskID, record.threadID) :
+			-1;
+	writeThreadState(containerIndex, *lastState);
+}
 
-	if(lastState != nullptr)
-		free(lastState);
+/**
+ * Write a state of a thread (read from the trace, or built from a region of
+ * --event-pairs) through the statistics, the coalescer and the reducer
+ *
+ * @param containerIndex index of the thread, only needed by the coalescer
+ */
+void ParaverParser::writeThreadState(int containerIndex, State & state) {
+	if (statistics != nullptr)
+		statistics->addState(state.getContainer(), state.getName(),
+				state.getTimeStamp(), state.getEndDate());
+
+	State * output = &state;
+
+	// The state is only written once the next state of the container differs
+	State flushed;
+	if (coalescer != nullptr) {
+		if (!coalescer->add(containerIndex, state, flushed))
+			return;
+		output = &flushed;
+	}
 
-	lastState = new State(startTimestamp,
-			getContainerName(appID, taskID, threadID), getStateName(type),
-			endTimestamp);
+	if (reducer != nullptr
+			&& !reducer->keepState(output->getTimeStamp(), output->getEndDate()))
+		return;
 
-	return lastState->toPjdump();
+	writer->writeState(*output);
 }
 
 /**
- * Parse a line representing a punctual event
+ * Convert a record representing a punctual event
  *
  * from
  * 	2:cpuID:appID:taskID:threadID:startTime:type:value
@@ -422,157 +660,184 @@ string ParaverParser::parseState(string line) {
  * to
  * 	Event, containerName, eventName, timeStamp, eventValue
  */
-string ParaverParser::parseEvent(string line) {
-
-	// remove token
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int cpuID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int appID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int taskID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int threadID = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	long long timestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	map<int, long long> params = map<int, long long>();
-	int firstType = -1;
-	int firstValue = -1;
-
-	while (count(line.begin(), line.end(), PRV_SEPARATOR) > 1) {
-		int type = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-		line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-		long long value = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-		line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-		params[type] = value;
-
-		if (firstType == -1)
-			firstType = type;
-		if (firstValue == -1)
-			firstValue = value;
-	}
-
-	int type = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	long long value = stoll(line);
-	params[type] = value;
+void ParaverParser::parseEvent(const PrvRecord & record) {
+
+	long long timestamp = record.time;
+
+	// Use the first param as it seems to be the most significant
+	auto first = record.params.begin();
+	if (counters != nullptr)
+		while (next(first) != record.params.end()
+				&& CounterSeries::isCounter(first->first))
+			++first;
+	int firstType = first->first;
+	int firstValue = first->second;
+	int type = record.params.back().first;
+
+	// The hardware counters are converted into variables, the event is kept
+	// for the other parameters
+	if (counters != nullptr && !sampleCounters(record, type))
+		return;
 
-	if (firstType == -1)
-		firstType = type;
-	if (firstValue == -1)
-		firstValue = value;
+	// The parameters of the region types are converted into states, the
+	// event is kept for the other ones
+	if (eventPairing != nullptr && !pairRegions(record, type))
+		return;
 
 	if (useEventForState && lastState != nullptr) {
 		if (lastState->getContainer()
-				== getContainerName(appID, taskID, threadID)
+				== getOutputContainerName(record.appID, record.taskID, record.threadID)
 				&& lastState->getTimeStamp() <= timestamp
 				&& lastState->getEndDate() >= timestamp) {
 
-			// Use the first param as it seems to be the most significant
 			// Add a prefix in order to avoid having event and state with the same name
 			string stateType = getEventName(firstType) + "_state";
 
 			// Is there an alternative name defined in the .pcf file
-			if(eventTypes.find(firstType) != eventTypes.end()){
-				stateType =  eventTypes.at(firstType).at(firstValue);
+			if (config->eventTypes.find(firstType) != config->eventTypes.end()
+					&& config->eventTypes.at(firstType).find(firstValue)
+							!= config->eventTypes.at(firstType).end()) {
+				stateType =  config->eventTypes.at(firstType).at(firstValue);
 			}
 
 			State eventState = State(timestamp, lastState->getContainer(),
 					stateType, lastState->getEndDate());
 			eventState.setImbrication(1);
 
-			free(lastState);
+			delete lastState;
 			lastState = nullptr;
 
-			return eventState.toPjdump();
+			writer->writeState(eventState);
+			return;
 		}
 	}
 
-	Event event = Event(timestamp, getContainerName(appID, taskID, threadID),
+	int containerIndex = -1;
+	if (reducer != nullptr) {
+		containerIndex = getContainerIndex(record.appID, record.taskID,
+				record.threadID);
+		if (!reducer->keepEvent(containerIndex, type, timestamp))
+			return;
+	}
+
+	Event event = Event(timestamp,
+			getOutputContainerName(record.appID, record.taskID, record.threadID),
 			getEventName(type));
 
-	return event.toPjdump();
+	// The kept events are written at the end of the trace
+	if (reducer != nullptr && reducer->useReservoir()) {
+		reducer->offerReservoir(containerIndex, event);
+		return;
+	}
+
+	writer->writeEvent(event);
 }
 
 /**
- * Parse a line representing a type link
+ * Write the hardware counters of an event record as variables of its
+ * container
  *
- * from
- * 	3:objectSender:wantedSendTime:actualSendTime:objectReceiver:wantedReceiveTime:actualRcvTime:size:tag
- *
- * objectSender = cpuID:appId:TaskID:threadID
- * objectReceiver = cpuID:appId:TaskID:threadID
- *
- * to
- * 	Link, containerName, linkType, startTime, endTime, duration, linkValue, sendingContainerName, receivingContainerName
+ * @return true if the record has other parameters, the type of the last one
+ * is then given in otherType
  */
-string ParaverParser::parseLink(string line) {
-
-	// remove token
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	// Sender fields
-	int cpuIDSend = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
-
-	int appIDSend = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+bool ParaverParser::sampleCounters(const PrvRecord & record, int & otherType) {
+	bool others = false;
+	for (auto & param : record.params)
+		if (!CounterSeries::isCounter(param.first)) {
+			otherType = param.first;
+			others = true;
+		}
 
-	int taskIDSend = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	counterVariables.clear();
+	counters->sample(
+			getContainerIndex(record.appID, record.taskID, record.threadID),
+			record.time, record.params, config->eventNames, counterVariables);
+
+	if (!counterVariables.empty()) {
+		string container = getOutputContainerName(record.appID, record.taskID,
+				record.threadID);
+		for (CounterVariable & variable : counterVariables)
+			writer->writeVariable(container, variable.name, variable.start,
+					variable.end, variable.value);
+	}
 
-	int threadIDSend = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	return others;
+}
 
-	long long wantedSendTimestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+/**
+ * Open or close the regions of the event types having values in the .pcf
+ * file (user functions, MPI calls, OpenMP regions...): a non-zero value
+ * opens a region, the value 0 closes it. The state of a region is written
+ * when it is closed.
+ *
+ * @param otherType set to the last type of the record that is not a region
+ * @return false if all the parameters of the record were regions
+ */
+bool ParaverParser::pairRegions(const PrvRecord & record, int & otherType) {
+	bool others = false;
+	int containerIndex = -1;
 
-	long long actualSendTimestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	for (auto & param : record.params) {
+		if (counters != nullptr && CounterSeries::isCounter(param.first))
+			continue;
 
-	//receiverFields
-	int cpuIDReceive = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+		auto values = config->eventTypes.find(param.first);
+		if (values == config->eventTypes.end()) {
+			otherType = param.first;
+			others = true;
+			continue;
+		}
 
-	int appIDReceive = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+		if (containerIndex == -1)
+			containerIndex = getContainerIndex(record.appID, record.taskID,
+					record.threadID);
 
-	int taskIDReceive = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+		if (param.second != 0) {
+			auto value = values->second.find((int) param.second);
+			string name = (value != values->second.end()) ?
+					value->second :
+					getEventName(param.first) + "_" + to_string(param.second);
 
-	int threadIDReceive = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+			eventPairing->begin(containerIndex, param.first,
+					getOutputContainerName(record.appID, record.taskID,
+							record.threadID), name, record.time);
+			continue;
+		}
 
-	long long wantedRcvTimestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+		State closed;
+		if (eventPairing->end(containerIndex, param.first, record.time, closed))
+			writeThreadState(containerIndex, closed);
+	}
 
-	long long actualRcvTimestamp = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	return others;
+}
 
-	// Other fields
-	// Size in byte
-	long long size = stoll(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+/**
+ * Convert a record representing a type link
+ *
+ * from
+ * 	3:objectSender:wantedSendTime:actualSendTime:objectReceiver:wantedReceiveTime:actualRcvTime:size:tag
+ *
+ * objectSender = cpuID:appId:TaskID:threadID
+ * objectReceiver = cpuID:appId:TaskID:threadID
+ *
+ * to
+ * 	Link, containerName, linkType, startTime, endTime, duration, linkValue, sendingContainerName, receivingContainerName
+ */
+void ParaverParser::parseLink(const PrvRecord & record) {
 
-	int tag = stoi(line.substr(0, line.find(PRV_SEPARATOR)));
-	line.erase(0, line.find(PRV_SEPARATOR) + 1);
+	Link link = Link(record.time,
+			getOutputContainerName(record.appID, record.taskID, record.threadID), "",
+			record.endTime,
+			getOutputContainerName(record.appIDReceive, record.taskIDReceive,
+					record.threadIDReceive));
 
-	Link link = Link(actualSendTimestamp,
-			getContainerName(appIDSend, taskIDSend, threadIDSend), "",
-			actualRcvTimestamp,
-			getContainerName(appIDReceive, taskIDReceive, threadIDReceive));
+	if (statistics != nullptr)
+		statistics->addLink(record.appID, record.taskID, link.getContainer(),
+				record.appIDReceive, record.taskIDReceive,
+				link.getReceiverContainer(), record.time, record.endTime);
 
-	return link.toPjdump();
+	writer->writeLink(link);
 }
 
 /**
@@ -583,16 +848,16 @@ string ParaverParser::parseLink(string line) {
 string ParaverParser::buildProducers() {
 	stringstream producers;
 
-	if(resourceNames.find("THREAD") == resourceNames.end())
+	if(config->resourceNames.find("THREAD") == config->resourceNames.end())
 		return "";
 
-	for (unsigned int i = 0; i < resourceNames.at("THREAD").size(); i++) {
+	for (unsigned int i = 0; i < config->resourceNames.at("THREAD").size(); i++) {
 		producers << "Container, 0,";
-		producers << resourceNames.at("THREAD").at(i) << PJDUMP_SEPARATOR;
+		producers << config->resourceNames.at("THREAD").at(i) << PJDUMP_SEPARATOR;
 		producers << 0 << PJDUMP_SEPARATOR;
 		producers << traceDuration << PJDUMP_SEPARATOR;
 		producers << traceDuration << PJDUMP_SEPARATOR;
-		producers << resourceNames.at("THREAD").at(i) << endl;
+		producers << config->resourceNames.at("THREAD").at(i) << endl;
 	}
 
 	return producers.str();
@@ -602,8 +867,8 @@ string ParaverParser::buildProducers() {
  * Look if a name for the given type exists, if not, falls back on default values and if not return a default name with the type at the end
  */
 string ParaverParser::getStateName(int type) {
-	if (stateNames.find(type) != stateNames.end())
-		return stateNames.at(type);
+	if (config->stateNames.find(type) != config->stateNames.end())
+		return config->stateNames.at(type);
 
 	if (defaultStateValues.find(type) != defaultStateValues.end())
 		return defaultStateValues.at(type);
@@ -615,8 +880,8 @@ string ParaverParser::getStateName(int type) {
 }
 
 string ParaverParser::getEventName(int type) {
-	if (eventNames.find(type) != eventNames.end())
-		return eventNames.at(type);
+	if (config->eventNames.find(type) != config->eventNames.end())
+		return config->eventNames.at(type);
 
 	stringstream ss;
 	ss << type;
@@ -637,7 +902,7 @@ string ParaverParser::getContainerName(int appID, unsigned int taskID, int threa
 			+ to_string(threadID);
 
 	if(contains(createdContainers, name))
-		return name;
+		return qualify(name);
 
 	string taskParentID = TASK_CONTAINER_PREFIX + "_" + to_string(taskID);
 	if (contains(createdContainers, taskParentID)) {
@@ -646,11 +911,92 @@ string ParaverParser::getContainerName(int appID, unsigned int taskID, int threa
 		buildContainer(appID, taskID, threadID, "0");
 	}
 
-	return name;
+	return qualify(name);
+}
+
+/**
+ * Name of the container receiving the records of a thread: the thread
+ * itself, or its parent at the roll-up level
+ */
+string ParaverParser::getOutputContainerName(int appID, int taskID,
+		int threadID) {
+	if (rollUp == nullptr)
+		return getContainerName(appID, taskID, threadID);
+
+	return parentNames[getParentIndex(appID, taskID)];
+}
+
+/**
+ * Get a dense index identifying the parent container of a task at the
+ * roll-up level (the parent container is created on first use if it was not
+ * declared in the header)
+ */
+int ParaverParser::getParentIndex(int appID, int taskID) {
+	bool declared = appID >= 1 && appID <= (int) applicationNodes.size()
+			&& taskID >= 1
+			&& taskID <= (int) applicationNodes[appID - 1].size();
+	int index;
+
+	switch (level) {
+	case LEVEL_TASK:
+		// Index of the first thread of the task
+		index = getContainerIndex(appID, taskID, 1);
+		break;
+	case LEVEL_NODE:
+		index = declared ? applicationNodes[appID - 1][taskID - 1] : 0;
+		break;
+	default:
+		index = max(appID, 0);
+	}
+
+	if ((unsigned int) index >= parentNames.size())
+		parentNames.resize(index + 1);
+
+	if (parentNames[index].empty()) {
+		string name, kind;
+		switch (level) {
+		case LEVEL_TASK:
+			name = TASK_CONTAINER_PREFIX + "_" + to_string(taskID);
+			kind = TASK_CONTAINER_KIND;
+			break;
+		case LEVEL_NODE:
+			name = getNodeName(index);
+			kind = NODE_CONTAINER_KIND;
+			break;
+		default:
+			name = APPLICATION_CONTAINER_PREFIX + "_" + to_string(appID - 1);
+			kind = APPLICATION_CONTAINER_KIND;
+		}
+
+		buildContainer(name, "0", kind);
+		parentNames[index] = qualify(name);
+	}
+
+	return index;
+}
+
+/**
+ * Get a dense index (starting at 0) identifying a thread. The threads
+ * declared in the header are numbered first.
+ */
+int ParaverParser::getContainerIndex(int appID, int taskID, int threadID) {
+	if (appID >= 1 && appID <= (int) threadOffsets.size()) {
+		const vector<int> & offsets = threadOffsets[appID - 1];
+		if (taskID >= 1 && taskID <= (int) offsets.size() && threadID >= 1
+				&& threadID <= applicationThreads[appID - 1][taskID - 1])
+			return offsets[taskID - 1] + threadID - 1;
+	}
+
+	tuple<int, int, int> key = make_tuple(appID, taskID, threadID);
+	auto it = undeclaredContainers.find(key);
+	if (it != undeclaredContainers.end())
+		return it->second;
+
+	undeclaredContainers[key] = containerCount;
+	return containerCount++;
 }
 
 void ParaverParser::buildContainer(int appID, int taskID, int threadID, string parent) {
-	stringstream container;
 	string name = "THREAD " + to_string(appID) + "." + to_string(taskID) + "."
 			+ to_string(threadID);
 
@@ -658,15 +1004,9 @@ void ParaverParser::buildContainer(int appID, int taskID, int threadID, string p
 	if(contains(createdContainers, name))
 		return;
 
-	container << "Container" << PJDUMP_SEPARATOR;
-	container << parent << PJDUMP_SEPARATOR;
-	container << name << PJDUMP_SEPARATOR;
-	container << 0 << PJDUMP_SEPARATOR;
-	container << traceDuration << PJDUMP_SEPARATOR;
-	container << traceDuration << PJDUMP_SEPARATOR;
-	container << name << endl;
-
-	pjdumpFile << container.str();
+	if (writer != nullptr)
+		writer->writeContainer(qualify(parent), qualify(name),
+				THREAD_CONTAINER_KIND, 0, traceDuration);
 
 	createdContainers.insert(name);
 
@@ -678,25 +1018,18 @@ void ParaverParser::buildContainer(int appID, int taskID, int threadID, string p
 		threadProducers[appID][taskID] = map<int, string>();
 	}
 
-	threadProducers[appID][taskID][threadID] = name;
+	threadProducers[appID][taskID][threadID] = qualify(name);
 }
 
-void ParaverParser::buildContainer(string name, string parentName) {
+void ParaverParser::buildContainer(string name, string parentName,
+		const string & kind) {
 	// Check if already existing
 	if(contains(createdContainers, name))
 		return;
 
-	stringstream container;
-
-	container << "Container" << PJDUMP_SEPARATOR;
-	container << parentName << PJDUMP_SEPARATOR;
-	container << name << PJDUMP_SEPARATOR;
-	container << 0 << PJDUMP_SEPARATOR;
-	container << traceDuration << PJDUMP_SEPARATOR;
-	container << traceDuration << PJDUMP_SEPARATOR;
-	container << name << endl;
-
-	pjdumpFile << container.str();
+	if (writer != nullptr)
+		writer->writeContainer(qualify(parentName), qualify(name), kind, 0,
+				traceDuration);
 
 	createdContainers.insert(name);
 }
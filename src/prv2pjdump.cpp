@@ -1,4 +1,15 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "include/comparison.h"
+#include "include/pajeWriter.h"
 #include "include/prv2pjdump.h"
+#include "include/selfTrace.h"
+#include "include/traceMerger.h"
 
 using namespace std;
 
@@ -7,23 +18,31 @@ const string PARAVER_FILE_EXTENSION = ".prv";
 const string PARAVER_CONF_FILE_EXTENSION = ".pcf";
 const string PARAVER_RESOURCE_FILE_EXTENSION = ".row";
 const string PJDUMP_FILE_EXTENSION = ".pjdump";
+const string SQLITE_FILE_EXTENSION = ".sqlite";
+const string PAJE_FILE_EXTENSION = ".paje";
+// Between the name of a merged trace and the names of its containers
+const string MERGE_PREFIX_SEPARATOR = "/";
+// Largest number of threads given with --threads and --compression-threads
+const long long MAX_THREADS = 1024;
 
 /**
  * prv2pjdump is a utility program converting a paraver trace to pjdump format.
  */
 int main(int argc, char **argv) {
 	Prv2Pjdump prv2pjd = Prv2Pjdump();
-	prv2pjd.launch(argc, argv);
+	int result = prv2pjd.launch(argc, argv);
+	prv2pjd.writeSelfTrace();
+	return result;
 }
 
-void Prv2Pjdump::launch(int argc, char **argv) {
+int Prv2Pjdump::launch(int argc, char **argv) {
 
 	if (argc < MINIMUM_INPUT_SIZE) {
-		cout
+		cerr
 				<< "Error: not enough arguments provided. You must provide at least one prv file."
 				<< endl << endl;
 		printHelp();
-		return;
+		return 1;
 	}
 
 	int opt;
@@ -31,10 +50,50 @@ void Prv2Pjdump::launch(int argc, char **argv) {
 	static struct option long_options[] = { { "output-file", required_argument,
 			0, 'o' },
 			{ "event-state", required_argument,
-					0, 'e' },{ 0, 0, 0, 0 } };
+					0, 'e' },
+			{ "event-pairs", no_argument, 0, 'p' },
+			{ "counters", no_argument, 0, 'P' },
+			{ "counter-metrics", required_argument, 0, 'M' },
+			{ "histogram", required_argument, 0, 'H' },
+			{ "histogram-containers", no_argument, 0, 'C' },
+			{ "top", required_argument, 0, 'k' },
+			{ "validate", no_argument, 0, 'V' },
+			{ "max-errors", required_argument, 0, 'm' },
+			{ "skip-errors", no_argument, 0, 's' },
+			{ "min-duration", required_argument, 0, 'd' },
+			{ "event-rate", required_argument, 0, 'r' },
+			{ "sample", required_argument, 0, 'n' },
+			{ "reservoir", required_argument, 0, 'R' },
+			{ "coalesce", no_argument, 0, 'c' },
+			{ "coalesce-gap", required_argument, 0, 'g' },
+			{ "format", required_argument, 0, 'f' },
+			{ "level", required_argument, 0, 'l' },
+			{ "rollup", required_argument, 0, 'u' },
+			{ "config-cache", no_argument, 0, 'K' },
+			{ "record-cache", no_argument, 0, 'B' },
+			{ "out", required_argument, 0, 'O' },
+			{ "sink-threads", no_argument, 0, 'T' },
+			{ "compression-level", required_argument, 0, 'z' },
+			{ "block-size", required_argument, 0, 'b' },
+			{ "compression-threads", required_argument, 0, 'Z' },
+			{ "index", no_argument, 0, 'I' },
+			{ "container", required_argument, 0, 'x' },
+			{ "serve", required_argument, 0, 'S' },
+			{ "threads", required_argument, 0, 'j' },
+			{ "query-cache", required_argument, 0, 'Q' },
+			{ "pcf", required_argument, 0, 'F' },
+			{ "row", required_argument, 0, 'w' },
+			{ "time-unit", required_argument, 0, 't' },
+			{ "time-precision", required_argument, 0, 'D' },
+			{ "compare", required_argument, 0, 'A' },
+			{ "threshold", required_argument, 0, 'y' },
+			{ "self-trace", required_argument, 0, 'X' },{ 0, 0, 0, 0 } };
+
+	// Value of the numeric options
+	long long value;
 
 	// Check the provided options
-	while ((opt = getopt_long(argc, argv, "eo:", long_options, &option_index))
+	while ((opt = getopt_long(argc, argv, "epPM:o:H:Ck:Vm:sd:r:n:R:cg:f:l:u:KBO:Tz:b:Z:Ix:S:j:Q:F:w:t:D:A:y:X:", long_options, &option_index))
 			!= -1) {
 		switch (opt) {
 		case 'o':
@@ -43,91 +102,1062 @@ void Prv2Pjdump::launch(int argc, char **argv) {
 		case 'e':
 			useEventForState = true;
 			break;
+		case 'p':
+			pairEvents = true;
+			break;
+		case 'P':
+			useCounters = true;
+			break;
+		case 'M':
+			useCounters = true;
+			counterMetrics = optarg;
+			break;
+		case 'H':
+			histogramFile = optarg;
+			break;
+		case 'C':
+			histogramPerContainer = true;
+			break;
+		case 'k':
+			if (!parseInteger("--top", optarg, 0, INT_MAX, value))
+				return 1;
+			histogramTopCount = value;
+			break;
+		case 'V':
+			validateOnly = true;
+			break;
+		case 'm':
+			if (!parseInteger("--max-errors", optarg, 0, INT_MAX, value))
+				return 1;
+			maxReportedErrors = value;
+			break;
+		case 's':
+			skipErrors = true;
+			break;
+		case 'd':
+			if (!parseInteger("--min-duration", optarg, 0, LLONG_MAX,
+					minDuration))
+				return 1;
+			break;
+		case 'r': {
+			// COUNT/WINDOW
+			string rate = optarg;
+			if (rate.find("/") == string::npos) {
+				cerr << "Error: the event rate must be given as COUNT/WINDOW"
+						<< endl;
+				return 1;
+			}
+			if (!parseInteger("--event-rate",
+					rate.substr(0, rate.find("/")).c_str(), 0, LLONG_MAX,
+					eventRateCount)
+					|| !parseInteger("--event-rate",
+							rate.substr(rate.find("/") + 1).c_str(), 1,
+							LLONG_MAX, eventRateWindow))
+				return 1;
+			break;
+		}
+		case 'n':
+			if (!parseInteger("--sample", optarg, 0, INT_MAX, value))
+				return 1;
+			sampleInterval = value;
+			break;
+		case 'R':
+			if (!parseInteger("--reservoir", optarg, 0, INT_MAX, value))
+				return 1;
+			reservoirSize = value;
+			break;
+		case 'c':
+			coalesce = true;
+			break;
+		case 'g':
+			if (!parseInteger("--coalesce-gap", optarg, 0, LLONG_MAX,
+					coalesceGap))
+				return 1;
+			break;
+		case 'f':
+			outputFormat = optarg;
+			break;
+		case 'K':
+			useConfigCache = true;
+			break;
+		case 'B':
+			useRecordCache = true;
+			break;
+		case 'O':
+			outputs.push_back(optarg);
+			break;
+		case 'T':
+			sinkThreads = true;
+			break;
+		case 'z':
+			// The range of the format is checked when the output is opened
+			if (!parseInteger("--compression-level", optarg, 0,
+					MAX_ZSTD_LEVEL, value))
+				return 1;
+			compression.level = value;
+			break;
+		case 'b':
+			// In kilobytes
+			if (!parseInteger("--block-size", optarg, 1,
+					MAX_COMPRESSION_BLOCK_KB, value))
+				return 1;
+			compression.blockSize = value * 1024;
+			break;
+		case 'Z':
+			if (!parseInteger("--compression-threads", optarg, 0, MAX_THREADS,
+					value))
+				return 1;
+			compression.threads = value;
+			break;
+		case 'I':
+			useIndex = true;
+			break;
+		case 'x':
+			extractedContainer = optarg;
+			break;
+		case 'S':
+			serverSocket = optarg;
+			break;
+		case 'j':
+			if (!parseInteger("--threads", optarg, 0, MAX_THREADS, value))
+				return 1;
+			serverThreads = value;
+			break;
+		case 'Q':
+			// In megabytes
+			if (!parseInteger("--query-cache", optarg, 0,
+					SIZE_MAX / (1024 * 1024), value))
+				return 1;
+			queryCacheSize = value * 1024 * 1024;
+			break;
+		case 'F':
+			pcfFile = optarg;
+			break;
+		case 'w':
+			rowFile = optarg;
+			break;
+		case 't':
+			timeUnit = optarg;
+			break;
+		case 'D':
+			if (!parseInteger("--time-precision", optarg, 0,
+					MAX_TIME_PRECISION, value))
+				return 1;
+			timePrecision = value;
+			break;
+		case 'A':
+			baselineFile = optarg;
+			break;
+		case 'y':
+			if (!parseInteger("--threshold", optarg, 0, LLONG_MAX,
+					compareThreshold))
+				return 1;
+			break;
+		case 'X':
+			selfTraceFile = optarg;
+			break;
+		case 'l': {
+			string levelName = optarg;
+			if (levelName == "thread")
+				level = LEVEL_THREAD;
+			else if (levelName == "task")
+				level = LEVEL_TASK;
+			else if (levelName == "node")
+				level = LEVEL_NODE;
+			else if (levelName == "app")
+				level = LEVEL_APPLICATION;
+			else {
+				cerr << "Error: unknown level " << levelName << endl;
+				return 1;
+			}
+			break;
+		}
+		case 'u': {
+			string modeName = optarg;
+			if (modeName == "dominant")
+				rollUpMode = ROLLUP_DOMINANT;
+			else if (modeName == "occupancy")
+				rollUpMode = ROLLUP_OCCUPANCY;
+			else {
+				cerr << "Error: unknown roll-up mode " << modeName << endl;
+				return 1;
+			}
+			break;
+		}
 		default: // '?'
 			printHelp();
-			return;
+			return 1;
 		}
 	}
 
 	if (optind < argc) {
-		inputFile = argv[optind];
+		inputFiles.assign(argv + optind, argv + argc);
+		inputFile = inputFiles.front();
 	} else {
-		cout
+		cerr
 				<< "Error: not enough arguments provided. You must provide at least one prv file."
 				<< endl << endl;
 		printHelp();
-		return;
+		return 1;
+	}
+
+	if (validateOnly) {
+		if (inputFile != STANDARD_STREAM && !exist(inputFile)) {
+			cerr << "Error: cannot open input file: " << inputFile << endl;
+			return 1;
+		}
+
+		ParaverParser parser(useEventForState);
+		bool valid = parser.validate(inputFile, maxReportedErrors);
+
+		cerr << (valid ? "The trace is valid" : "The trace is not valid")
+				<< endl;
+		return valid ? 0 : 2;
+	}
+
+	if (!timeUnit.empty() || timePrecision != EXACT_PRECISION) {
+		int unit;
+		if (!parseTimeUnit(timeUnit, unit)) {
+			cerr << "Error: the time unit must be s, ms, us or ns." << endl;
+			return 1;
+		}
+		timeFormat.setOutputUnit(unit, timePrecision);
+	}
+
+	if (useEventForState && pairEvents) {
+		cerr << "Error: --event-state and --event-pairs cannot be used together."
+				<< endl;
+		return 1;
+	}
+
+	// The nested states of the regions have no place in the roll-up
+	if (pairEvents && level != LEVEL_THREAD) {
+		cerr << "Error: --level and --event-pairs cannot be used together."
+				<< endl;
+		return 1;
+	}
+
+	// The thread states go to the roll-up without being filtered nor merged
+	if (level != LEVEL_THREAD && (coalesce || minDuration > 0)) {
+		cerr << "Error: --level cannot be used with "
+				<< (coalesce ? "--coalesce." : "--min-duration.") << endl;
+		return 1;
+	}
+
+	if (!selfTraceFile.empty())
+		SelfTrace::enable();
+
+	if (!baselineFile.empty())
+		return compare();
+
+	if (inputFiles.size() > 1 && !checkMergeOptions())
+		return 1;
+
+	if (find(inputFiles.begin(), inputFiles.end(), STANDARD_STREAM)
+			!= inputFiles.end() && !checkStreamOptions())
+		return 1;
+
+	// The extraction reads the records through the index
+	if (!extractedContainer.empty() && useRecordCache) {
+		cerr << "Error: --record-cache cannot be used with --container."
+				<< endl;
+		return 1;
 	}
 
+	if (!serverSocket.empty())
+		return serve();
+
+	TraceWriter * writer;
+	if (outputs.empty()) {
+		writer = createWriter(outputFormat, compression, timeFormat);
+		if (writer == nullptr) {
+			cerr << "Error: output format " << outputFormat
+					<< " is unknown or not available in this build." << endl;
+			return 1;
+		}
+	} else {
+		writer = createOutputs();
+		if (writer == nullptr)
+			return 1;
+	}
+
+	if (SelfTrace::isEnabled())
+		writer = new TracedWriter(writer);
+
 	if (handleFilenames() < 0) {
 		printHelp();
-		return;
+		return 1;
+	}
+
+	if (!extractedContainer.empty()) {
+		int result = extract(writer);
+		delete writer;
+		writeReports();
+		return result;
 	}
 
+	if (inputFiles.size() > 1) {
+		int result = merge(writer);
+		delete writer;
+		return result;
+	}
+
+	TraceIndex * index = nullptr;
+	if (useIndex)
+		index = new TraceIndex();
+
 	ParaverParser * parser = new ParaverParser(useEventForState);
-	parser->parse(inputFile, confFile, resourceFile, outputFile);
+	parser->setIndex(index);
+	parser->setUseRecordCache(useRecordCache);
+	if (!setUpParser(*parser, writer))
+		return 1;
+
+	bool converted = parser->parse(inputFile, confFile, resourceFile,
+			outputFile);
+
+	delete parser;
+	delete writer;
+	delete index;
+	writeReports();
 
-	cout << "End of conversion" << endl;
+	// The errors were reported by the parser
+	if (!converted)
+		return 1;
 
-	return;
+	cerr << "End of conversion" << endl;
+
+	return 0;
 }
 
 int Prv2Pjdump::handleFilenames() {
 
-	if (!exist(inputFile)) {
-		cout << "Error: cannot open input file: " << inputFile << endl;
+	if (findConfigFiles() < 0)
+		return -1;
+
+	string basename = inputFile.substr(0, inputFile.find(".prv"));
+
+	// A trace read from the standard input goes to the standard output
+	if (outputFile.empty() && inputFile == STANDARD_STREAM)
+		outputFile = STANDARD_STREAM;
+
+	if (outputFile.empty()) {
+		string extension = PJDUMP_FILE_EXTENSION;
+		if (outputFormat == SQLITE_OUTPUT_FORMAT)
+			extension = SQLITE_FILE_EXTENSION;
+		else if (outputFormat == PAJE_OUTPUT_FORMAT)
+			extension = PAJE_FILE_EXTENSION;
+
+		// Generate default name
+		outputFile = basename + extension;
+
+		// Check if there is already an existing file with this name
+		// and if so find the first name corresponding to a non-existing file
+		int i = 1;
+
+		while (exist(outputFile)) {
+			stringstream outputss;
+			outputss << basename << "_" << i << extension;
+			outputFile = outputss.str();
+			i++;
+		}
+
+		cerr << "Converted trace will be written in " << outputFile << endl;
+	}
+
+	return 0;
+}
+
+/**
+ * Find the .pcf and .row files next to the input file, unless they were given
+ * with --pcf and --row (the only way for the standard input)
+ */
+int Prv2Pjdump::findConfigFiles() {
+
+	if (inputFile != STANDARD_STREAM && !exist(inputFile)) {
+		cerr << "Error: cannot open input file: " << inputFile << endl;
 		return -1;
 	}
 
+	for (const string & file : { pcfFile, rowFile })
+		if (!file.empty() && !exist(file)) {
+			cerr << "Error: cannot open input file: " << file << endl;
+			return -1;
+		}
+
 	string basename = inputFile.substr(0, inputFile.find(".prv"));
 
 	string potentialConfFile = basename + PARAVER_CONF_FILE_EXTENSION;
-	if (exist(potentialConfFile)) {
+	if (!pcfFile.empty()) {
+		confFile = pcfFile;
+	} else if (inputFile != STANDARD_STREAM && exist(potentialConfFile)) {
 		confFile = potentialConfFile;
 	} else {
-		cout
+		cerr
 				<< "Warning: no configuration file could be found ("
-						+ potentialConfFile + ")." << endl
+						+ (inputFile == STANDARD_STREAM ?
+								"use --pcf" : potentialConfFile) + ")." << endl
 				<< "Parsing will be done with default values." << endl;
 	}
 
 	string potentialResFile = basename + PARAVER_RESOURCE_FILE_EXTENSION;
-	if (exist(potentialResFile)) {
+	if (!rowFile.empty()) {
+		resourceFile = rowFile;
+	} else if (inputFile != STANDARD_STREAM && exist(potentialResFile)) {
 		resourceFile = potentialResFile;
 	} else {
-		cout
+		cerr
 				<< "Warning: no resource file could be found ("
-						+ potentialResFile + ")." << endl
+						+ (inputFile == STANDARD_STREAM ?
+								"use --row" : potentialResFile) + ")." << endl
 				<< "Parsing will be done with default values." << endl;
 	}
 
-	if (outputFile.empty()) {
-		// Generate default name
-		outputFile = basename + PJDUMP_FILE_EXTENSION;
+	return 0;
+}
 
-		// Check if there is already an existing file with this name
-		// and if so find the first name corresponding to a non-existing file
-		int i = 1;
+/**
+ * Build the writer sending the converted trace to all the outputs given with
+ * --out
+ */
+TraceWriter * Prv2Pjdump::createOutputs() {
+	MultiWriter * writer = new MultiWriter();
 
-		while (exist(outputFile)) {
-			stringstream outputss;
-			outputss << basename << "_" << i << PJDUMP_FILE_EXTENSION;
-			outputFile = outputss.str();
-			i++;
+#ifdef _WIN32
+	if (sinkThreads)
+		cerr << "Warning: the outputs run on the main thread on Windows."
+				<< endl;
+#endif
+
+	for (string & output : outputs) {
+		string file, error;
+		TraceWriter * sink = createSink(output, file, error, compression,
+				timeFormat);
+		if (sink == nullptr) {
+			cerr << "Error: " << error << endl;
+			delete writer;
+			return nullptr;
+		}
+
+#ifndef _WIN32
+		if (sinkThreads)
+			sink = new AsyncWriter(sink);
+#endif
+
+		writer->addSink(sink, file);
+
+		// Used in the messages of the parser
+		outputFile += (outputFile.empty() ? "" : ", ") + file;
+	}
+
+	return writer;
+}
+
+/**
+ * Read the .pcf and .row files found by findConfigFiles
+ */
+shared_ptr<TraceConfig> Prv2Pjdump::loadConfig() {
+	shared_ptr<TraceConfig> config = make_shared<TraceConfig>();
+
+	if (!confFile.empty() && !loadPcf(confFile, *config, useConfigCache))
+		cerr << "Warning: could not read the configuration file " << confFile
+				<< endl;
+
+	if (!resourceFile.empty() && !loadRow(resourceFile, *config, useConfigCache))
+		cerr << "Warning: could not read the resource file " << resourceFile
+				<< endl;
+
+	return config;
+}
+
+/**
+ * Give the parser its writer and the optional stages of the conversion
+ * (histograms, reduction, coalescing, counters, event pairs, roll-up) chosen
+ * by the options
+ *
+ * @return false if the options of a stage are not valid
+ */
+bool Prv2Pjdump::setUpParser(ParaverParser & parser, TraceWriter * writer) {
+	parser.setWriter(writer);
+	parser.setSkipErrors(skipErrors);
+	parser.setUseConfigCache(useConfigCache);
+
+	if (useCounters) {
+		string error;
+		counters = new CounterSeries();
+		if (!counterMetrics.empty()
+				&& !counters->setMetrics(counterMetrics, error)) {
+			cerr << "Error: " << error << endl;
+			return false;
+		}
+		parser.setCounters(counters);
+	}
+
+	if (!histogramFile.empty()) {
+		statistics = new DurationStatistics(histogramPerContainer,
+				histogramTopCount);
+		parser.setStatistics(statistics);
+	}
+
+	reducer = new Reducer();
+	reducer->setMinDuration(minDuration);
+	reducer->setEventRate(eventRateCount, eventRateWindow);
+	reducer->setSampleInterval(sampleInterval);
+	reducer->setReservoirSize(reservoirSize);
+	if (reducer->isActive())
+		parser.setReducer(reducer);
+
+	if (coalesce) {
+		coalescer = new Coalescer();
+		coalescer->setTolerance(coalesceGap);
+		// Short states are merged into their neighbour instead of being dropped
+		coalescer->setAbsorbDuration(minDuration);
+		parser.setCoalescer(coalescer);
+	}
+
+	if (pairEvents) {
+		eventPairing = new EventPairing();
+		parser.setEventPairing(eventPairing);
+	}
+
+	if (level != LEVEL_THREAD) {
+		rollUp = new RollUp(rollUpMode, writer);
+		parser.setRollUp(rollUp, level);
+	}
+
+	return true;
+}
+
+/**
+ * Print the reports of the optional stages once the trace is converted,
+ * write the histograms, and delete the stages
+ */
+void Prv2Pjdump::writeReports() {
+	delete rollUp;
+	rollUp = nullptr;
+
+	if (counters != nullptr) {
+		counters->writeReport(cerr);
+		delete counters;
+		counters = nullptr;
+	}
+
+	if (eventPairing != nullptr) {
+		eventPairing->writeReport(cerr);
+		delete eventPairing;
+		eventPairing = nullptr;
+	}
+
+	if (coalescer != nullptr) {
+		cerr << "Coalesced states: " << coalescer->getMergedStates() << endl;
+		delete coalescer;
+		coalescer = nullptr;
+	}
+
+	if (reducer != nullptr && reducer->isActive())
+		reducer->writeReport(cerr);
+	delete reducer;
+	reducer = nullptr;
+
+	if (statistics != nullptr) {
+		ofstream report(histogramFile);
+		if (report.good()) {
+			statistics->writeReport(report);
+			cerr << "Duration histograms written in " << histogramFile << endl;
+		} else {
+			cerr << "Error: could not open histogram file " << histogramFile
+					<< endl;
+		}
+		delete statistics;
+		statistics = nullptr;
+	}
+}
+
+/**
+ * Convert the records of one container (or of several ones with 0 as a
+ * wildcard ID) by reading only the blocks of the trace holding them, as given
+ * by the index. The index is built by a scan of the trace if it was not
+ * written by a previous conversion, and saved with --index.
+ */
+int Prv2Pjdump::extract(TraceWriter * writer) {
+	int appID, taskID, threadID;
+	char end;
+	if (sscanf(extractedContainer.c_str(), "%d.%d.%d%c", &appID, &taskID,
+			&threadID, &end) != 3) {
+		cerr << "Error: expected --container APP.TASK.THREAD instead of "
+				<< extractedContainer << endl;
+		return 1;
+	}
+
+	TraceIndex index;
+	if (!index.load(inputFile)) {
+		cerr << "No up to date index of " << inputFile
+				<< ", the whole trace is scanned." << endl;
+		if (!index.build(inputFile, skipErrors))
+			return 1;
+
+		if (useIndex && !index.save(inputFile))
+			cerr << "Warning: could not write the index of " << inputFile
+					<< endl;
+	}
+
+	vector<int> containers = index.findContainers(appID, taskID, threadID);
+	if (containers.empty()) {
+		cerr << "Error: the trace has no record of THREAD " << extractedContainer
+				<< endl;
+		return 1;
+	}
+
+	shared_ptr<TraceConfig> config = loadConfig();
+	ParaverParser parser(useEventForState);
+	parser.setConfig(config);
+	if (!setUpParser(parser, writer))
+		return 1;
+	writer->setConfig(config);
+
+	if (!writer->open(outputFile)) {
+		cerr << "Error: could not open output file " << outputFile << endl;
+		return 1;
+	}
+
+	try {
+		parser.parseHeader(index.getHeader());
+	} catch (const exception & e) {
+		cerr << "Error: malformed header: " << index.getHeader() << endl;
+		writer->setIncomplete();
+		writer->close();
+		return 1;
+	}
+
+	unsigned long long records = 0;
+	index.forEachRecord(LLONG_MIN, LLONG_MAX, containers,
+			[&parser, &records](const PrvRecord & record) {
+				parser.parseRecord(record);
+				records++;
+			});
+	parser.finish();
+	writer->close();
+
+	cerr << "Extracted " << records << " records from "
+			<< index.findBlocks(LLONG_MIN, LLONG_MAX, containers).size()
+			<< " of the " << index.getBlockCount() << " blocks of the trace"
+			<< endl;
+	return 0;
+}
+
+/**
+ * The options keeping a state per container of the trace, or working on a
+ * single trace, are not available when several traces are merged
+ */
+bool Prv2Pjdump::checkMergeOptions() {
+	string option;
+	if (validateOnly)
+		option = "--validate";
+	else if (!serverSocket.empty())
+		option = "--serve";
+	else if (!extractedContainer.empty())
+		option = "--container";
+	else if (useIndex)
+		option = "--index";
+	else if (useRecordCache)
+		option = "--record-cache";
+	else if (pairEvents)
+		option = "--event-pairs";
+	else if (useCounters)
+		option = "--counters";
+	else if (level != LEVEL_THREAD)
+		option = "--level";
+	else if (coalesce)
+		option = "--coalesce";
+	else if (!histogramFile.empty())
+		option = "--histogram";
+	else if (minDuration > 0 || eventRateCount > 0 || sampleInterval > 0
+			|| reservoirSize > 0)
+		option = "the reduction options";
+
+	if (!option.empty()) {
+		cerr << "Error: " << option
+				<< " cannot be used when several traces are merged." << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * The options reading the trace file again, or writing files next to it, are
+ * not available for the standard input
+ */
+bool Prv2Pjdump::checkStreamOptions() {
+	string option;
+	if (!serverSocket.empty())
+		option = "--serve";
+	else if (!extractedContainer.empty())
+		option = "--container";
+	else if (useIndex)
+		option = "--index";
+	else if (useRecordCache)
+		option = "--record-cache";
+
+	if (!option.empty()) {
+		cerr << "Error: " << option
+				<< " cannot be used when the trace is read from the standard input."
+				<< endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Convert several traces into one output. The containers of each trace are
+ * prefixed with the name of its file (without the directory and the .prv
+ * extension), and the names of the .pcf files are gathered for the outputs
+ * using them.
+ */
+int Prv2Pjdump::merge(TraceWriter * writer) {
+	TraceMerger merger(writer);
+	shared_ptr<TraceConfig> names = make_shared<TraceConfig>();
+	set<string> labels;
+
+	for (size_t i = 0; i < inputFiles.size(); i++) {
+		// The configuration files of the first trace were found with the
+		// output file name
+		if (i > 0) {
+			inputFile = inputFiles[i];
+			confFile = "";
+			resourceFile = "";
+			if (findConfigFiles() < 0)
+				return 1;
+		}
+
+		shared_ptr<TraceConfig> config = loadConfig();
+		names->stateNames.insert(config->stateNames.begin(),
+				config->stateNames.end());
+		names->stateColors.insert(config->stateColors.begin(),
+				config->stateColors.end());
+		names->eventNames.insert(config->eventNames.begin(),
+				config->eventNames.end());
+		names->eventTypes.insert(config->eventTypes.begin(),
+				config->eventTypes.end());
+
+		string label = (inputFile == STANDARD_STREAM) ?
+				"stdin" : inputFile.substr(inputFile.find_last_of("/\\") + 1);
+		label = label.substr(0, label.find(PARAVER_FILE_EXTENSION));
+		replace(label.begin(), label.end(), PJDUMP_SEPARATOR, '_');
+		if (!labels.insert(label).second) {
+			label += "_" + to_string(i + 1);
+			labels.insert(label);
+		}
+
+		ParaverParser * parser = new ParaverParser(useEventForState);
+		parser->setConfig(config);
+		parser->setWriter(writer);
+		parser->setContainerPrefix(label + MERGE_PREFIX_SEPARATOR);
+		merger.addInput(inputFile, parser, skipErrors);
+	}
+
+	writer->setConfig(names);
+	if (!merger.merge(outputFile))
+		return 1;
+
+	cerr << "Merged " << inputFiles.size() << " traces" << endl;
+	cerr << "End of conversion" << endl;
+	return 0;
+}
+
+/**
+ * Only the options applying to each trace separately are available with
+ * --compare
+ */
+bool Prv2Pjdump::checkCompareOptions() {
+	string option;
+	if (inputFiles.size() > 1)
+		option = "several traces";
+	else if (inputFile == STANDARD_STREAM && baselineFile == STANDARD_STREAM)
+		option = "the standard input for both traces";
+	else if (!serverSocket.empty())
+		option = "--serve";
+	else if (!extractedContainer.empty())
+		option = "--container";
+	else if (useIndex)
+		option = "--index";
+	else if (!outputs.empty())
+		option = "--out";
+	else if (outputFormat != PJDUMP_OUTPUT_FORMAT)
+		option = "--format";
+	else if (useCounters)
+		option = "--counters";
+	else if (level != LEVEL_THREAD)
+		option = "--level";
+	else if (coalesce)
+		option = "--coalesce";
+	else if (!histogramFile.empty())
+		option = "--histogram";
+	else if (minDuration > 0 || eventRateCount > 0 || sampleInterval > 0
+			|| reservoirSize > 0)
+		option = "the reduction options";
+
+	if (!option.empty()) {
+		cerr << "Error: " << option << " cannot be used with --compare."
+				<< endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Convert the candidate trace (FILE) and the baseline trace (--compare) at
+ * the same time, each one on its own thread (one after the other on
+ * Windows), and write their differences instead of a converted trace: in the
+ * output file if one is given, on the standard output otherwise
+ */
+int Prv2Pjdump::compare() {
+	if (!checkCompareOptions())
+		return 1;
+
+	if ((inputFile == STANDARD_STREAM || baselineFile == STANDARD_STREAM)
+			&& !checkStreamOptions())
+		return 1;
+
+	string candidateFile = inputFile;
+	string traces[2] = { baselineFile, candidateFile };
+	string configFiles[2][2];
+	for (int i = 0; i < 2; i++) {
+		inputFile = traces[i];
+		confFile = "";
+		resourceFile = "";
+		if (findConfigFiles() < 0)
+			return 1;
+		configFiles[i][0] = confFile;
+		configFiles[i][1] = resourceFile;
+	}
+
+	TraceComparison comparison;
+	ComparisonWriter * writers[2] = { comparison.getBaseWriter(),
+			comparison.getCandidateWriter() };
+	ParaverParser * parsers[2];
+	EventPairing * eventPairings[2] = { nullptr, nullptr };
+
+	for (int i = 0; i < 2; i++) {
+		parsers[i] = new ParaverParser(useEventForState);
+		parsers[i]->setWriter(writers[i]);
+		parsers[i]->setSkipErrors(skipErrors);
+		parsers[i]->setUseConfigCache(useConfigCache);
+		parsers[i]->setUseRecordCache(useRecordCache);
+		if (pairEvents) {
+			eventPairings[i] = new EventPairing();
+			parsers[i]->setEventPairing(eventPairings[i]);
 		}
+	}
+
+	bool converted[2] = { false, false };
+	auto convert = [&](int i) {
+		converted[i] = parsers[i]->parse(traces[i], configFiles[i][0],
+				configFiles[i][1], "");
+	};
 
-		cout << "Converted trace will be written in " << outputFile << endl;
+#ifndef _WIN32
+	thread baseline([&convert] {
+		SelfTrace::setThreadName("baseline");
+		convert(0);
+	});
+	convert(1);
+	baseline.join();
+#else
+	convert(0);
+	convert(1);
+#endif
+
+	for (int i = 0; i < 2; i++) {
+		delete parsers[i];
+		delete eventPairings[i];
 	}
 
+	// No report of a partial comparison
+	if (!converted[0] || !converted[1])
+		return 1;
+
+	unsigned long long differences;
+	if (outputFile.empty() || outputFile == STANDARD_STREAM)
+		differences = comparison.writeReport(cout, compareThreshold,
+				timeFormat);
+	else {
+		ofstream report(outputFile);
+		if (!report.good()) {
+			cerr << "Error: could not open output file " << outputFile << endl;
+			return 1;
+		}
+		differences = comparison.writeReport(report, compareThreshold,
+				timeFormat);
+	}
+
+	cerr << differences << " differences between " << baselineFile << " and "
+			<< candidateFile << endl;
 	return 0;
 }
 
+/**
+ * Write the stages of the threads of the conversion, recorded with
+ * --self-trace
+ */
+void Prv2Pjdump::writeSelfTrace() {
+	if (!SelfTrace::isEnabled())
+		return;
+
+	if (SelfTrace::write(selfTraceFile))
+		cerr << "Self trace written in " << selfTraceFile << endl;
+	else
+		cerr << "Error: could not write the self trace in " << selfTraceFile
+				<< endl;
+}
+
+/**
+ * Index the trace and answer the queries received on the server socket
+ */
+int Prv2Pjdump::serve() {
+#ifdef _WIN32
+	cerr << "Error: the query server is not available on Windows." << endl;
+	return 1;
+#else
+	if (findConfigFiles() < 0)
+		return 1;
+
+	shared_ptr<TraceConfig> config = loadConfig();
+
+	// Use the index written by a previous conversion if it is up to date
+	TraceIndex index;
+	if (!index.load(inputFile) && !index.build(inputFile, skipErrors))
+		return 1;
+
+	cerr << "Indexed " << index.getRecordCount() << " records ("
+			<< index.getBlockCount() << " blocks, "
+			<< index.getContainerCount() << " threads)" << endl;
+	if (index.getSkippedRecords() > 0)
+		cerr << "Warning: " << index.getSkippedRecords()
+				<< " malformed records were skipped." << endl;
+
+	unsigned int threads = serverThreads;
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+
+	QueryServer server(index, config, useEventForState, threads,
+			queryCacheSize);
+	return server.run(serverSocket) ? 0 : 1;
+#endif
+}
+
 void printHelp() {
-	cout << "Usage: prv2pjdump [OPTION] FILE" << endl;
-	cout << "Convert the paraver FILE into pjdump." << endl << endl;
-	cout << "\t -o, --output-file \tSpecify an output file." << endl;
+	cout << "Usage: prv2pjdump [OPTION] FILE..." << endl;
+	cout << "Convert the paraver FILE (- for the standard input) into pjdump." << endl;
+	cout << "Several FILEs are merged by time into one output, their containers being prefixed with the file names."
+			<< endl << endl;
+	cout << "\t -o, --output-file \tSpecify an output file (- for the standard output, the default when FILE is -)."
+			<< endl;
 	cout << "\t -e, --event-state \tUse paraver events to build pjdump states."
 			<< endl;
+	cout << "\t -p, --event-pairs \tBuild nested states from the begin/end events of the types having values in the .pcf file."
+			<< endl;
+	cout << "\t -P, --counters \tWrite the hardware counters (event types 42xxxxxx) as variables instead of events."
+			<< endl;
+	cout << "\t -M, --counter-metrics LIST \tAlso write metrics derived from the counters: delta, rate, ipc or ipc=INS/CYC (implies -P)."
+			<< endl;
+	cout << "\t -f, --format FORMAT \tOutput format: pjdump (default), paje or sqlite."
+			<< endl;
+	cout << "\t -O, --out TYPE:FILE \tAdd an output produced during the same pass (pjdump, paje, sqlite, summary, matrix,"
+			<< endl
+			<< "\t\t\t\tfilter(task=A..B,thread=A..B,time=A..B) or image(WIDTH) for a .png/.ppm timeline); replaces -o and -f."
+			<< endl;
+	cout << "\t -T, --sink-threads \tRun each output of --out on its own thread." << endl;
+	cout << "\t -z, --compression-level N \tLevel of the .gz and .zst outputs (default: gzip 6, zstd 3)."
+			<< endl;
+	cout << "\t -b, --block-size KB \tSize of the blocks compressed independently (default 4096)."
+			<< endl;
+	cout << "\t -Z, --compression-threads N \tNumber of compression threads (default: one per core)."
+			<< endl;
+	cout << "\t -t, --time-unit UNIT \tWrite the times of the pjdump and Paje outputs in s, ms, us or ns."
+			<< endl;
+	cout << "\t -D, --time-precision N \tNumber of decimals of the converted times (default: all the digits of the trace)."
+			<< endl;
+	cout << "\t -H, --histogram FILE \tWrite state duration and link latency histograms in FILE."
+			<< endl;
+	cout << "\t -C, --histogram-containers \tAlso build the state histograms per container."
+			<< endl;
+	cout << "\t -k, --top K \tNumber of longest states and links reported in the histogram file (default 10)."
+			<< endl;
+	cout << "\t -V, --validate \tOnly check the trace (malformed records, unsorted timestamps, undeclared objects)."
+			<< endl;
+	cout << "\t -m, --max-errors N \tNumber of problems printed by --validate (default 100)."
+			<< endl;
+	cout << "\t -s, --skip-errors \tSkip the malformed records instead of stopping the conversion."
+			<< endl;
+	cout << "\t -d, --min-duration D \tDrop the states shorter than D." << endl;
+	cout << "\t -r, --event-rate N/W \tKeep at most N events of each type per time window W."
+			<< endl;
+	cout << "\t -n, --sample N \tKeep one event out of N per container." << endl;
+	cout << "\t -R, --reservoir K \tKeep K randomly chosen events per container."
+			<< endl;
+	cout << "\t -c, --coalesce \tMerge the consecutive states of a container having the same name."
+			<< endl;
+	cout << "\t -g, --coalesce-gap G \tMerge states separated by at most G (default 0)."
+			<< endl;
+	cout << "\t -I, --index \tWrite the index of the records by container in FILE.idx during the conversion."
+			<< endl;
+	cout << "\t -x, --container A.T.TH \tOnly convert the records of a thread (0 matches any ID), reading the blocks given by the index."
+			<< endl;
+	cout << "\t -K, --config-cache \tRead the .pcf and .row files from (or save them in) a binary cache."
+			<< endl;
+	cout << "\t -B, --record-cache \tRead the parsed records from (or save them in) a binary cache of the trace."
+			<< endl;
+	cout << "\t -l, --level LEVEL \tContainer level of the output: thread (default), task, node or app."
+			<< endl;
+	cout << "\t -u, --rollup MODE \tAggregation of the thread states at the task, node or app level:"
+			<< endl
+			<< "\t\t\t\tdominant (default) or occupancy." << endl;
+	cout << "\t -S, --serve SOCKET \tIndex the trace and answer queries on the Unix socket SOCKET."
+			<< endl;
+	cout << "\t -j, --threads N \tNumber of threads answering the queries (default: one per core)."
+			<< endl;
+	cout << "\t -Q, --query-cache MB \tSize of the cache of query results (default 64)."
+			<< endl;
+	cout << "\t -F, --pcf FILE \tConfiguration file of the trace (default: next to FILE)."
+			<< endl;
+	cout << "\t -w, --row FILE \tResource file of the trace (default: next to FILE)."
+			<< endl;
+	cout << "\t -A, --compare BASE \tCompare FILE with the baseline trace BASE: write the differences of time per state"
+			<< endl
+			<< "\t\t\t\tand of number of events per container, instead of converting FILE."
+			<< endl;
+	cout << "\t -y, --threshold T \tOnly write the differences of --compare larger than T (time or count, default 0)."
+			<< endl;
+	cout << "\t -X, --self-trace FILE \tRecord the stages of each thread of the converter, written in FILE in pjdump"
+			<< endl
+			<< "\t\t\t\t(or as a Paraver trace if FILE ends with .prv)." << endl;
+}
+
+/**
+ * Read the value of a numeric option: the whole text must be an integer
+ * between minimum and maximum
+ *
+ * @return false if it is not (the error is printed)
+ */
+bool parseInteger(const string & option, const char * text, long long minimum,
+		long long maximum, long long & value) {
+	char * end;
+	errno = 0;
+	long long parsed = strtoll(text, &end, 10);
+
+	if (end == text || *end != '\0' || isspace((unsigned char) *text)
+			|| errno == ERANGE || parsed < minimum || parsed > maximum) {
+		cerr << "Error: invalid value " << text << " for " << option;
+		if (maximum < LLONG_MAX)
+			cerr << " (expected an integer between " << minimum << " and "
+					<< maximum << ")";
+		else
+			cerr << " (expected an integer of at least " << minimum << ")";
+		cerr << endl;
+		return false;
+	}
+
+	value = parsed;
+	return true;
 }
 
 /**
@@ -0,0 +1,480 @@
+/*
+ * queryServer.cpp
+ *
+ *  Answer queries on an indexed trace through a Unix domain socket.
+ */
+
+#include "include/queryServer.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "include/paraverParser.h"
+#include "include/sinks.h"
+
+const string WINDOW_QUERY = "window";
+const string SUMMARY_QUERY = "summary";
+const string INFO_QUERY = "info";
+
+const string PJDUMP_RESULT = "pjdump";
+const string BINARY_RESULT = "binary";
+
+const string THREADS_PARAMETER = "threads=";
+const string FORMAT_PARAMETER = "format=";
+
+// Maximum length of a request line
+const size_t MAX_REQUEST_LENGTH = 64 * 1024;
+
+// Set by the signal handler and read by the worker threads: a lock-free
+// atomic is both safe in a handler and free of data races
+static_assert(ATOMIC_BOOL_LOCK_FREE == 2,
+		"the stop flag must be a lock-free atomic");
+static atomic<bool> stopRequested(false);
+
+static void requestStop(int) {
+	stopRequested = true;
+}
+
+/**
+ * Send the whole buffer, retrying on partial writes
+ */
+static bool sendAll(int connection, const char * data, size_t size) {
+	while (size > 0) {
+		ssize_t sent = send(connection, data, size, 0);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+QueryCache::QueryCache(size_t capacity) {
+	this->capacity = capacity;
+}
+
+shared_ptr<const string> QueryCache::get(const string & key) {
+	lock_guard<mutex> guard(lock);
+
+	auto it = positions.find(key);
+	if (it == positions.end())
+		return nullptr;
+
+	// Move the entry to the front (most recently used)
+	entries.splice(entries.begin(), entries, it->second);
+	return it->second->second;
+}
+
+void QueryCache::put(const string & key, shared_ptr<const string> result) {
+	if (result->size() > capacity)
+		return;
+
+	lock_guard<mutex> guard(lock);
+
+	if (positions.find(key) != positions.end())
+		return;
+
+	entries.emplace_front(key, result);
+	positions[key] = entries.begin();
+	size += result->size();
+
+	while (size > capacity) {
+		size -= entries.back().second->size();
+		positions.erase(entries.back().first);
+		entries.pop_back();
+	}
+}
+
+QueryServer::QueryServer(const TraceIndex & index,
+		shared_ptr<const TraceConfig> config, bool useEventForState,
+		unsigned int threadCount, size_t cacheSize) :
+		index(index), cache(cacheSize) {
+	this->config = config;
+	this->useEventForState = useEventForState;
+	this->threadCount = max(threadCount, 1u);
+}
+
+bool QueryServer::run(const string & socketPath) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		cerr << "Error: socket path too long: " << socketPath << endl;
+		return false;
+	}
+	strcpy(address.sun_path, socketPath.c_str());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		cerr << "Error: could not create socket: " << strerror(errno) << endl;
+		return false;
+	}
+
+	// Remove the socket left by a previous server
+	unlink(socketPath.c_str());
+
+	if (bind(listener, (sockaddr *) &address, sizeof(address)) != 0
+			|| listen(listener, SOMAXCONN) != 0) {
+		cerr << "Error: could not listen on " << socketPath << ": "
+				<< strerror(errno) << endl;
+		::close(listener);
+		return false;
+	}
+
+	// accept() must be interrupted by the signals to stop the server
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = requestStop;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	// The signals are only delivered to this thread (the workers inherit the
+	// blocked mask)
+	sigset_t stopSignals;
+	sigemptyset(&stopSignals);
+	sigaddset(&stopSignals, SIGINT);
+	sigaddset(&stopSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+	vector<thread> workers;
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.push_back(thread(&QueryServer::work, this));
+
+	pthread_sigmask(SIG_UNBLOCK, &stopSignals, nullptr);
+
+	cerr << "Listening on " << socketPath << " with " << threadCount
+			<< " threads" << endl;
+
+	while (!stopRequested) {
+		int connection = accept(listener, nullptr, nullptr);
+		if (connection < 0) {
+			if (errno != EINTR)
+				cerr << "Error: accept failed: " << strerror(errno) << endl;
+			continue;
+		}
+
+		lock_guard<mutex> guard(connectionLock);
+		connections.push(connection);
+		connectionReady.notify_one();
+	}
+
+	::close(listener);
+	unlink(socketPath.c_str());
+
+	{
+		lock_guard<mutex> guard(connectionLock);
+		// Wake up the threads waiting for a request
+		for (int connection : activeConnections)
+			shutdown(connection, SHUT_RD);
+		for (unsigned int i = 0; i < threadCount; i++)
+			connections.push(-1);
+		connectionReady.notify_all();
+	}
+
+	for (thread & worker : workers)
+		worker.join();
+
+	// Connections that were never served
+	while (!connections.empty()) {
+		if (connections.front() >= 0)
+			::close(connections.front());
+		connections.pop();
+	}
+
+	cerr << "Server stopped" << endl;
+	return true;
+}
+
+void QueryServer::work() {
+	while (true) {
+		int connection;
+		{
+			unique_lock<mutex> guard(connectionLock);
+			connectionReady.wait(guard, [this] {
+				return !connections.empty();
+			});
+			connection = connections.front();
+			connections.pop();
+
+			if (connection < 0)
+				return;
+			activeConnections.insert(connection);
+		}
+
+		// The connections accepted before a stop are not served
+		if (!stopRequested)
+			serveConnection(connection);
+
+		lock_guard<mutex> guard(connectionLock);
+		activeConnections.erase(connection);
+		::close(connection);
+	}
+}
+
+/**
+ * Answer the requests of a connection (one per line) until the client
+ * closes it. Each answer is "OK size" followed by size bytes of result, or
+ * "ERROR message".
+ */
+void QueryServer::serveConnection(int connection) {
+	string pending;
+	char buffer[4096];
+
+	while (true) {
+		ssize_t received = recv(connection, buffer, sizeof(buffer), 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return;
+
+		pending.append(buffer, received);
+
+		size_t newline;
+		while ((newline = pending.find('\n')) != string::npos) {
+			string request = pending.substr(0, newline);
+			pending.erase(0, newline + 1);
+
+			if (request.find_first_not_of(" \t\r") == string::npos)
+				continue;
+
+			string error;
+			shared_ptr<const string> result = answer(request, error);
+
+			string status = (result == nullptr) ?
+					"ERROR " + error + "\n" :
+					"OK " + to_string(result->size()) + "\n";
+
+			if (!sendAll(connection, status.data(), status.size()))
+				return;
+			if (result != nullptr
+					&& !sendAll(connection, result->data(), result->size()))
+				return;
+		}
+
+		if (pending.size() > MAX_REQUEST_LENGTH) {
+			string status = "ERROR request too long\n";
+			sendAll(connection, status.data(), status.size());
+			return;
+		}
+	}
+}
+
+shared_ptr<const string> QueryServer::answer(const string & request,
+		string & error) {
+	Query query;
+	if (!parseQuery(request, query, error))
+		return nullptr;
+
+	// Normalized form of the query
+	stringstream key;
+	key << query.command << " " << query.start << " " << query.end << " "
+			<< query.format;
+	for (int container : query.containers)
+		key << " " << container;
+
+	shared_ptr<const string> result = cache.get(key.str());
+	if (result != nullptr)
+		return result;
+
+	if (query.command == WINDOW_QUERY)
+		result = make_shared<const string>(runWindow(query));
+	else if (query.command == SUMMARY_QUERY)
+		result = make_shared<const string>(runSummary(query));
+	else
+		result = make_shared<const string>(runInfo());
+
+	cache.put(key.str(), result);
+	return result;
+}
+
+bool QueryServer::parseQuery(const string & request, Query & query,
+		string & error) {
+	stringstream words(request);
+	words >> query.command;
+
+	if (query.command == INFO_QUERY)
+		return true;
+
+	if (query.command != WINDOW_QUERY && query.command != SUMMARY_QUERY) {
+		error = "unknown query " + query.command;
+		return false;
+	}
+
+	string start, end;
+	words >> start >> end;
+	try {
+		size_t used;
+		query.start = stoll(start, &used);
+		if (used != start.size())
+			throw invalid_argument(start);
+		query.end = stoll(end, &used);
+		if (used != end.size())
+			throw invalid_argument(end);
+	} catch (const exception & e) {
+		error = "expected: " + query.command + " START END";
+		return false;
+	}
+
+	if (query.command == WINDOW_QUERY)
+		query.format = PJDUMP_RESULT;
+
+	string word;
+	while (words >> word) {
+		if (word.compare(0, FORMAT_PARAMETER.size(), FORMAT_PARAMETER) == 0
+				&& query.command == WINDOW_QUERY) {
+			query.format = word.substr(FORMAT_PARAMETER.size());
+			if (query.format != PJDUMP_RESULT && query.format != BINARY_RESULT) {
+				error = "unknown format " + query.format;
+				return false;
+			}
+		} else if (word.compare(0, THREADS_PARAMETER.size(),
+				THREADS_PARAMETER) == 0) {
+			stringstream selectors(word.substr(THREADS_PARAMETER.size()));
+			string selector;
+
+			while (getline(selectors, selector, ',')) {
+				// app.task.thread, app.task or app
+				int ids[3] = { 0, 0, 0 };
+				stringstream parts(selector);
+				string part;
+				int count = 0;
+				try {
+					while (getline(parts, part, '.') && count < 3)
+						ids[count++] = stoi(part);
+				} catch (const exception & e) {
+					count = 0;
+				}
+
+				vector<int> found;
+				if (count > 0)
+					found = index.findContainers(ids[0], ids[1], ids[2]);
+				if (found.empty()) {
+					error = "no thread matches " + selector;
+					return false;
+				}
+				query.containers.insert(query.containers.end(), found.begin(),
+						found.end());
+			}
+		} else {
+			error = "unknown parameter " + word;
+			return false;
+		}
+	}
+
+	sort(query.containers.begin(), query.containers.end());
+	query.containers.erase(
+			unique(query.containers.begin(), query.containers.end()),
+			query.containers.end());
+	return true;
+}
+
+string QueryServer::runWindow(const Query & query) {
+	if (query.format == BINARY_RESULT) {
+		string result;
+
+		index.forEachRecord(query.start, query.end, query.containers,
+				[this, &result](const PrvRecord & record) {
+			QueryRecord packed;
+			packed.category = record.category;
+			packed.container = index.getContainerIndex(record.appID,
+					record.taskID, record.threadID);
+			packed.receiver = -1;
+			packed.start = record.time;
+			packed.end = record.endTime;
+			packed.type = record.stateType;
+			packed.value = 0;
+
+			if (record.category == LINK_CATEGORY) {
+				packed.receiver = index.getContainerIndex(record.appIDReceive,
+						record.taskIDReceive, record.threadIDReceive);
+				packed.type = record.tag;
+				packed.value = record.size;
+			}
+
+			if (record.category != EVENT_CATEGORY) {
+				result.append((const char *) &packed, sizeof(packed));
+				return;
+			}
+
+			packed.end = record.time;
+			for (auto & param : record.params) {
+				packed.type = param.first;
+				packed.value = param.second;
+				result.append((const char *) &packed, sizeof(packed));
+			}
+		});
+
+		return result;
+	}
+
+	stringstream output;
+	PjdumpWriter writer(output);
+	ParaverParser parser(useEventForState);
+	parser.setConfig(config);
+	parser.setWriter(&writer);
+
+	writer.open("");
+	parser.parseHeader(index.getHeader());
+	index.forEachRecord(query.start, query.end, query.containers,
+			[&parser](const PrvRecord & record) {
+		parser.parseRecord(record);
+	});
+	writer.close();
+
+	return output.str();
+}
+
+string QueryServer::runSummary(const Query & query) {
+	SummaryWriter writer;
+	writer.setWindow(query.start, query.end);
+	ParaverParser parser(false);
+	parser.setConfig(config);
+	parser.setWriter(&writer);
+
+	parser.parseHeader(index.getHeader());
+	index.forEachRecord(query.start, query.end, query.containers,
+			[&parser](const PrvRecord & record) {
+		if (record.category == STATE_CATEGORY)
+			parser.parseRecord(record);
+	});
+
+	stringstream report;
+	writer.writeReport(report);
+	return report.str();
+}
+
+/**
+ * Header, records and threads of the trace. The threads are listed with the
+ * dense index used by the binary results.
+ */
+string QueryServer::runInfo() {
+	stringstream info;
+	info << "Header" << PJDUMP_SEPARATOR << index.getHeader() << endl;
+	info << "Records" << PJDUMP_SEPARATOR << index.getRecordCount() << endl;
+	info << "Blocks" << PJDUMP_SEPARATOR << index.getBlockCount() << endl;
+
+	for (unsigned int i = 0; i < index.getContainerCount(); i++) {
+		const tuple<int, int, int> & container = index.getContainer(i);
+		info << "Thread" << PJDUMP_SEPARATOR << i << PJDUMP_SEPARATOR
+				<< get<0>(container) << "." << get<1>(container) << "."
+				<< get<2>(container) << endl;
+	}
+
+	return info.str();
+}
+
+#endif /* _WIN32 */
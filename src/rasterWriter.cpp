@@ -0,0 +1,384 @@
+/*
+ * rasterWriter.cpp
+ *
+ *  Timeline image of the states, rendered while the trace is converted.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "include/rasterWriter.h"
+
+#ifndef _WIN32
+#include <thread>
+#endif
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+// Minimum number of partial pixels of a row before they are merged, per
+// column
+const unsigned int PARTIALS_PER_COLUMN = 4;
+
+static bool isPng(const string & outputFile) {
+	return outputFile.size() >= PNG_EXTENSION.size()
+			&& outputFile.compare(outputFile.size() - PNG_EXTENSION.size(),
+					PNG_EXTENSION.size(), PNG_EXTENSION) == 0;
+}
+
+RasterWriter::RasterWriter(unsigned int width) {
+	this->width = max(1u, width);
+}
+
+void RasterWriter::setConfig(shared_ptr<const TraceConfig> config) {
+	this->config = config;
+}
+
+bool RasterWriter::open(const string & outputFile) {
+	this->outputFile = outputFile;
+
+#ifndef WITH_ZLIB
+	if (isPng(outputFile)) {
+		cerr << "Error: PNG output is not available in this build, use a .ppm file."
+				<< endl;
+		return false;
+	}
+#endif
+
+	if (outputFile == STANDARD_STREAM)
+		return true;
+
+	// Check that the file can be written before the conversion
+	FILE * image = fopen(outputFile.c_str(), "wb");
+	if (image == nullptr)
+		return false;
+	fclose(image);
+	return true;
+}
+
+RasterRow & RasterWriter::getRow(const string & name) {
+	auto it = rowIndexes.find(name);
+	if (it != rowIndexes.end())
+		return rows[it->second];
+
+	rowIndexes[name] = rows.size();
+	rows.push_back(RasterRow());
+	rows.back().name = name;
+	return rows.back();
+}
+
+/**
+ * Number of a state, with its color from the .pcf file if it has one
+ */
+unsigned short RasterWriter::getState(const string & name) {
+	auto it = stateIndexes.find(name);
+	if (it != stateIndexes.end())
+		return it->second;
+
+	unsigned short number = stateColors.size();
+	stateIndexes[name] = number;
+	stateColors.push_back(stateColor(config.get(), name, number));
+	return number;
+}
+
+long long RasterWriter::bucketStart(unsigned int column) const {
+	return (long long) ((long double) duration * column / width);
+}
+
+/**
+ * Column whose bucket holds a time of [0, duration)
+ */
+unsigned int RasterWriter::columnOf(long long time) const {
+	long double position = (long double) time * width / duration;
+	unsigned int column = position < width ? (unsigned int) position : width - 1;
+
+	// Fix the rounding of the division
+	while (column + 1 < width && bucketStart(column + 1) <= time)
+		column++;
+	while (column > 0 && bucketStart(column) > time)
+		column--;
+	return column;
+}
+
+void RasterWriter::writeContainer(const string & parent, const string & name,
+		const string &, long long, long long end) {
+	duration = max(duration, end);
+	getRow(parent).hasChildren = true;
+	getRow(name);
+}
+
+void RasterWriter::writeState(State & state) {
+	long long start = max(state.getTimeStamp(), 0LL);
+	long long end = min(state.getEndDate(), duration);
+	if (end <= start)
+		return;
+
+	unsigned short number = getState(state.getName());
+	RasterRow & row = getRow(state.getContainer());
+	if (row.pixels.empty()) {
+		row.pixels.resize(width, 0);
+		row.partialLimit = (size_t) PARTIALS_PER_COLUMN * width;
+	}
+
+	unsigned int first = columnOf(start);
+	unsigned int last = columnOf(end - 1);
+
+	for (unsigned int column = first; column <= last; column++) {
+		long long bucketBegin = bucketStart(column);
+		long long bucketEnd =
+				(column + 1 < width) ? bucketStart(column + 1) : duration;
+
+		// The columns inside the state are fully covered
+		if ((column > first || start <= bucketBegin)
+				&& (column < last || end >= bucketEnd)) {
+			row.pixels[column] = number + 1;
+			continue;
+		}
+
+		long long covered = min(end, bucketEnd) - max(start, bucketBegin);
+		if (!row.partials.empty() && row.partials.back().column == column
+				&& row.partials.back().state == number)
+			row.partials.back().duration += covered;
+		else
+			row.partials.push_back( { column, number, covered });
+	}
+
+	// Merge the time of each state per column, the next merge waiting for
+	// twice as many partial pixels as are left
+	if (row.partials.size() > row.partialLimit) {
+		sort(row.partials.begin(), row.partials.end(),
+				[](const PartialPixel & a, const PartialPixel & b) {
+					return a.column < b.column
+							|| (a.column == b.column && a.state < b.state);
+				});
+
+		vector<PartialPixel> merged;
+		for (const PartialPixel & partial : row.partials)
+			if (!merged.empty() && merged.back().column == partial.column
+					&& merged.back().state == partial.state)
+				merged.back().duration += partial.duration;
+			else
+				merged.push_back(partial);
+		row.partials.swap(merged);
+		row.partialLimit = max(row.partialLimit, 2 * row.partials.size());
+	}
+}
+
+void RasterWriter::writeEvent(Event &) {
+}
+
+void RasterWriter::writeLink(Link &) {
+}
+
+void RasterWriter::writeVariable(const string &, const string &, long long,
+		long long, double) {
+}
+
+/**
+ * RGB pixels of a row: the state fully covering a column, or the state
+ * taking the most time in it
+ */
+void RasterWriter::rasterize(const RasterRow & row,
+		vector<unsigned char> & line) const {
+	vector<unsigned int> colors(width, RASTER_BACKGROUND);
+	vector<long long> best(width, 0);
+
+	// Time of each state per column
+	vector<PartialPixel> partials = row.partials;
+	sort(partials.begin(), partials.end(),
+			[](const PartialPixel & a, const PartialPixel & b) {
+				return a.column < b.column
+						|| (a.column == b.column && a.state < b.state);
+			});
+
+	for (size_t i = 0; i < partials.size();) {
+		unsigned int column = partials[i].column;
+		unsigned short state = partials[i].state;
+		long long total = 0;
+		for (; i < partials.size() && partials[i].column == column
+				&& partials[i].state == state; i++)
+			total += partials[i].duration;
+
+		if (total > best[column]) {
+			best[column] = total;
+			colors[column] = stateColors[state];
+		}
+	}
+
+	for (unsigned int column = 0; column < row.pixels.size(); column++)
+		if (row.pixels[column] != 0)
+			colors[column] = stateColors[row.pixels[column] - 1];
+
+	line.resize(3 * width);
+	for (unsigned int column = 0; column < width; column++) {
+		line[3 * column] = colors[column] >> 16;
+		line[3 * column + 1] = (colors[column] >> 8) & 0xff;
+		line[3 * column + 2] = colors[column] & 0xff;
+	}
+}
+
+void RasterWriter::rasterizeBand(const vector<const RasterRow *> & band,
+		vector<vector<unsigned char>> & lines) const {
+	lines.resize(band.size());
+
+#ifndef _WIN32
+	unsigned int threadCount = min((size_t) max(1u,
+			thread::hardware_concurrency()), band.size());
+	vector<thread> threads;
+
+	for (unsigned int t = 0; t < threadCount; t++)
+		threads.push_back(thread([this, &band, &lines, t, threadCount] {
+			for (size_t i = t; i < band.size(); i += threadCount)
+				rasterize(*band[i], lines[i]);
+		}));
+
+	for (thread & worker : threads)
+		worker.join();
+#else
+	for (size_t i = 0; i < band.size(); i++)
+		rasterize(*band[i], lines[i]);
+#endif
+}
+
+#ifdef WITH_ZLIB
+
+static void writeBigEndian(unsigned char * data, unsigned int value) {
+	data[0] = value >> 24;
+	data[1] = (value >> 16) & 0xff;
+	data[2] = (value >> 8) & 0xff;
+	data[3] = value & 0xff;
+}
+
+static bool writePngChunk(FILE * image, const char * type,
+		const unsigned char * data, unsigned int size) {
+	unsigned char header[8];
+	writeBigEndian(header, size);
+	copy(type, type + 4, header + 4);
+
+	unsigned char crc[4];
+	uLong checksum = crc32(0, header + 4, 4);
+	if (size > 0)
+		checksum = crc32(checksum, data, size);
+	writeBigEndian(crc, checksum);
+
+	return fwrite(header, 1, 8, image) == 8
+			&& fwrite(data, 1, size, image) == size
+			&& fwrite(crc, 1, 4, image) == 4;
+}
+
+/**
+ * Compress the available data of the stream into IDAT chunks
+ */
+static bool deflateToPng(FILE * image, z_stream & stream,
+		vector<unsigned char> & buffer, int flush) {
+	int result;
+	do {
+		stream.next_out = buffer.data();
+		stream.avail_out = buffer.size();
+		result = deflate(&stream, flush);
+		if (result == Z_STREAM_ERROR)
+			return false;
+
+		unsigned int size = buffer.size() - stream.avail_out;
+		if (size > 0 && !writePngChunk(image, "IDAT", buffer.data(), size))
+			return false;
+	} while (stream.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+
+	return true;
+}
+
+#endif /* WITH_ZLIB */
+
+/**
+ * Write the rows by bands, each band being rasterized in parallel
+ */
+bool RasterWriter::writeImage(const vector<const RasterRow *> & kept) {
+	bool standardOutput = outputFile == STANDARD_STREAM;
+	FILE * image = standardOutput ? stdout : fopen(outputFile.c_str(), "wb");
+	if (image == nullptr)
+		return false;
+
+	bool written = true;
+
+#ifdef WITH_ZLIB
+	bool png = isPng(outputFile);
+	z_stream stream = z_stream();
+	vector<unsigned char> buffer(1 << 16);
+
+	if (png) {
+		const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n',
+				0x1a, '\n' };
+		// Width, height, 8 bits per channel, RGB, no interlacing
+		unsigned char header[13] = { 0 };
+		writeBigEndian(header, width);
+		writeBigEndian(header + 4, kept.size());
+		header[8] = 8;
+		header[9] = 2;
+
+		written = fwrite(signature, 1, sizeof(signature), image)
+				== sizeof(signature)
+				&& writePngChunk(image, "IHDR", header, sizeof(header))
+				// Large images of mostly uniform rows: favour the speed
+				&& deflateInit(&stream, Z_BEST_SPEED) == Z_OK;
+	} else
+#endif
+		written = fprintf(image, "P6\n%u %u\n255\n", width,
+				(unsigned int) kept.size()) > 0;
+
+	vector<vector<unsigned char>> lines;
+	for (size_t first = 0; written && first < kept.size();
+			first += RASTER_BAND_ROWS) {
+		vector<const RasterRow *> band(kept.begin() + first,
+				kept.begin() + min(kept.size(), first + RASTER_BAND_ROWS));
+		rasterizeBand(band, lines);
+
+		for (size_t i = 0; written && i < band.size(); i++) {
+#ifdef WITH_ZLIB
+			if (png) {
+				// No filter on the line
+				unsigned char filter = 0;
+				stream.next_in = &filter;
+				stream.avail_in = 1;
+				written = deflateToPng(image, stream, buffer, Z_NO_FLUSH);
+
+				stream.next_in = lines[i].data();
+				stream.avail_in = lines[i].size();
+				written = written
+						&& deflateToPng(image, stream, buffer, Z_NO_FLUSH);
+				continue;
+			}
+#endif
+			written = fwrite(lines[i].data(), 1, lines[i].size(), image)
+					== lines[i].size();
+		}
+	}
+
+#ifdef WITH_ZLIB
+	if (png) {
+		stream.avail_in = 0;
+		written = written && deflateToPng(image, stream, buffer, Z_FINISH)
+				&& writePngChunk(image, "IEND", nullptr, 0);
+		deflateEnd(&stream);
+	}
+#endif
+
+	return (standardOutput ? fflush(image) : fclose(image)) == 0 && written;
+}
+
+void RasterWriter::close() {
+	vector<const RasterRow *> kept;
+	for (const RasterRow & row : rows)
+		if (!row.hasChildren || !row.pixels.empty() || !row.partials.empty())
+			kept.push_back(&row);
+
+	if (kept.empty() || duration <= 0) {
+		cerr << "Warning: no container to render in " << outputFile << endl;
+		return;
+	}
+
+	if (!writeImage(kept))
+		cerr << "Error: could not write the image " << outputFile << endl;
+	else
+		cerr << "Rendered " << kept.size() << " containers on " << width
+				<< " columns in " << outputFile << endl;
+}
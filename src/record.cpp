@@ -0,0 +1,171 @@
+/*
+ * record.cpp
+ *
+ *  Tokenizer for the records of a .prv file.
+ */
+
+#include <climits>
+#include "include/record.h"
+
+/**
+ * Cursor over the fields of a line
+ */
+class FieldCursor {
+
+private:
+	const char * current;
+	const char * end;
+	int fieldNumber = 0;
+
+public:
+	string error;
+
+	FieldCursor(const char * begin, const char * end) {
+		this->current = begin;
+		this->end = end;
+	}
+
+	bool atEnd() const {
+		return current >= end;
+	}
+
+	/**
+	 * Read the next field as a signed integer, and skip the separator
+	 */
+	bool nextLong(long long & value) {
+		fieldNumber++;
+
+		if (current >= end) {
+			error = "missing field " + to_string(fieldNumber);
+			return false;
+		}
+
+		bool negative = false;
+		if (*current == '-') {
+			negative = true;
+			current++;
+		}
+
+		const char * start = current;
+		unsigned long long result = 0;
+
+		while (current < end && *current >= '0' && *current <= '9') {
+			unsigned int digit = *current - '0';
+			if (result > ((unsigned long long) LLONG_MAX - digit) / 10) {
+				error = "value out of range in field " + to_string(fieldNumber);
+				return false;
+			}
+			result = result * 10 + digit;
+			current++;
+		}
+
+		if (current == start) {
+			error = "invalid number in field " + to_string(fieldNumber);
+			return false;
+		}
+
+		if (current < end) {
+			if (*current != PRV_SEPARATOR) {
+				error = "invalid number in field " + to_string(fieldNumber);
+				return false;
+			}
+			current++;
+			// A separator must be followed by a field
+			if (current == end) {
+				error = "missing field " + to_string(fieldNumber + 1);
+				return false;
+			}
+		}
+
+		value = negative ? -(long long) result : (long long) result;
+		return true;
+	}
+
+	bool nextInt(int & value) {
+		long long longValue;
+		if (!nextLong(longValue))
+			return false;
+
+		if (longValue > INT_MAX || longValue < INT_MIN) {
+			error = "value out of range in field " + to_string(fieldNumber);
+			return false;
+		}
+
+		value = longValue;
+		return true;
+	}
+
+	/**
+	 * Check that the whole line was consumed
+	 */
+	bool finished() {
+		if (current < end) {
+			error = "unexpected field " + to_string(fieldNumber + 1);
+			return false;
+		}
+		return true;
+	}
+};
+
+TokenizeResult tokenizeRecord(const char * begin, const char * end,
+		PrvRecord & record, string & error) {
+
+	if (begin == end || *begin < '0' || *begin > '9')
+		return RECORD_IGNORED;
+
+	FieldCursor cursor(begin, end);
+
+	if (!cursor.nextInt(record.category)) {
+		error = cursor.error;
+		return RECORD_MALFORMED;
+	}
+
+	if (record.category != STATE_CATEGORY && record.category != EVENT_CATEGORY
+			&& record.category != LINK_CATEGORY)
+		return RECORD_UNSUPPORTED;
+
+	bool valid = cursor.nextInt(record.cpuID) && cursor.nextInt(record.appID)
+			&& cursor.nextInt(record.taskID) && cursor.nextInt(record.threadID);
+
+	switch (record.category) {
+	case STATE_CATEGORY:
+		valid = valid && cursor.nextLong(record.time)
+				&& cursor.nextLong(record.endTime)
+				&& cursor.nextInt(record.stateType) && cursor.finished();
+		break;
+
+	case EVENT_CATEGORY:
+		record.params.clear();
+		valid = valid && cursor.nextLong(record.time);
+
+		// At least one (type, value) pair
+		do {
+			int type;
+			long long value;
+			valid = valid && cursor.nextInt(type) && cursor.nextLong(value);
+			if (valid)
+				record.params.push_back(make_pair(type, value));
+		} while (valid && !cursor.atEnd());
+		break;
+
+	case LINK_CATEGORY:
+		valid = valid && cursor.nextLong(record.wantedSendTime)
+				&& cursor.nextLong(record.time)
+				&& cursor.nextInt(record.cpuIDReceive)
+				&& cursor.nextInt(record.appIDReceive)
+				&& cursor.nextInt(record.taskIDReceive)
+				&& cursor.nextInt(record.threadIDReceive)
+				&& cursor.nextLong(record.wantedReceiveTime)
+				&& cursor.nextLong(record.endTime)
+				&& cursor.nextLong(record.size) && cursor.nextInt(record.tag)
+				&& cursor.finished();
+		break;
+	}
+
+	if (!valid) {
+		error = cursor.error;
+		return RECORD_MALFORMED;
+	}
+
+	return RECORD_OK;
+}
@@ -0,0 +1,285 @@
+/*
+ * recordCache.cpp
+ *
+ *  Binary cache of the parsed records of a .prv file.
+ */
+
+#include <algorithm>
+#include <climits>
+#include "include/recordCache.h"
+
+const char RECORD_CACHE_KIND = 'T';
+
+// Category of the object definitions in the blocks
+const unsigned char OBJECT_DEFINITION = 0;
+
+static void writeVarint(string & out, unsigned long long value) {
+	while (value >= 0x80) {
+		out.push_back((char) (value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char) value);
+}
+
+static void writeSigned(string & out, long long value) {
+	writeVarint(out,
+			((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63));
+}
+
+/**
+ * Decode a varint, clearing valid if it goes past the end of the block
+ */
+static inline unsigned long long readVarint(const char * data, size_t size,
+		size_t & position, bool & valid) {
+	unsigned long long value = 0;
+	int shift = 0;
+
+	while (position < size && shift < 64) {
+		unsigned char byte = data[position++];
+		value |= (unsigned long long) (byte & 0x7f) << shift;
+		if (byte < 0x80)
+			return value;
+		shift += 7;
+	}
+
+	valid = false;
+	return 0;
+}
+
+static inline long long readSigned(const char * data, size_t size,
+		size_t & position, bool & valid) {
+	unsigned long long value = readVarint(data, size, position, valid);
+	return (long long) (value >> 1) ^ -(long long) (value & 1);
+}
+
+bool RecordCacheWriter::open(const string & traceFile, const string & header) {
+	long long size, modification;
+	if (!fileIdentity(traceFile, size, modification))
+		return false;
+
+	cacheFile = traceFile + RECORD_CACHE_EXTENSION;
+	if (!cache.open(cacheFile + ".tmp", "wb"))
+		return false;
+
+	cache.writeHeader(RECORD_CACHE_KIND, size, modification);
+	cache.writeString(header);
+
+	opened = true;
+	return cache.isValid();
+}
+
+unsigned int RecordCacheWriter::getObject(int cpuID, int appID, int taskID,
+		int threadID) {
+	tuple<int, int, int, int> key = make_tuple(cpuID, appID, taskID, threadID);
+	auto it = objects.find(key);
+	if (it != objects.end())
+		return it->second;
+
+	unsigned int number = objects.size();
+	objects[key] = number;
+
+	payload.push_back(OBJECT_DEFINITION);
+	writeSigned(payload, cpuID);
+	writeSigned(payload, appID);
+	writeSigned(payload, taskID);
+	writeSigned(payload, threadID);
+	return number;
+}
+
+void RecordCacheWriter::add(const PrvRecord & record) {
+	if (!opened)
+		return;
+
+	unsigned int sender = getObject(record.cpuID, record.appID, record.taskID,
+			record.threadID);
+	unsigned int receiver = 0;
+	if (record.category == LINK_CATEGORY)
+		receiver = getObject(record.cpuIDReceive, record.appIDReceive,
+				record.taskIDReceive, record.threadIDReceive);
+
+	payload.push_back((char) record.category);
+	writeVarint(payload, sender);
+	writeSigned(payload, record.time - previousTime);
+
+	switch (record.category) {
+	case STATE_CATEGORY:
+		writeSigned(payload, record.endTime - record.time);
+		writeSigned(payload, record.stateType);
+		break;
+
+	case EVENT_CATEGORY:
+		writeVarint(payload, record.params.size());
+		for (auto & param : record.params) {
+			writeSigned(payload, param.first);
+			writeSigned(payload, param.second);
+		}
+		break;
+
+	case LINK_CATEGORY:
+		writeSigned(payload, record.wantedSendTime - record.time);
+		writeSigned(payload, record.endTime - record.time);
+		writeVarint(payload, receiver);
+		writeSigned(payload, record.wantedReceiveTime - record.time);
+		writeSigned(payload, record.size);
+		writeSigned(payload, record.tag);
+		break;
+	}
+
+	long long end = (record.category == EVENT_CATEGORY) ?
+			record.time : max(record.time, record.endTime);
+	if (recordCount == 0) {
+		firstTime = record.time;
+		lastTime = end;
+	}
+	firstTime = min(firstTime, record.time);
+	lastTime = max(lastTime, end);
+	previousTime = record.time;
+
+	if (++recordCount == RECORD_CACHE_BLOCK_RECORDS)
+		flushBlock();
+}
+
+void RecordCacheWriter::flushBlock() {
+	cache.write<unsigned int>(payload.size());
+	cache.write<unsigned int>(recordCount);
+	cache.write<long long>(firstTime);
+	cache.write<long long>(lastTime);
+	cache.writeBytes(payload.data(), payload.size());
+
+	payload.clear();
+	recordCount = 0;
+	previousTime = 0;
+	objects.clear();
+}
+
+bool RecordCacheWriter::commit() {
+	if (!opened)
+		return false;
+	opened = false;
+
+	if (recordCount > 0)
+		flushBlock();
+	// End of the cache
+	flushBlock();
+
+	return commitCache(cache, cacheFile);
+}
+
+void RecordCacheWriter::discard() {
+	if (!opened)
+		return;
+	opened = false;
+
+	cache.close();
+	remove((cacheFile + ".tmp").c_str());
+}
+
+bool RecordCacheReader::open(const string & traceFile) {
+	long long size, modification;
+	if (!fileIdentity(traceFile, size, modification))
+		return false;
+
+	if (!cache.open(traceFile + RECORD_CACHE_EXTENSION, "rb")
+			|| !cache.checkHeader(RECORD_CACHE_KIND, size, modification))
+		return false;
+
+	header = cache.readString();
+	return cache.isValid();
+}
+
+bool RecordCacheReader::readBlock() {
+	unsigned int size = cache.read<unsigned int>();
+	remaining = cache.read<unsigned int>();
+	// Time range of the block (not needed to read the whole trace)
+	cache.read<long long>();
+	cache.read<long long>();
+
+	if (!cache.isValid()) {
+		valid = false;
+		return false;
+	}
+
+	if (remaining == 0)
+		return false;
+
+	payload.resize(size);
+	cache.readBytes(payload.data(), size);
+	valid = cache.isValid();
+
+	position = 0;
+	previousTime = 0;
+	objects.clear();
+	return valid;
+}
+
+bool RecordCacheReader::next(PrvRecord & record) {
+	if (remaining == 0 && !readBlock())
+		return false;
+
+	const char * data = payload.data();
+	size_t size = payload.size();
+
+	unsigned char category = 0;
+	while (valid && position < size
+			&& (category = data[position++]) == OBJECT_DEFINITION) {
+		int cpuID = readSigned(data, size, position, valid);
+		int appID = readSigned(data, size, position, valid);
+		int taskID = readSigned(data, size, position, valid);
+		int threadID = readSigned(data, size, position, valid);
+		objects.push_back(make_tuple(cpuID, appID, taskID, threadID));
+	}
+
+	unsigned int sender = readVarint(data, size, position, valid);
+	if (!valid || sender >= objects.size()) {
+		valid = false;
+		return false;
+	}
+
+	record.category = category;
+	tie(record.cpuID, record.appID, record.taskID, record.threadID) =
+			objects[sender];
+	record.time = previousTime + readSigned(data, size, position, valid);
+	previousTime = record.time;
+
+	switch (category) {
+	case STATE_CATEGORY:
+		record.endTime = record.time + readSigned(data, size, position, valid);
+		record.stateType = readSigned(data, size, position, valid);
+		break;
+
+	case EVENT_CATEGORY: {
+		unsigned long long count = readVarint(data, size, position, valid);
+		record.params.clear();
+		for (unsigned long long i = 0; valid && i < count; i++) {
+			int type = readSigned(data, size, position, valid);
+			record.params.push_back(
+					make_pair(type, readSigned(data, size, position, valid)));
+		}
+		break;
+	}
+
+	case LINK_CATEGORY: {
+		record.wantedSendTime = record.time
+				+ readSigned(data, size, position, valid);
+		record.endTime = record.time + readSigned(data, size, position, valid);
+		unsigned int receiver = readVarint(data, size, position, valid);
+		if (receiver >= objects.size()) {
+			valid = false;
+			break;
+		}
+		tie(record.cpuIDReceive, record.appIDReceive, record.taskIDReceive,
+				record.threadIDReceive) = objects[receiver];
+		record.wantedReceiveTime = record.time
+				+ readSigned(data, size, position, valid);
+		record.size = readSigned(data, size, position, valid);
+		record.tag = readSigned(data, size, position, valid);
+		break;
+	}
+
+	default:
+		valid = false;
+	}
+
+	remaining--;
+	return valid;
+}
@@ -0,0 +1,136 @@
+/*
+ * reduction.cpp
+ *
+ *  Reduction of the states and events written in the output.
+ */
+
+#include <algorithm>
+#include "include/reduction.h"
+
+// Fixed seed so that the reservoir sampling is reproducible
+const unsigned long long RESERVOIR_SEED = 0x70727632706a64ULL;
+
+Reducer::Reducer() :
+		generator(RESERVOIR_SEED) {
+}
+
+bool Reducer::keepState(long long start, long long end) {
+	if (minDuration > 0 && end - start < minDuration) {
+		droppedStates++;
+		droppedStateTime += end - start;
+		return false;
+	}
+
+	keptStates++;
+	return true;
+}
+
+/**
+ * Apply the rate limitation and the 1 in N sampling to an event.
+ *
+ * When the reservoir sampling is used, the kept events must then be given
+ * to offerReservoir().
+ */
+bool Reducer::keepEvent(int containerIndex, int type, long long time) {
+	if (eventRateWindow > 0) {
+		long long window = time / eventRateWindow;
+		pair<long long, long long> & rate = eventRates[type];
+
+		if (rate.first != window) {
+			rate.first = window;
+			rate.second = 0;
+		}
+
+		if (rate.second >= eventRateCount) {
+			rateLimitedEvents++;
+			rateLimitedPerType[type]++;
+			return false;
+		}
+		rate.second++;
+	}
+
+	if (sampleInterval > 1) {
+		if ((unsigned int) containerIndex >= sampleCounters.size())
+			sampleCounters.resize(containerIndex + 1, 0);
+
+		if (sampleCounters[containerIndex]++ % sampleInterval != 0) {
+			sampledOutEvents++;
+			return false;
+		}
+	}
+
+	if (reservoirSize == 0)
+		keptEvents++;
+
+	return true;
+}
+
+/**
+ * Reservoir sampling (algorithm R): each event of a container has the same
+ * probability to be kept.
+ */
+void Reducer::offerReservoir(int containerIndex, const Event & event) {
+	if ((unsigned int) containerIndex >= reservoirs.size()) {
+		reservoirs.resize(containerIndex + 1);
+		reservoirSeen.resize(containerIndex + 1, 0);
+	}
+
+	vector<Event> & reservoir = reservoirs[containerIndex];
+	unsigned long long seen = reservoirSeen[containerIndex]++;
+
+	if (reservoir.size() < reservoirSize) {
+		reservoir.push_back(event);
+		return;
+	}
+
+	sampledOutEvents++;
+	unsigned long long slot = uniform_int_distribution<unsigned long long>(0,
+			seen)(generator);
+	if (slot < reservoirSize)
+		reservoir[slot] = event;
+}
+
+/**
+ * Get the events kept by reservoir sampling, sorted by timestamp
+ */
+vector<Event> Reducer::takeReservoirs() {
+	vector<Event> events;
+
+	for (vector<Event> & reservoir : reservoirs) {
+		events.insert(events.end(), reservoir.begin(), reservoir.end());
+		reservoir.clear();
+	}
+
+	stable_sort(events.begin(), events.end(),
+			[](const Event & a, const Event & b) {
+				return a.getTimeStamp() < b.getTimeStamp();
+			});
+
+	keptEvents += events.size();
+	return events;
+}
+
+void Reducer::writeReport(ostream & out) {
+	out << "Reduction report:" << endl;
+
+	unsigned long long totalStates = keptStates + droppedStates;
+	out << "\tStates kept: " << keptStates << " / " << totalStates;
+	if (minDuration > 0)
+		out << " (" << droppedStates << " shorter than " << minDuration
+				<< " dropped, total time " << droppedStateTime << ")";
+	out << endl;
+
+	unsigned long long totalEvents = keptEvents + rateLimitedEvents
+			+ sampledOutEvents;
+	out << "\tEvents kept: " << keptEvents << " / " << totalEvents << endl;
+
+	if (eventRateWindow > 0) {
+		out << "\tEvents dropped by rate limitation: " << rateLimitedEvents
+				<< endl;
+		for (auto & it : rateLimitedPerType)
+			out << "\t\ttype " << it.first << ": " << it.second << endl;
+	}
+
+	if (sampleInterval > 1 || reservoirSize > 0)
+		out << "\tEvents dropped by sampling: " << sampledOutEvents << endl;
+}
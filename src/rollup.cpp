@@ -0,0 +1,140 @@
+/*
+ * rollup.cpp
+ *
+ *  Aggregation of the thread states at the task, node or application level.
+ */
+
+#include <climits>
+#include "include/rollup.h"
+
+RollUp::RollUp(RollUpMode mode, TraceWriter * writer) {
+	this->mode = mode;
+	this->writer = writer;
+}
+
+int RollUp::getStateIndex(int type, const string & name) {
+	auto it = stateIndexes.find(type);
+	if (it != stateIndexes.end())
+		return it->second;
+
+	int index = stateNames.size();
+	stateIndexes[type] = index;
+	stateNames.push_back(name);
+	return index;
+}
+
+/**
+ * Process the ends of the thread states up to the given time
+ */
+void RollUp::advance(ParentTimeline & parent, long long time) {
+	while (!parent.ends.empty() && parent.ends.top().first <= time) {
+		pair<long long, int> end = parent.ends.top();
+		parent.ends.pop();
+		change(parent, end.first, end.second, -1);
+	}
+}
+
+/**
+ * Dominant mode: the counts are about to change at the given time, so they
+ * were constant over [segmentStart, time). Close the written state if the
+ * dominant state of this segment differs.
+ */
+void RollUp::settle(ParentTimeline & parent, long long time) {
+	if (time <= parent.segmentStart)
+		return;
+
+	int dominant = parent.openState;
+	int dominantCount = (dominant == -1) ? 0 : parent.counts[dominant];
+
+	for (unsigned int i = 0; i < parent.counts.size(); i++)
+		if (parent.counts[i] > dominantCount) {
+			dominant = i;
+			dominantCount = parent.counts[i];
+		}
+
+	if (dominantCount == 0)
+		dominant = -1;
+
+	if (dominant != parent.openState) {
+		if (parent.openState != -1 && parent.segmentStart > parent.openStart) {
+			State state(parent.openStart, parent.name,
+					stateNames[parent.openState], parent.segmentStart);
+			writer->writeState(state);
+		}
+		parent.openState = dominant;
+		parent.openStart = parent.segmentStart;
+	}
+
+	parent.segmentStart = time;
+}
+
+/**
+ * Occupancy mode: the count of a state is about to change at the given time,
+ * so it was constant over [countSince, time). Write the previous value if it
+ * differs.
+ */
+void RollUp::settleCount(ParentTimeline & parent, int state, long long time) {
+	if (time <= parent.countSince[state])
+		return;
+
+	if (parent.counts[state] != parent.openValue[state]) {
+		if (parent.openValue[state] > 0)
+			writer->writeVariable(parent.name, stateNames[state],
+					parent.openValueStart[state], parent.countSince[state],
+					parent.openValue[state]);
+		parent.openValue[state] = parent.counts[state];
+		parent.openValueStart[state] = parent.countSince[state];
+	}
+
+	parent.countSince[state] = time;
+}
+
+void RollUp::change(ParentTimeline & parent, long long time, int state,
+		int delta) {
+	if ((unsigned int) state >= parent.counts.size()) {
+		parent.counts.resize(state + 1, 0);
+		parent.countSince.resize(state + 1, time);
+		parent.openValue.resize(state + 1, 0);
+		parent.openValueStart.resize(state + 1, 0);
+	}
+
+	if (mode == ROLLUP_DOMINANT) {
+		if (parent.segmentStart == -1)
+			parent.segmentStart = time;
+		settle(parent, time);
+	} else {
+		settleCount(parent, state, time);
+	}
+
+	parent.counts[state] += delta;
+}
+
+void RollUp::addState(int parentIndex, const string & parentName,
+		long long start, long long end, int type, const string & typeName) {
+	if ((unsigned int) parentIndex >= parents.size())
+		parents.resize(parentIndex + 1);
+
+	ParentTimeline & parent = parents[parentIndex];
+	parent.name = parentName;
+
+	int state = getStateIndex(type, typeName);
+
+	advance(parent, start);
+	change(parent, start, state, 1);
+	parent.ends.push(make_pair(end, state));
+}
+
+/**
+ * End of the trace: process the remaining ends
+ */
+void RollUp::flush() {
+	for (ParentTimeline & parent : parents) {
+		advance(parent, LLONG_MAX);
+		if (mode == ROLLUP_DOMINANT)
+			settle(parent, LLONG_MAX);
+		else
+			for (unsigned int i = 0; i < parent.counts.size(); i++)
+				settleCount(parent, i, LLONG_MAX);
+	}
+	parents.clear();
+}
@@ -0,0 +1,296 @@
+/*
+ * selfTrace.cpp
+ *
+ *  Timeline of the stages of the converter itself, per thread, written as a
+ *  pjdump or Paraver trace.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include "include/selfTrace.h"
+#include "include/writer.h"
+
+#ifndef _WIN32
+#include <mutex>
+#endif
+
+static const char * STAGE_NAMES[] = { "Read", "Tokenize", "Resolve names",
+		"Format", "Write", "Compress", "Queue wait", "Records" };
+static const char * STAGE_COLORS[] = { "{0,130,200}", "{60,180,75}",
+		"{255,225,25}", "{245,130,48}", "{230,25,75}", "{145,30,180}",
+		"{170,170,170}", "{255,255,255}" };
+
+// Container holding the threads of the converter
+static const string SELF_TRACE_CONTAINER = "prv2pjdump";
+
+bool SelfTrace::enabled = false;
+long long SelfTrace::origin = 0;
+
+// Buffers of the threads, kept after the threads have stopped
+static vector<unique_ptr<ThreadSpans>> threadSpans;
+// Number of threads named with each role
+static map<string, unsigned int> roleCounts;
+#ifndef _WIN32
+static mutex threadsLock;
+#endif
+
+static thread_local ThreadSpans * threadBuffer = nullptr;
+
+static long long currentTime() {
+	return chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SelfTrace::enable() {
+	origin = currentTime();
+	enabled = true;
+	current().name = "main";
+}
+
+/**
+ * Buffer of the calling thread, created the first time
+ */
+ThreadSpans & SelfTrace::current() {
+	if (threadBuffer != nullptr)
+		return *threadBuffer;
+
+#ifndef _WIN32
+	lock_guard<mutex> guard(threadsLock);
+#endif
+	threadSpans.push_back(unique_ptr<ThreadSpans>(new ThreadSpans()));
+	threadBuffer = threadSpans.back().get();
+	threadBuffer->name = "thread " + to_string(threadSpans.size());
+	return *threadBuffer;
+}
+
+void SelfTrace::setThreadName(const string & role) {
+	if (!enabled)
+		return;
+
+	ThreadSpans & thread = current();
+#ifndef _WIN32
+	lock_guard<mutex> guard(threadsLock);
+#endif
+	thread.name = role + " " + to_string(++roleCounts[role]);
+}
+
+/**
+ * Stages switched for each record
+ */
+static bool isRecordStage(TraceStage stage) {
+	return stage == STAGE_TOKENIZE || stage == STAGE_RESOLVE
+			|| stage == STAGE_FORMAT;
+}
+
+/**
+ * Add the time since the last switch to the current stage
+ */
+void SelfTrace::account(ThreadSpans & thread, long long time) {
+	if (thread.stage != NO_STAGE && time > thread.switchTime) {
+		if (!thread.sampled && isRecordStage(thread.stage))
+			thread.unsampledTime += time - thread.switchTime;
+		else {
+			if (thread.stageTimes[thread.stage] == 0)
+				thread.stageOrder.push_back(thread.stage);
+			thread.stageTimes[thread.stage] += time - thread.switchTime;
+		}
+	}
+	thread.switchTime = time;
+}
+
+/**
+ * Write the times of the batch as consecutive spans, which end at the given
+ * time, and start the next batch
+ */
+void SelfTrace::flush(ThreadSpans & thread, long long time) {
+	account(thread, time);
+
+	long long sampledTime = 0;
+	for (TraceStage stage : thread.stageOrder)
+		if (isRecordStage(stage))
+			sampledTime += thread.stageTimes[stage];
+
+	// Without sampled record, the stages of the records are unknown
+	if (thread.unsampledTime > 0 && sampledTime == 0) {
+		thread.stageOrder.push_back(STAGE_RECORDS);
+		thread.stageTimes[STAGE_RECORDS] = thread.unsampledTime;
+	} else if (thread.unsampledTime > 0) {
+		long long shared = 0;
+		TraceStage last = NO_STAGE;
+		for (TraceStage stage : thread.stageOrder)
+			if (isRecordStage(stage)) {
+				long long part = (long long) ((double) thread.unsampledTime
+						* thread.stageTimes[stage] / sampledTime);
+				thread.stageTimes[stage] += part;
+				shared += part;
+				last = stage;
+			}
+		// Rounding
+		thread.stageTimes[last] += thread.unsampledTime - shared;
+	}
+	thread.unsampledTime = 0;
+
+	long long start = thread.batchStart;
+	for (TraceStage stage : thread.stageOrder) {
+		long long end = start + thread.stageTimes[stage];
+		thread.spans.push_back( { start - origin, end - origin, stage });
+		thread.stageTimes[stage] = 0;
+		start = end;
+	}
+
+	thread.stageOrder.clear();
+	thread.records = 0;
+	thread.batchStart = time;
+}
+
+TraceStage SelfTrace::switchTracedRecordStage(TraceStage stage) {
+	ThreadSpans & thread = current();
+	if (thread.sampled || !isRecordStage(stage)
+			|| !isRecordStage(thread.stage))
+		return switchTracedStage(stage);
+
+	// Only the time of the whole record is known
+	TraceStage previous = thread.stage;
+	thread.stage = stage;
+	return previous;
+}
+
+TraceStage SelfTrace::switchTracedStage(TraceStage stage) {
+	ThreadSpans & thread = current();
+	long long time = currentTime();
+	TraceStage previous = thread.stage;
+
+	if (stage == NO_STAGE)
+		flush(thread, time);
+	else if (previous == NO_STAGE)
+		// The time out of the stages is not part of the batch
+		thread.batchStart = time;
+
+	account(thread, time);
+	thread.stage = stage;
+	return previous;
+}
+
+void SelfTrace::countTracedRecord() {
+	ThreadSpans & thread = current();
+	thread.records++;
+	bool sampled = thread.records % SELF_TRACE_SAMPLING == 0;
+
+	if (thread.records >= SELF_TRACE_BATCH_SIZE)
+		flush(thread, currentTime());
+	else if (sampled != thread.sampled)
+		account(thread, currentTime());
+	thread.sampled = sampled;
+}
+
+void SelfTrace::endTracedBatch() {
+	flush(current(), currentTime());
+}
+
+/**
+ * Date of the header of a Paraver trace: (dd/mm/yy at hh:mm)
+ */
+static string paraverDate() {
+	time_t now = time(nullptr);
+	char date[32];
+	strftime(date, sizeof(date), "(%d/%m/%y at %H:%M)", localtime(&now));
+	return date;
+}
+
+/**
+ * Threads of a node, the stages being the states (their number plus one, 0
+ * being Idle), in a .prv file with its .pcf and .row files
+ */
+static bool writeParaver(const string & outputFile, long long duration) {
+	size_t threads = threadSpans.size();
+	string basename = outputFile.substr(0, outputFile.size() - 4);
+
+	// Records sorted by time, then by thread
+	vector<pair<TraceSpan, size_t>> records;
+	for (size_t i = 0; i < threads; i++)
+		for (const TraceSpan & span : threadSpans[i]->spans)
+			records.push_back(make_pair(span, i));
+	sort(records.begin(), records.end(),
+			[](const pair<TraceSpan, size_t> & a,
+					const pair<TraceSpan, size_t> & b) {
+				if (a.first.start != b.first.start)
+					return a.first.start < b.first.start;
+				return a.second < b.second;
+			});
+
+	ofstream trace(outputFile);
+	trace << "#Paraver " << paraverDate() << PRV_SEPARATOR << duration
+			<< "_ns" << PRV_SEPARATOR << "1(" << threads << ")"
+			<< PRV_SEPARATOR << "1" << PRV_SEPARATOR << "1(" << threads
+			<< PRV_SEPARATOR << "1)\n";
+	for (auto & record : records)
+		trace << "1:" << record.second + 1 << ":1:1:" << record.second + 1
+				<< PRV_SEPARATOR << record.first.start << PRV_SEPARATOR
+				<< record.first.end << PRV_SEPARATOR
+				<< record.first.stage + 1 << '\n';
+	trace.close();
+
+	ofstream config(basename + ".pcf");
+	config << "STATES\n0    Idle\n";
+	for (int stage = 0; stage < NO_STAGE; stage++)
+		config << stage + 1 << "    " << STAGE_NAMES[stage] << '\n';
+	config << "\nSTATES_COLOR\n0    {117,195,255}\n";
+	for (int stage = 0; stage < NO_STAGE; stage++)
+		config << stage + 1 << "    " << STAGE_COLORS[stage] << '\n';
+	config.close();
+
+	ofstream resources(basename + ".row");
+	resources << "LEVEL NODE SIZE 1\n" << SELF_TRACE_CONTAINER << "\n\n";
+	resources << "LEVEL THREAD SIZE " << threads << '\n';
+	for (auto & thread : threadSpans)
+		resources << thread->name << '\n';
+	resources.close();
+
+	return trace.good() && config.good() && resources.good();
+}
+
+/**
+ * A container per thread in the container of the converter, and a state per
+ * span
+ */
+static bool writePjdump(const string & outputFile, long long duration) {
+	PjdumpWriter writer;
+	if (!writer.open(outputFile))
+		return false;
+
+	writer.writeContainer("0", SELF_TRACE_CONTAINER,
+			APPLICATION_CONTAINER_KIND, 0, duration);
+	for (auto & thread : threadSpans)
+		writer.writeContainer(SELF_TRACE_CONTAINER, thread->name,
+				THREAD_CONTAINER_KIND, 0, duration);
+
+	for (auto & thread : threadSpans)
+		for (const TraceSpan & span : thread->spans) {
+			State state(span.start, thread->name, STAGE_NAMES[span.stage],
+					span.end);
+			writer.writeState(state);
+		}
+
+	writer.close();
+	return true;
+}
+
+bool SelfTrace::write(const string & outputFile) {
+	long long duration = 0;
+	for (auto & thread : threadSpans) {
+		// Batch left by a thread that stopped in a stage
+		flush(*thread, thread->switchTime);
+		if (!thread->spans.empty())
+			duration = max(duration, thread->spans.back().end);
+	}
+
+	const string extension = ".prv";
+	if (outputFile.size() > extension.size()
+			&& outputFile.compare(outputFile.size() - extension.size(),
+					extension.size(), extension) == 0)
+		return writeParaver(outputFile, duration);
+	return writePjdump(outputFile, duration);
+}
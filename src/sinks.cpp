@@ -0,0 +1,659 @@
+/*
+ * sinks.cpp
+ *
+ *  Outputs receiving the converted trace besides the pjdump and SQLite
+ *  backends: summaries, filters, and the fan-out to several outputs.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "include/sinks.h"
+#include "include/rasterWriter.h"
+#include "include/selfTrace.h"
+
+const string SUMMARY_TAG = "StateSummary";
+const string MATRIX_TAG = "LinkMatrix";
+
+const string THREAD_CONTAINER_FORMAT = "THREAD %d.%d.%d";
+const string TASK_CONTAINER_FORMAT = "Task_%d";
+
+const string SQLITE_EXTENSION = ".sqlite";
+
+bool SummaryWriter::open(const string & outputFile) {
+	this->outputFile = outputFile;
+	if (outputFile.empty() || outputFile == STANDARD_STREAM)
+		return true;
+
+	// Check that the file can be written before the conversion
+	ofstream report(outputFile);
+	return report.good();
+}
+
+void SummaryWriter::writeContainer(const string &, const string &,
+		const string &, long long, long long) {
+}
+
+void SummaryWriter::writeState(State & state) {
+	long long start = max(state.getTimeStamp(), windowStart);
+	long long end = min(state.getEndDate(), windowEnd);
+
+	auto & total = totals[make_pair(state.getContainer(), state.getName())];
+	total.first++;
+	if (end > start)
+		total.second += end - start;
+}
+
+void SummaryWriter::writeEvent(Event &) {
+}
+
+void SummaryWriter::writeLink(Link &) {
+}
+
+void SummaryWriter::writeVariable(const string &, const string &, long long,
+		long long, double) {
+}
+
+void SummaryWriter::close() {
+	if (outputFile.empty())
+		return;
+
+	if (outputFile == STANDARD_STREAM) {
+		writeReport(cout);
+		return;
+	}
+
+	ofstream report(outputFile);
+	writeReport(report);
+}
+
+void SummaryWriter::writeReport(ostream & out) const {
+	for (auto & it : totals) {
+		out << SUMMARY_TAG << PJDUMP_SEPARATOR;
+		out << it.first.first << PJDUMP_SEPARATOR;
+		out << it.first.second << PJDUMP_SEPARATOR;
+		out << it.second.first << PJDUMP_SEPARATOR;
+		out << it.second.second << endl;
+	}
+}
+
+bool LinkMatrixWriter::open(const string & outputFile) {
+	this->outputFile = outputFile;
+	if (outputFile == STANDARD_STREAM)
+		return true;
+
+	ofstream report(outputFile);
+	return report.good();
+}
+
+void LinkMatrixWriter::writeContainer(const string &, const string &,
+		const string &, long long, long long) {
+}
+
+void LinkMatrixWriter::writeState(State &) {
+}
+
+void LinkMatrixWriter::writeEvent(Event &) {
+}
+
+void LinkMatrixWriter::writeLink(Link & link) {
+	auto & total = totals[make_pair(link.getContainer(),
+			link.getReceiverContainer())];
+	total.first++;
+	total.second += link.getReceiveTimestamp() - link.getTimeStamp();
+}
+
+void LinkMatrixWriter::writeVariable(const string &, const string &,
+		long long, long long, double) {
+}
+
+void LinkMatrixWriter::close() {
+	ofstream file;
+	if (outputFile != STANDARD_STREAM)
+		file.open(outputFile);
+	ostream & report = (outputFile == STANDARD_STREAM) ? cout : file;
+
+	for (auto & it : totals) {
+		report << MATRIX_TAG << PJDUMP_SEPARATOR;
+		report << it.first.first << PJDUMP_SEPARATOR;
+		report << it.first.second << PJDUMP_SEPARATOR;
+		report << it.second.first << PJDUMP_SEPARATOR;
+		report << it.second.second << endl;
+	}
+}
+
+FilterWriter::FilterWriter(TraceWriter * target) {
+	this->target = target;
+}
+
+FilterWriter::~FilterWriter() {
+	delete target;
+}
+
+/**
+ * Read a range "min..max" or a single value
+ */
+template<typename T> static bool readRange(const string & text, T & low,
+		T & high) {
+	try {
+		size_t separator = text.find("..");
+		size_t used;
+		low = stoll(text.substr(0, separator), &used);
+		if (used != text.substr(0, separator).size())
+			return false;
+
+		if (separator == string::npos) {
+			high = low;
+			return true;
+		}
+
+		high = stoll(text.substr(separator + 2), &used);
+		return used == text.size() - separator - 2;
+	} catch (const exception & e) {
+		return false;
+	}
+}
+
+bool FilterWriter::setConditions(const string & conditions, string & error) {
+	stringstream list(conditions);
+	string condition;
+
+	while (getline(list, condition, ',')) {
+		size_t equal = condition.find('=');
+		string key = condition.substr(0, equal);
+		string range = (equal == string::npos) ?
+				"" : condition.substr(equal + 1);
+		bool valid;
+
+		if (key == "task")
+			valid = readRange(range, taskMin, taskMax);
+		else if (key == "thread")
+			valid = readRange(range, threadMin, threadMax);
+		else if (key == "time")
+			valid = readRange(range, timeMin, timeMax);
+		else {
+			error = "unknown filter condition " + condition;
+			return false;
+		}
+
+		if (!valid) {
+			error = "invalid range in filter condition " + condition;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FilterWriter::keepContainer(const string & name) {
+	auto it = keptContainers.find(name);
+	if (it != keptContainers.end())
+		return it->second;
+
+	int app, task, thread;
+	bool kept = true;
+
+	if (sscanf(name.c_str(), THREAD_CONTAINER_FORMAT.c_str(), &app, &task,
+			&thread) == 3)
+		kept = task >= taskMin && task <= taskMax && thread >= threadMin
+				&& thread <= threadMax;
+	else if (sscanf(name.c_str(), TASK_CONTAINER_FORMAT.c_str(), &task) == 1)
+		kept = task >= taskMin && task <= taskMax;
+
+	keptContainers[name] = kept;
+	return kept;
+}
+
+void FilterWriter::setConfig(shared_ptr<const TraceConfig> config) {
+	target->setConfig(config);
+}
+
+void FilterWriter::setTraceUnit(int unit) {
+	target->setTraceUnit(unit);
+}
+
+void FilterWriter::setUnsortedRecords() {
+	target->setUnsortedRecords();
+}
+
+void FilterWriter::setIncomplete() {
+	target->setIncomplete();
+}
+
+bool FilterWriter::open(const string & outputFile) {
+	return target->open(outputFile);
+}
+
+void FilterWriter::writeContainer(const string & parent, const string & name,
+		const string & kind, long long start, long long end) {
+	if (keepContainer(name))
+		target->writeContainer(parent, name, kind, start, end);
+}
+
+void FilterWriter::writeState(State & state) {
+	if (keepInterval(state.getTimeStamp(), state.getEndDate())
+			&& keepContainer(state.getContainer()))
+		target->writeState(state);
+}
+
+void FilterWriter::writeEvent(Event & event) {
+	if (keepInterval(event.getTimeStamp(), event.getTimeStamp())
+			&& keepContainer(event.getContainer()))
+		target->writeEvent(event);
+}
+
+void FilterWriter::writeLink(Link & link) {
+	if (keepInterval(link.getTimeStamp(), link.getReceiveTimestamp())
+			&& keepContainer(link.getContainer()))
+		target->writeLink(link);
+}
+
+void FilterWriter::writeVariable(const string & container, const string & name,
+		long long start, long long end, double value) {
+	if (keepInterval(start, end) && keepContainer(container))
+		target->writeVariable(container, name, start, end, value);
+}
+
+void FilterWriter::close() {
+	target->close();
+}
+
+MultiWriter::~MultiWriter() {
+	for (auto & sink : sinks)
+		delete sink.first;
+}
+
+void MultiWriter::addSink(TraceWriter * sink, const string & outputFile) {
+	sinks.push_back(make_pair(sink, outputFile));
+}
+
+void MultiWriter::setConfig(shared_ptr<const TraceConfig> config) {
+	for (auto & sink : sinks)
+		sink.first->setConfig(config);
+}
+
+void MultiWriter::setTraceUnit(int unit) {
+	for (auto & sink : sinks)
+		sink.first->setTraceUnit(unit);
+}
+
+void MultiWriter::setUnsortedRecords() {
+	for (auto & sink : sinks)
+		sink.first->setUnsortedRecords();
+}
+
+void MultiWriter::setIncomplete() {
+	for (auto & sink : sinks)
+		sink.first->setIncomplete();
+}
+
+bool MultiWriter::open(const string &) {
+	for (auto & sink : sinks)
+		if (!sink.first->open(sink.second)) {
+			cerr << "Error: could not open output file " << sink.second
+					<< endl;
+			return false;
+		}
+
+	return true;
+}
+
+void MultiWriter::writeContainer(const string & parent, const string & name,
+		const string & kind, long long start, long long end) {
+	for (auto & sink : sinks)
+		sink.first->writeContainer(parent, name, kind, start, end);
+}
+
+void MultiWriter::writeState(State & state) {
+	for (auto & sink : sinks)
+		sink.first->writeState(state);
+}
+
+void MultiWriter::writeEvent(Event & event) {
+	for (auto & sink : sinks)
+		sink.first->writeEvent(event);
+}
+
+void MultiWriter::writeLink(Link & link) {
+	for (auto & sink : sinks)
+		sink.first->writeLink(link);
+}
+
+void MultiWriter::writeVariable(const string & container, const string & name,
+		long long start, long long end, double value) {
+	for (auto & sink : sinks)
+		sink.first->writeVariable(container, name, start, end, value);
+}
+
+void MultiWriter::close() {
+	for (auto & sink : sinks)
+		sink.first->close();
+}
+
+TracedWriter::TracedWriter(TraceWriter * target) {
+	this->target = target;
+}
+
+TracedWriter::~TracedWriter() {
+	delete target;
+}
+
+void TracedWriter::setConfig(shared_ptr<const TraceConfig> config) {
+	target->setConfig(config);
+}
+
+void TracedWriter::setTraceUnit(int unit) {
+	target->setTraceUnit(unit);
+}
+
+void TracedWriter::setUnsortedRecords() {
+	target->setUnsortedRecords();
+}
+
+void TracedWriter::setIncomplete() {
+	target->setIncomplete();
+}
+
+bool TracedWriter::open(const string & outputFile) {
+	return target->open(outputFile);
+}
+
+void TracedWriter::writeContainer(const string & parent, const string & name,
+		const string & kind, long long start, long long end) {
+	TraceStage stage = SelfTrace::switchRecordStage(STAGE_FORMAT);
+	target->writeContainer(parent, name, kind, start, end);
+	SelfTrace::switchRecordStage(stage);
+}
+
+void TracedWriter::writeState(State & state) {
+	TraceStage stage = SelfTrace::switchRecordStage(STAGE_FORMAT);
+	target->writeState(state);
+	SelfTrace::switchRecordStage(stage);
+}
+
+void TracedWriter::writeEvent(Event & event) {
+	TraceStage stage = SelfTrace::switchRecordStage(STAGE_FORMAT);
+	target->writeEvent(event);
+	SelfTrace::switchRecordStage(stage);
+}
+
+void TracedWriter::writeLink(Link & link) {
+	TraceStage stage = SelfTrace::switchRecordStage(STAGE_FORMAT);
+	target->writeLink(link);
+	SelfTrace::switchRecordStage(stage);
+}
+
+void TracedWriter::writeVariable(const string & container, const string & name,
+		long long start, long long end, double value) {
+	TraceStage stage = SelfTrace::switchRecordStage(STAGE_FORMAT);
+	target->writeVariable(container, name, start, end, value);
+	SelfTrace::switchRecordStage(stage);
+}
+
+void TracedWriter::close() {
+	TraceStage stage = SelfTrace::switchStage(STAGE_WRITE);
+	target->close();
+	SelfTrace::switchStage(stage);
+}
+
+#ifndef _WIN32
+
+void WriterBatch::replay(TraceWriter * writer) {
+	unsigned int interval = 0, state = 0, event = 0, link = 0, unit = 0;
+
+	for (Call call : calls) {
+		switch (call) {
+		case CALL_CONTAINER: {
+			Interval & container = intervals[interval++];
+			writer->writeContainer(container.parent, container.name,
+					container.kind, container.start, container.end);
+			break;
+		}
+		case CALL_STATE:
+			writer->writeState(states[state++]);
+			break;
+		case CALL_EVENT:
+			writer->writeEvent(events[event++]);
+			break;
+		case CALL_LINK:
+			writer->writeLink(links[link++]);
+			break;
+		case CALL_VARIABLE: {
+			Interval & variable = intervals[interval++];
+			writer->writeVariable(variable.parent, variable.name,
+					variable.start, variable.end, variable.value);
+			break;
+		}
+		case CALL_TRACE_UNIT:
+			writer->setTraceUnit(traceUnits[unit++]);
+			break;
+		case CALL_UNSORTED_RECORDS:
+			writer->setUnsortedRecords();
+			break;
+		}
+	}
+}
+
+AsyncWriter::AsyncWriter(TraceWriter * target) {
+	this->target = target;
+}
+
+AsyncWriter::~AsyncWriter() {
+	close();
+	delete batch;
+	delete target;
+}
+
+/**
+ * Queue a batch (nullptr for the end), waiting if the thread is late
+ */
+void AsyncWriter::push(WriterBatch * full) {
+	unique_lock<mutex> guard(lock);
+	if (batches.size() >= SINK_QUEUE_LENGTH) {
+		TraceStage stage = SelfTrace::switchStage(STAGE_QUEUE_WAIT);
+		batchTaken.wait(guard, [this] {
+			return batches.size() < SINK_QUEUE_LENGTH;
+		});
+		SelfTrace::switchStage(stage);
+	}
+	batches.push(full);
+	batchReady.notify_one();
+}
+
+void AsyncWriter::flushBatch() {
+	if (batch->calls.size() >= SINK_BATCH_SIZE) {
+		push(batch);
+		batch = new WriterBatch();
+	}
+}
+
+void AsyncWriter::work() {
+	SelfTrace::setThreadName("sink");
+
+	while (true) {
+		WriterBatch * next;
+		{
+			SelfTrace::switchStage(STAGE_QUEUE_WAIT);
+			unique_lock<mutex> guard(lock);
+			batchReady.wait(guard, [this] {
+				return !batches.empty();
+			});
+			next = batches.front();
+			batches.pop();
+			batchTaken.notify_one();
+		}
+
+		if (next == nullptr) {
+			SelfTrace::switchStage(NO_STAGE);
+			return;
+		}
+
+		SelfTrace::switchStage(STAGE_FORMAT);
+		next->replay(target);
+		delete next;
+		SelfTrace::endBatch();
+	}
+}
+
+/**
+ * Called before the thread is started
+ */
+void AsyncWriter::setConfig(shared_ptr<const TraceConfig> config) {
+	target->setConfig(config);
+}
+
+bool AsyncWriter::open(const string & outputFile) {
+	if (!target->open(outputFile))
+		return false;
+
+	batch = new WriterBatch();
+	worker = thread(&AsyncWriter::work, this);
+	return true;
+}
+
+/**
+ * Recorded with the calls: the header of a merged trace is parsed while the
+ * containers of the previous traces may still be written
+ */
+void AsyncWriter::setTraceUnit(int unit) {
+	batch->calls.push_back(WriterBatch::CALL_TRACE_UNIT);
+	batch->traceUnits.push_back(unit);
+	flushBatch();
+}
+
+void AsyncWriter::setUnsortedRecords() {
+	batch->calls.push_back(WriterBatch::CALL_UNSORTED_RECORDS);
+	flushBatch();
+}
+
+void AsyncWriter::writeContainer(const string & parent, const string & name,
+		const string & kind, long long start, long long end) {
+	batch->calls.push_back(WriterBatch::CALL_CONTAINER);
+	batch->intervals.push_back( { parent, name, kind, start, end, 0 });
+	flushBatch();
+}
+
+void AsyncWriter::writeState(State & state) {
+	batch->calls.push_back(WriterBatch::CALL_STATE);
+	batch->states.push_back(state);
+	flushBatch();
+}
+
+void AsyncWriter::writeEvent(Event & event) {
+	batch->calls.push_back(WriterBatch::CALL_EVENT);
+	batch->events.push_back(event);
+	flushBatch();
+}
+
+void AsyncWriter::writeLink(Link & link) {
+	batch->calls.push_back(WriterBatch::CALL_LINK);
+	batch->links.push_back(link);
+	flushBatch();
+}
+
+void AsyncWriter::writeVariable(const string & container, const string & name,
+		long long start, long long end, double value) {
+	batch->calls.push_back(WriterBatch::CALL_VARIABLE);
+	batch->intervals.push_back( { container, name, "", start, end, value });
+	flushBatch();
+}
+
+void AsyncWriter::setIncomplete() {
+	incomplete = true;
+}
+
+/**
+ * Wait for the thread to write the remaining batches
+ */
+void AsyncWriter::close() {
+	if (!worker.joinable())
+		return;
+
+	push(batch);
+	batch = nullptr;
+	push(nullptr);
+	worker.join();
+
+	if (incomplete)
+		target->setIncomplete();
+	target->close();
+}
+
+#endif /* _WIN32 */
+
+TraceWriter * createSink(const string & output, string & outputFile,
+		string & error, const CompressionSettings & compression,
+		const TimeFormat & timeFormat) {
+	string type;
+	string conditions;
+	size_t separator;
+
+	size_t open = output.find('(');
+	if (open != string::npos && open < output.find(':')) {
+		size_t close = output.find(')');
+		if (close == string::npos) {
+			error = "missing ) in " + output;
+			return nullptr;
+		}
+		type = output.substr(0, open);
+		conditions = output.substr(open + 1, close - open - 1);
+		separator = (output.size() > close + 1 && output[close + 1] == ':') ?
+				close + 1 : string::npos;
+	} else {
+		separator = output.find(':');
+		type = output.substr(0, separator);
+	}
+
+	if (separator == string::npos || separator + 1 == output.size()) {
+		error = "expected TYPE:FILE instead of " + output;
+		return nullptr;
+	}
+	outputFile = output.substr(separator + 1);
+
+	if (type == SUMMARY_OUTPUT_FORMAT)
+		return new SummaryWriter();
+
+	if (type == MATRIX_OUTPUT_FORMAT)
+		return new LinkMatrixWriter();
+
+	if (type == IMAGE_OUTPUT_FORMAT) {
+		unsigned int width = DEFAULT_IMAGE_WIDTH;
+		if (!conditions.empty()) {
+			char * end;
+			width = strtoul(conditions.c_str(), &end, 10);
+			if (*end != '\0' || width == 0) {
+				error = "expected image(WIDTH) instead of " + output;
+				return nullptr;
+			}
+		}
+		return new RasterWriter(width);
+	}
+
+	if (type == FILTER_OUTPUT_FORMAT) {
+		bool sqlite = outputFile.size() >= SQLITE_EXTENSION.size()
+				&& outputFile.compare(
+						outputFile.size() - SQLITE_EXTENSION.size(),
+						SQLITE_EXTENSION.size(), SQLITE_EXTENSION) == 0;
+
+		TraceWriter * target = createWriter(
+				sqlite ? SQLITE_OUTPUT_FORMAT : PJDUMP_OUTPUT_FORMAT,
+				compression, timeFormat);
+		if (target == nullptr) {
+			error = "output format " + SQLITE_OUTPUT_FORMAT
+					+ " is not available in this build";
+			return nullptr;
+		}
+
+		FilterWriter * filter = new FilterWriter(target);
+		if (!filter->setConditions(conditions, error)) {
+			delete filter;
+			return nullptr;
+		}
+		return filter;
+	}
+
+	TraceWriter * writer = createWriter(type, compression, timeFormat);
+	if (writer == nullptr)
+		error = "output type " + type
+				+ " is unknown or not available in this build";
+	return writer;
+}
@@ -0,0 +1,279 @@
+/*
+ * sqliteWriter.cpp
+ *
+ *  Bulk load of the converted trace into a SQLite database.
+ */
+
+#include "include/sqliteWriter.h"
+
+#ifdef WITH_SQLITE
+#include <cstdio>
+
+const string DATABASE_SCHEMA = "PRAGMA page_size = 65536;"
+		"PRAGMA journal_mode = OFF;"
+		"PRAGMA synchronous = OFF;"
+		"PRAGMA locking_mode = EXCLUSIVE;"
+		"PRAGMA temp_store = MEMORY;"
+		"PRAGMA cache_size = -262144;"
+		"CREATE TABLE container (id INTEGER PRIMARY KEY, name TEXT NOT NULL,"
+		" parent INTEGER, start INTEGER, end INTEGER);"
+		"CREATE TABLE state_name (id INTEGER PRIMARY KEY, name TEXT NOT NULL);"
+		"CREATE TABLE event_name (id INTEGER PRIMARY KEY, name TEXT NOT NULL);"
+		"CREATE TABLE variable_name (id INTEGER PRIMARY KEY, name TEXT NOT NULL);"
+		"CREATE TABLE state (container INTEGER NOT NULL, state INTEGER NOT NULL,"
+		" start INTEGER NOT NULL, end INTEGER NOT NULL,"
+		" duration INTEGER NOT NULL, imbrication INTEGER NOT NULL);"
+		"CREATE TABLE event (container INTEGER NOT NULL, event INTEGER NOT NULL,"
+		" time INTEGER NOT NULL);"
+		"CREATE TABLE link (sender INTEGER NOT NULL, receiver INTEGER NOT NULL,"
+		" start INTEGER NOT NULL, end INTEGER NOT NULL,"
+		" duration INTEGER NOT NULL);"
+		"CREATE TABLE variable (container INTEGER NOT NULL,"
+		" variable INTEGER NOT NULL, start INTEGER NOT NULL,"
+		" end INTEGER NOT NULL, value REAL NOT NULL);";
+
+// Created once the tables are filled
+const string DATABASE_INDEXES =
+		"CREATE UNIQUE INDEX container_name ON container (name);"
+				"CREATE INDEX state_container_start ON state (container, start);"
+				"CREATE INDEX state_state_start ON state (state, start);"
+				"CREATE INDEX event_container_time ON event (container, time);"
+				"CREATE INDEX link_sender_start ON link (sender, start);"
+				"CREATE INDEX variable_container_start ON variable (container, start);"
+				"CREATE VIEW state_view AS SELECT c.name AS container,"
+				" n.name AS state, s.start, s.end, s.duration, s.imbrication"
+				" FROM state s JOIN container c ON c.id = s.container"
+				" JOIN state_name n ON n.id = s.state;";
+
+bool SqliteWriter::execute(const string & sql) {
+	char * error = nullptr;
+
+	if (sqlite3_exec(database, sql.c_str(), nullptr, nullptr, &error)
+			!= SQLITE_OK) {
+		cerr << "Error: SQLite: " << (error != nullptr ? error : "") << endl;
+		sqlite3_free(error);
+		failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+sqlite3_stmt * SqliteWriter::prepare(const string & sql) {
+	sqlite3_stmt * statement = nullptr;
+
+	if (sqlite3_prepare_v2(database, sql.c_str(), -1, &statement, nullptr)
+			!= SQLITE_OK)
+		cerr << "Error: SQLite: " << sqlite3_errmsg(database) << endl;
+
+	return statement;
+}
+
+void SqliteWriter::step(sqlite3_stmt * statement) {
+	if (sqlite3_step(statement) != SQLITE_DONE) {
+		cerr << "Error: SQLite: " << sqlite3_errmsg(database) << endl;
+		failed = true;
+	}
+	sqlite3_reset(statement);
+}
+
+bool SqliteWriter::open(const string & outputFile) {
+	if (outputFile == STANDARD_STREAM) {
+		cerr << "Error: a SQLite database cannot be written to the standard output."
+				<< endl;
+		return false;
+	}
+
+	// The database is built in a temporary file, which replaces the output
+	// file once it is complete
+	this->outputFile = outputFile;
+	temporaryFile = outputFile + ".tmp";
+	remove(temporaryFile.c_str());
+
+	if (sqlite3_open(temporaryFile.c_str(), &database) != SQLITE_OK) {
+		cerr << "Error: SQLite: " << sqlite3_errmsg(database) << endl;
+		return false;
+	}
+
+	if (!execute(DATABASE_SCHEMA) || !execute("BEGIN"))
+		return false;
+
+	insertContainer = prepare(
+			"INSERT INTO container (id, name, parent, start, end)"
+					" VALUES (?, ?, ?, ?, ?)");
+	insertStateName = prepare(
+			"INSERT INTO state_name (id, name) VALUES (?, ?)");
+	insertEventName = prepare(
+			"INSERT INTO event_name (id, name) VALUES (?, ?)");
+	insertState = prepare(
+			"INSERT INTO state (container, state, start, end, duration,"
+					" imbrication) VALUES (?, ?, ?, ?, ?, ?)");
+	insertEvent = prepare(
+			"INSERT INTO event (container, event, time) VALUES (?, ?, ?)");
+	insertLink = prepare(
+			"INSERT INTO link (sender, receiver, start, end, duration)"
+					" VALUES (?, ?, ?, ?, ?)");
+	insertVariableName = prepare(
+			"INSERT INTO variable_name (id, name) VALUES (?, ?)");
+	insertVariable = prepare(
+			"INSERT INTO variable (container, variable, start, end, value)"
+					" VALUES (?, ?, ?, ?, ?)");
+
+	return insertContainer != nullptr && insertStateName != nullptr
+			&& insertEventName != nullptr && insertState != nullptr
+			&& insertEvent != nullptr && insertLink != nullptr
+			&& insertVariableName != nullptr && insertVariable != nullptr;
+}
+
+/**
+ * Commit regularly so that a transaction does not grow without bound
+ */
+void SqliteWriter::rowInserted() {
+	if (++pendingRows >= SQLITE_ROWS_PER_TRANSACTION) {
+		execute("COMMIT");
+		execute("BEGIN");
+		pendingRows = 0;
+	}
+}
+
+/**
+ * Get the ID of a container, declaring it without parent if it is unknown
+ */
+long long SqliteWriter::getContainerID(const string & name) {
+	auto it = containerIDs.find(name);
+	if (it != containerIDs.end())
+		return it->second;
+
+	writeContainer("0", name, THREAD_CONTAINER_KIND, 0, 0);
+	return containerIDs.at(name);
+}
+
+long long SqliteWriter::getNameID(unordered_map<string, long long> & ids,
+		sqlite3_stmt * insert, const string & name) {
+	auto it = ids.find(name);
+	if (it != ids.end())
+		return it->second;
+
+	long long id = ids.size() + 1;
+	ids[name] = id;
+
+	sqlite3_bind_int64(insert, 1, id);
+	sqlite3_bind_text(insert, 2, name.c_str(), name.size(), SQLITE_TRANSIENT);
+	step(insert);
+
+	return id;
+}
+
+void SqliteWriter::writeContainer(const string & parent, const string & name,
+		const string &, long long start, long long end) {
+	if (containerIDs.find(name) != containerIDs.end())
+		return;
+
+	long long id = containerIDs.size() + 1;
+	containerIDs[name] = id;
+
+	sqlite3_bind_int64(insertContainer, 1, id);
+	sqlite3_bind_text(insertContainer, 2, name.c_str(), name.size(),
+			SQLITE_TRANSIENT);
+
+	// The root of the hierarchy is named "0"
+	auto parentIt = containerIDs.find(parent);
+	if (parentIt == containerIDs.end())
+		sqlite3_bind_null(insertContainer, 3);
+	else
+		sqlite3_bind_int64(insertContainer, 3, parentIt->second);
+
+	sqlite3_bind_int64(insertContainer, 4, start);
+	sqlite3_bind_int64(insertContainer, 5, end);
+	step(insertContainer);
+	rowInserted();
+}
+
+void SqliteWriter::writeState(State & state) {
+	sqlite3_bind_int64(insertState, 1, getContainerID(state.getContainer()));
+	sqlite3_bind_int64(insertState, 2,
+			getNameID(stateIDs, insertStateName, state.getName()));
+	sqlite3_bind_int64(insertState, 3, state.getTimeStamp());
+	sqlite3_bind_int64(insertState, 4, state.getEndDate());
+	sqlite3_bind_int64(insertState, 5,
+			state.getEndDate() - state.getTimeStamp());
+	sqlite3_bind_int(insertState, 6, state.getImbrication());
+	step(insertState);
+	rowInserted();
+}
+
+void SqliteWriter::writeEvent(Event & event) {
+	sqlite3_bind_int64(insertEvent, 1, getContainerID(event.getContainer()));
+	sqlite3_bind_int64(insertEvent, 2,
+			getNameID(eventIDs, insertEventName, event.getName()));
+	sqlite3_bind_int64(insertEvent, 3, event.getTimeStamp());
+	step(insertEvent);
+	rowInserted();
+}
+
+void SqliteWriter::writeLink(Link & link) {
+	sqlite3_bind_int64(insertLink, 1, getContainerID(link.getContainer()));
+	sqlite3_bind_int64(insertLink, 2,
+			getContainerID(link.getReceiverContainer()));
+	sqlite3_bind_int64(insertLink, 3, link.getTimeStamp());
+	sqlite3_bind_int64(insertLink, 4, link.getReceiveTimestamp());
+	sqlite3_bind_int64(insertLink, 5,
+			link.getReceiveTimestamp() - link.getTimeStamp());
+	step(insertLink);
+	rowInserted();
+}
+
+void SqliteWriter::writeVariable(const string & container, const string & name,
+		long long start, long long end, double value) {
+	sqlite3_bind_int64(insertVariable, 1, getContainerID(container));
+	sqlite3_bind_int64(insertVariable, 2,
+			getNameID(variableIDs, insertVariableName, name));
+	sqlite3_bind_int64(insertVariable, 3, start);
+	sqlite3_bind_int64(insertVariable, 4, end);
+	sqlite3_bind_double(insertVariable, 5, value);
+	step(insertVariable);
+	rowInserted();
+}
+
+void SqliteWriter::setIncomplete() {
+	failed = true;
+}
+
+void SqliteWriter::close() {
+	if (database == nullptr)
+		return;
+
+	sqlite3_finalize(insertContainer);
+	sqlite3_finalize(insertStateName);
+	sqlite3_finalize(insertEventName);
+	sqlite3_finalize(insertState);
+	sqlite3_finalize(insertEvent);
+	sqlite3_finalize(insertLink);
+	sqlite3_finalize(insertVariableName);
+	sqlite3_finalize(insertVariable);
+
+	execute("COMMIT");
+
+	// Build the indexes in one pass over the loaded tables
+	execute("BEGIN");
+	execute(DATABASE_INDEXES);
+	execute("COMMIT");
+
+	if (sqlite3_close(database) != SQLITE_OK)
+		failed = true;
+	database = nullptr;
+
+	if (failed) {
+		cerr << "Error: the SQLite database " << outputFile
+				<< " was not written" << endl;
+		remove(temporaryFile.c_str());
+		return;
+	}
+
+	remove(outputFile.c_str());
+	if (rename(temporaryFile.c_str(), outputFile.c_str()) != 0)
+		cerr << "Error: could not rename " << temporaryFile << " to "
+				<< outputFile << endl;
+}
+
+#endif /* WITH_SQLITE */
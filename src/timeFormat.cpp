@@ -0,0 +1,108 @@
+/*
+ * timeFormat.cpp
+ *
+ *  Exact conversion of the timestamps into another time unit, written as
+ *  fixed-point decimals.
+ */
+
+#include <climits>
+#include <cstring>
+#include "include/timeFormat.h"
+
+static const unsigned long long POWERS_OF_TEN[] = { 1ULL, 10ULL, 100ULL,
+		1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+		1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+		10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+		10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL };
+
+bool parseTimeUnit(const string & name, int & unit) {
+	if (name == "s")
+		unit = UNIT_SECONDS;
+	else if (name == "ms")
+		unit = UNIT_MILLISECONDS;
+	else if (name == "us")
+		unit = UNIT_MICROSECONDS;
+	else if (name == "ns")
+		unit = UNIT_NANOSECONDS;
+	else
+		return false;
+	return true;
+}
+
+void TimeFormat::setOutputUnit(int unit, int precision) {
+	converted = true;
+	outputUnit = unit;
+	this->precision = precision;
+	update();
+}
+
+void TimeFormat::setTraceUnit(int unit) {
+	traceUnit = unit;
+	update();
+}
+
+void TimeFormat::update() {
+	multiplier = 1;
+	multiplierExponent = 0;
+	divisor = 1;
+	decimals = 0;
+	padding = 0;
+	if (!converted)
+		return;
+
+	// Decimals of the timestamp once written in the output unit
+	int shift = outputUnit - traceUnit;
+	unsigned int exact = 0;
+	if (shift < 0) {
+		multiplier = POWERS_OF_TEN[-shift];
+		multiplierExponent = -shift;
+	} else
+		exact = shift;
+
+	decimals = (precision == EXACT_PRECISION) ? exact : precision;
+	if (exact > decimals)
+		divisor = POWERS_OF_TEN[exact - decimals];
+	else
+		padding = decimals - exact;
+}
+
+size_t TimeFormat::format(long long time, char * buffer) const {
+	char digits[TIME_BUFFER_SIZE];
+	char * end = digits + TIME_BUFFER_SIZE;
+	char * position = end;
+
+	unsigned long long value = (time < 0) ?
+			0ULL - (unsigned long long) time : (unsigned long long) time;
+
+	// A product that does not fit is written as the digits of the timestamp
+	// followed by the zeros of the multiplier (the divisor is then 1)
+	unsigned int zeros = 0;
+	if (value <= ULLONG_MAX / multiplier)
+		value *= multiplier;
+	else
+		zeros = multiplierExponent;
+	if (divisor > 1)
+		value = (value + divisor / 2) / divisor;
+	bool negative = time < 0 && value > 0;
+
+	for (unsigned int i = 0; i < padding; i++)
+		*--position = '0';
+	for (unsigned int i = padding; i < decimals; i++) {
+		*--position = '0' + value % 10;
+		value /= 10;
+	}
+	if (decimals > 0)
+		*--position = '.';
+	for (unsigned int i = 0; i < zeros; i++)
+		*--position = '0';
+	do {
+		*--position = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+	if (negative)
+		*--position = '-';
+
+	size_t length = end - position;
+	memcpy(buffer, position, length);
+	return length;
+}
@@ -0,0 +1,382 @@
+/*
+ * traceConfig.cpp
+ *
+ *  Names of the states, events and resources read from the .pcf and .row
+ *  files, with an optional binary cache.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "include/traceConfig.h"
+#include "include/lineReader.h"
+#include "include/cacheFile.h"
+
+const string STATE_CFG = "STATES";
+const string STATE_COLOR_CFG = "STATES_COLOR";
+const string EVENT_CFG = "EVENT_TYPE";
+const string VALUE_CFG = "VALUES";
+
+const string RESOURCE_LEVEL = "LEVEL";
+
+// Kinds of the cache files
+const char PCF_CACHE_KIND = 'P';
+const char ROW_CACHE_KIND = 'R';
+
+// Colors of the states missing from the .pcf file
+static const unsigned int DEFAULT_COLORS[] = { 0x75c3ff, 0x0000ff, 0xffffff,
+		0xff0000, 0xff00ae, 0xb3268c, 0x00ff00, 0xffff00, 0xeb0000, 0x00a200,
+		0xff00ff, 0x6464b1, 0xac7e1a, 0xff9000, 0x8000ff, 0x00ffff };
+
+enum PcfSection {
+	SECTION_NONE, SECTION_STATES, SECTION_STATE_COLORS, SECTION_EVENT_TYPES,
+	SECTION_VALUES,
+	// Section that is not used (gradients, options, etc.)
+	SECTION_OTHER
+};
+
+/**
+ * Remove the white spaces around [begin, end)
+ */
+static void trimRange(const char *& begin, const char *& end) {
+	while (begin < end && isspace((unsigned char) *begin))
+		begin++;
+	while (end > begin && isspace((unsigned char) end[-1]))
+		end--;
+}
+
+static bool rangeEquals(const char * begin, const char * end,
+		const string & word) {
+	return (size_t) (end - begin) == word.size()
+			&& memcmp(begin, word.data(), word.size()) == 0;
+}
+
+/**
+ * Read an integer at the beginning of [begin, end) and skip the white spaces
+ * following it
+ */
+static bool readNumber(const char *& begin, const char * end,
+		long long & value) {
+	bool negative = (begin < end && *begin == '-');
+	const char * current = negative ? begin + 1 : begin;
+	const char * digits = current;
+	unsigned long long result = 0;
+
+	while (current < end && *current >= '0' && *current <= '9')
+		result = result * 10 + (*current++ - '0');
+
+	if (current == digits || (current < end && !isspace((unsigned char) *current)))
+		return false;
+
+	while (current < end && isspace((unsigned char) *current))
+		current++;
+
+	value = negative ? -(long long) result : (long long) result;
+	begin = current;
+	return true;
+}
+
+/**
+ * Read a color given as {red,green,blue}
+ */
+static bool readColor(const char * begin, const char * end,
+		unsigned int & color) {
+	unsigned int red, green, blue;
+	string text(begin, end);
+
+	if (sscanf(text.c_str(), "{%u,%u,%u}", &red, &green, &blue) != 3
+			|| red > 255 || green > 255 || blue > 255)
+		return false;
+
+	color = (red << 16) | (green << 8) | blue;
+	return true;
+}
+
+static bool readPcfCache(const string & cacheFile, long long size,
+		long long modification, TraceConfig & config) {
+	CacheFile cache;
+	if (!cache.open(cacheFile, "rb")
+			|| !cache.checkHeader(PCF_CACHE_KIND, size, modification))
+		return false;
+
+	TraceConfig loaded;
+	cache.readNames(loaded.stateNames);
+
+	unsigned int colorCount = cache.read<unsigned int>();
+	for (unsigned int i = 0; cache.isValid() && i < colorCount; i++) {
+		int state = cache.read<int>();
+		loaded.stateColors[state] = cache.read<unsigned int>();
+	}
+
+	cache.readNames(loaded.eventNames);
+
+	unsigned int typeCount = cache.read<unsigned int>();
+	for (unsigned int i = 0; cache.isValid() && i < typeCount; i++) {
+		int type = cache.read<int>();
+		cache.readNames(loaded.eventTypes[type]);
+	}
+
+	if (!cache.isValid())
+		return false;
+
+	config.stateNames.swap(loaded.stateNames);
+	config.stateColors.swap(loaded.stateColors);
+	config.eventNames.swap(loaded.eventNames);
+	config.eventTypes.swap(loaded.eventTypes);
+	return true;
+}
+
+static bool writePcfCache(const string & cacheFile, long long size,
+		long long modification, const TraceConfig & config) {
+	CacheFile cache;
+	if (!cache.open(cacheFile + ".tmp", "wb"))
+		return false;
+
+	cache.writeHeader(PCF_CACHE_KIND, size, modification);
+	cache.writeNames(config.stateNames);
+
+	cache.write<unsigned int>(config.stateColors.size());
+	for (auto & it : config.stateColors) {
+		cache.write<int>(it.first);
+		cache.write<unsigned int>(it.second);
+	}
+
+	cache.writeNames(config.eventNames);
+
+	cache.write<unsigned int>(config.eventTypes.size());
+	for (auto & it : config.eventTypes) {
+		cache.write<int>(it.first);
+		cache.writeNames(it.second);
+	}
+
+	return commitCache(cache, cacheFile);
+}
+
+/**
+ * Parse the .pcf file in a single pass. Sections start with a keyword line
+ * and end with an empty line:
+ *
+ * STATES
+ * id name
+ *
+ * STATES_COLOR
+ * id {red,green,blue}
+ *
+ * EVENT_TYPE
+ * gradient id name
+ * VALUES
+ * value name
+ *
+ * The VALUES apply to all the event types of their EVENT_TYPE section.
+ */
+static bool parsePcf(const string & pcfFile, TraceConfig & config) {
+	LineReader reader;
+	if (!reader.open(pcfFile))
+		return false;
+
+	PcfSection section = SECTION_NONE;
+	// Event types of the current EVENT_TYPE section
+	vector<int> sectionTypes;
+	const char * line;
+	size_t length;
+
+	while (reader.nextLine(line, length)) {
+		const char * begin = line;
+		const char * end = line + length;
+		trimRange(begin, end);
+
+		if (begin == end) {
+			section = SECTION_NONE;
+			continue;
+		}
+
+		// Keyword starting a section
+		if (!isdigit((unsigned char) *begin) && *begin != '-') {
+			if (rangeEquals(begin, end, STATE_CFG)) {
+				section = SECTION_STATES;
+			} else if (rangeEquals(begin, end, STATE_COLOR_CFG)) {
+				section = SECTION_STATE_COLORS;
+			} else if (rangeEquals(begin, end, EVENT_CFG)) {
+				section = SECTION_EVENT_TYPES;
+				sectionTypes.clear();
+			} else if (rangeEquals(begin, end, VALUE_CFG)
+					&& section == SECTION_EVENT_TYPES) {
+				section = SECTION_VALUES;
+			} else {
+				section = SECTION_OTHER;
+			}
+			continue;
+		}
+
+		long long id;
+		switch (section) {
+		case SECTION_STATES:
+			if (readNumber(begin, end, id))
+				config.stateNames.insert(make_pair(id, string(begin, end)));
+			break;
+
+		case SECTION_STATE_COLORS: {
+			unsigned int color;
+			if (readNumber(begin, end, id) && readColor(begin, end, color))
+				config.stateColors.insert(make_pair(id, color));
+			break;
+		}
+
+		case SECTION_EVENT_TYPES: {
+			long long gradient;
+			// Skip the color gradient ID
+			if (readNumber(begin, end, gradient) && readNumber(begin, end, id)) {
+				config.eventNames.insert(make_pair(id, string(begin, end)));
+				sectionTypes.push_back(id);
+			}
+			break;
+		}
+
+		case SECTION_VALUES:
+			if (readNumber(begin, end, id)) {
+				string valueName(begin, end);
+				for (int type : sectionTypes)
+					config.eventTypes[type][id] = valueName;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+bool loadPcf(const string & pcfFile, TraceConfig & config, bool useCache) {
+	long long size = 0, modification = 0;
+	string cacheFile = pcfFile + CONFIG_CACHE_EXTENSION;
+	bool identified = useCache && fileIdentity(pcfFile, size, modification);
+
+	if (identified && readPcfCache(cacheFile, size, modification, config))
+		return true;
+
+	if (!parsePcf(pcfFile, config))
+		return false;
+
+	if (identified && !writePcfCache(cacheFile, size, modification, config))
+		cerr << "Warning: could not write the cache file " << cacheFile
+				<< endl;
+
+	return true;
+}
+
+static bool readRowCache(const string & cacheFile, long long size,
+		long long modification, TraceConfig & config) {
+	CacheFile cache;
+	if (!cache.open(cacheFile, "rb")
+			|| !cache.checkHeader(ROW_CACHE_KIND, size, modification))
+		return false;
+
+	map<string, vector<string>> loaded;
+	unsigned int levelCount = cache.read<unsigned int>();
+	for (unsigned int i = 0; cache.isValid() && i < levelCount; i++) {
+		vector<string> & names = loaded[cache.readString()];
+		unsigned int count = cache.read<unsigned int>();
+		names.reserve(count);
+		for (unsigned int j = 0; cache.isValid() && j < count; j++)
+			names.push_back(cache.readString());
+	}
+
+	if (!cache.isValid())
+		return false;
+
+	config.resourceNames.swap(loaded);
+	return true;
+}
+
+static bool writeRowCache(const string & cacheFile, long long size,
+		long long modification, const TraceConfig & config) {
+	CacheFile cache;
+	if (!cache.open(cacheFile + ".tmp", "wb"))
+		return false;
+
+	cache.writeHeader(ROW_CACHE_KIND, size, modification);
+	cache.write<unsigned int>(config.resourceNames.size());
+	for (auto & it : config.resourceNames) {
+		cache.writeString(it.first);
+		cache.write<unsigned int>(it.second.size());
+		for (const string & name : it.second)
+			cache.writeString(name);
+	}
+
+	return commitCache(cache, cacheFile);
+}
+
+/**
+ * Parse the .row file: each "LEVEL type SIZE n" line is followed by the names
+ * of the resources of this level, up to an empty line
+ */
+static bool parseRow(const string & rowFile, TraceConfig & config) {
+	LineReader reader;
+	if (!reader.open(rowFile))
+		return false;
+
+	vector<string> * names = nullptr;
+	const char * line;
+	size_t length;
+
+	while (reader.nextLine(line, length)) {
+		if (length == 0) {
+			names = nullptr;
+			continue;
+		}
+
+		if (length >= RESOURCE_LEVEL.size()
+				&& memcmp(line, RESOURCE_LEVEL.data(), RESOURCE_LEVEL.size())
+						== 0) {
+			const char * begin = line + RESOURCE_LEVEL.size();
+			const char * end = line + length;
+			trimRange(begin, end);
+
+			const char * typeEnd = begin;
+			while (typeEnd < end && !isspace((unsigned char) *typeEnd))
+				typeEnd++;
+
+			names = &config.resourceNames[string(begin, typeEnd)];
+			continue;
+		}
+
+		if (names != nullptr)
+			names->push_back(string(line, length));
+	}
+
+	return true;
+}
+
+bool loadRow(const string & rowFile, TraceConfig & config, bool useCache) {
+	long long size = 0, modification = 0;
+	string cacheFile = rowFile + CONFIG_CACHE_EXTENSION;
+	bool identified = useCache && fileIdentity(rowFile, size, modification);
+
+	if (identified && readRowCache(cacheFile, size, modification, config))
+		return true;
+
+	if (!parseRow(rowFile, config))
+		return false;
+
+	if (identified && !writeRowCache(cacheFile, size, modification, config))
+		cerr << "Warning: could not write the cache file " << cacheFile
+				<< endl;
+
+	return true;
+}
+
+unsigned int stateColor(const TraceConfig * config, const string & name,
+		unsigned int number) {
+	if (config != nullptr)
+		for (auto & state : config->stateNames)
+			if (state.second == name) {
+				auto found = config->stateColors.find(state.first);
+				if (found != config->stateColors.end())
+					return found->second;
+				break;
+			}
+
+	return DEFAULT_COLORS[number
+			% (sizeof(DEFAULT_COLORS) / sizeof(DEFAULT_COLORS[0]))];
+}
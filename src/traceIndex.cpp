@@ -0,0 +1,460 @@
+/*
+ * traceIndex.cpp
+ *
+ *  Memory-mapped .prv file with an index of its records by time and by
+ *  container.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include "include/traceIndex.h"
+#include "include/cacheFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifndef _WIN32
+
+bool MappedFile::open(const string & filename) {
+	close();
+
+	int descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0) {
+		::close(descriptor);
+		return false;
+	}
+
+	size = status.st_size;
+	if (size > 0) {
+		void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+				descriptor, 0);
+		if (mapping == MAP_FAILED) {
+			::close(descriptor);
+			size = 0;
+			return false;
+		}
+		data = (const char *) mapping;
+	}
+
+	// The mapping stays valid once the file is closed
+	::close(descriptor);
+	return true;
+}
+
+void MappedFile::close() {
+	if (data != nullptr)
+		munmap((void *) data, size);
+	data = nullptr;
+	size = 0;
+}
+
+#else
+
+/**
+ * No mapping on Windows: the file is read in memory
+ */
+bool MappedFile::open(const string & filename) {
+	close();
+
+	FILE * file = fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char * buffer = new char[max(length, 1L)];
+	size = fread(buffer, 1, length, file);
+	fclose(file);
+
+	data = buffer;
+	return size == (size_t) length;
+}
+
+void MappedFile::close() {
+	delete[] data;
+	data = nullptr;
+	size = 0;
+}
+
+#endif
+
+const char INDEX_KIND = 'X';
+
+int TraceIndex::addContainer(int appID, int taskID, int threadID) {
+	tuple<int, int, int> key = make_tuple(appID, taskID, threadID);
+	auto it = containerIndexes.find(key);
+	if (it != containerIndexes.end())
+		return it->second;
+
+	int index = containers.size();
+	containerIndexes[key] = index;
+	containers.push_back(key);
+	containerBlocks.push_back(vector<unsigned int>());
+	return index;
+}
+
+void TraceIndex::addToBlock(int container, unsigned int block) {
+	vector<unsigned int> & list = containerBlocks[container];
+	if (list.empty() || list.back() != block)
+		list.push_back(block);
+}
+
+void TraceIndex::clear() {
+	file.close();
+	header.clear();
+	blocks.clear();
+	containerIndexes.clear();
+	containers.clear();
+	containerBlocks.clear();
+	recordCount = 0;
+	skippedRecords = 0;
+	blockLines = 0;
+}
+
+void TraceIndex::addLine(size_t offset) {
+	if (blockLines == INDEX_BLOCK_LINES) {
+		block.end = offset;
+		blocks.push_back(block);
+		blockLines = 0;
+	}
+
+	if (blockLines == 0) {
+		block = IndexBlock();
+		block.begin = offset;
+		block.firstTime = LLONG_MAX;
+		block.lastEnd = LLONG_MIN;
+	}
+	blockLines++;
+}
+
+void TraceIndex::addRecord(const PrvRecord & record) {
+	recordCount++;
+
+	unsigned int blockIndex = blocks.size();
+	long long recordEnd = (record.category == EVENT_CATEGORY) ?
+			record.time : record.endTime;
+	block.firstTime = min(block.firstTime, record.time);
+	block.lastEnd = max(block.lastEnd, max(record.time, recordEnd));
+
+	addToBlock(addContainer(record.appID, record.taskID, record.threadID),
+			blockIndex);
+	if (record.category == LINK_CATEGORY)
+		addToBlock(
+				addContainer(record.appIDReceive, record.taskIDReceive,
+						record.threadIDReceive), blockIndex);
+}
+
+void TraceIndex::finish(size_t fileSize) {
+	if (blockLines > 0) {
+		block.end = fileSize;
+		blocks.push_back(block);
+		blockLines = 0;
+	}
+
+	// Bounds making the blocks searchable by time even if the records are
+	// not perfectly sorted
+	long long maxEnd = LLONG_MIN;
+	for (IndexBlock & indexBlock : blocks) {
+		maxEnd = max(maxEnd, indexBlock.lastEnd);
+		indexBlock.maxEnd = maxEnd;
+	}
+
+	long long minTime = LLONG_MAX;
+	for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+		minTime = min(minTime, it->firstTime);
+		it->minTime = minTime;
+	}
+}
+
+bool TraceIndex::build(const string & traceFile, bool skipErrors) {
+	clear();
+	if (!file.open(traceFile)) {
+		cerr << "Error: could not open trace file " << traceFile << endl;
+		return false;
+	}
+
+	const char * data = file.getData();
+	size_t size = file.getSize();
+	size_t position = 0;
+	unsigned long long lineNumber = 0;
+
+	PrvRecord record;
+	string error;
+	bool headerFound = false;
+
+	while (position < size) {
+		const char * line = data + position;
+		const char * newline = (const char *) memchr(line, '\n',
+				size - position);
+		const char * end = (newline != nullptr) ? newline : data + size;
+		size_t lineBegin = position;
+
+		position = (end - data) + 1;
+		lineNumber++;
+
+		if (end > line && end[-1] == '\r')
+			end--;
+
+		// The header is the first non empty line
+		if (!headerFound) {
+			if (end > line) {
+				header.assign(line, end);
+				headerFound = true;
+			}
+			continue;
+		}
+
+		addLine(lineBegin);
+		TokenizeResult result = tokenizeRecord(line, end, record, error);
+
+		if (result == RECORD_MALFORMED) {
+			if (!skipErrors) {
+				cerr << "Error: malformed record at line " << lineNumber
+						<< " (byte offset " << lineBegin << "): " << error
+						<< endl;
+				cerr << "Use --skip-errors to ignore malformed records."
+						<< endl;
+				return false;
+			}
+			skipRecord();
+		} else if (result == RECORD_OK)
+			addRecord(record);
+	}
+
+	if (!headerFound) {
+		cerr << "Error: no header found in " << traceFile << endl;
+		return false;
+	}
+
+	finish(size);
+	return true;
+}
+
+/**
+ * After the header of the CacheFile and the header line of the trace:
+ *
+ * record count, skipped record count
+ * block count, then for each block: begin, end, firstTime, lastEnd
+ * thread count, then for each thread: application, task, thread, number of
+ * blocks and block numbers as varint differences with the previous one
+ */
+bool TraceIndex::save(const string & traceFile) const {
+	long long size, modification;
+	if (!fileIdentity(traceFile, size, modification))
+		return false;
+
+	CacheFile cache;
+	string indexFile = traceFile + INDEX_EXTENSION;
+	if (!cache.open(indexFile + ".tmp", "wb"))
+		return false;
+
+	cache.writeHeader(INDEX_KIND, size, modification);
+	cache.writeString(header);
+	cache.write<unsigned long long>(recordCount);
+	cache.write<unsigned long long>(skippedRecords);
+
+	cache.write<unsigned int>(blocks.size());
+	for (const IndexBlock & indexBlock : blocks) {
+		cache.write<unsigned long long>(indexBlock.begin);
+		cache.write<unsigned long long>(indexBlock.end);
+		cache.write<long long>(indexBlock.firstTime);
+		cache.write<long long>(indexBlock.lastEnd);
+	}
+
+	cache.write<unsigned int>(containers.size());
+	for (unsigned int i = 0; i < containers.size(); i++) {
+		cache.write<int>(get<0>(containers[i]));
+		cache.write<int>(get<1>(containers[i]));
+		cache.write<int>(get<2>(containers[i]));
+
+		const vector<unsigned int> & list = containerBlocks[i];
+		cache.writeVarint(list.size());
+		unsigned int previous = 0;
+		for (unsigned int blockIndex : list) {
+			cache.writeVarint(blockIndex - previous);
+			previous = blockIndex;
+		}
+	}
+
+	return commitCache(cache, indexFile);
+}
+
+/**
+ * The index is left empty if it cannot be loaded
+ */
+bool TraceIndex::load(const string & traceFile) {
+	clear();
+
+	long long size, modification;
+	if (!fileIdentity(traceFile, size, modification))
+		return false;
+
+	CacheFile cache;
+	if (!cache.open(traceFile + INDEX_EXTENSION, "rb")
+			|| !cache.checkHeader(INDEX_KIND, size, modification))
+		return false;
+
+	header = cache.readString();
+	recordCount = cache.read<unsigned long long>();
+	skippedRecords = cache.read<unsigned long long>();
+
+	unsigned int blockCount = cache.read<unsigned int>();
+	for (unsigned int i = 0; cache.isValid() && i < blockCount; i++) {
+		block = IndexBlock();
+		block.begin = cache.read<unsigned long long>();
+		block.end = cache.read<unsigned long long>();
+		block.firstTime = cache.read<long long>();
+		block.lastEnd = cache.read<long long>();
+		if (block.begin > block.end || block.end > (size_t) size) {
+			clear();
+			return false;
+		}
+		blocks.push_back(block);
+	}
+
+	unsigned int containerCount = cache.read<unsigned int>();
+	for (unsigned int i = 0; cache.isValid() && i < containerCount; i++) {
+		int appID = cache.read<int>();
+		int taskID = cache.read<int>();
+		int threadID = cache.read<int>();
+		vector<unsigned int> & list = containerBlocks[addContainer(appID,
+				taskID, threadID)];
+
+		unsigned long long count = cache.readVarint();
+		unsigned long long blockIndex = 0;
+		for (unsigned long long j = 0; cache.isValid() && j < count; j++) {
+			blockIndex += cache.readVarint();
+			if (blockIndex >= blocks.size()) {
+				clear();
+				return false;
+			}
+			list.push_back(blockIndex);
+		}
+	}
+
+	if (!cache.isValid()) {
+		clear();
+		return false;
+	}
+
+	blocks.shrink_to_fit();
+	finish(size);
+	return file.open(traceFile);
+}
+
+vector<unsigned int> TraceIndex::findBlocks(long long start, long long end,
+		const vector<int> & selected) const {
+	// First block that may end after start, first block starting after end
+	unsigned int first = partition_point(blocks.begin(), blocks.end(),
+			[start](const IndexBlock & block) {
+				return block.maxEnd < start;
+			}) - blocks.begin();
+	unsigned int last = partition_point(blocks.begin(), blocks.end(),
+			[end](const IndexBlock & block) {
+				return block.minTime <= end;
+			}) - blocks.begin();
+
+	vector<unsigned int> found;
+
+	if (selected.empty()) {
+		for (unsigned int i = first; i < last; i++)
+			found.push_back(i);
+	} else {
+		for (int container : selected) {
+			const vector<unsigned int> & list = containerBlocks[container];
+			auto it = lower_bound(list.begin(), list.end(), first);
+			for (; it != list.end() && *it < last; ++it)
+				found.push_back(*it);
+		}
+		sort(found.begin(), found.end());
+		found.erase(unique(found.begin(), found.end()), found.end());
+	}
+
+	// Blocks whose own records are all outside the window
+	found.erase(remove_if(found.begin(), found.end(),
+			[this, start, end](unsigned int i) {
+				return blocks[i].lastEnd < start || blocks[i].firstTime > end;
+			}), found.end());
+
+	return found;
+}
+
+vector<int> TraceIndex::findContainers(int appID, int taskID,
+		int threadID) const {
+	vector<int> found;
+
+	for (auto & it : containerIndexes)
+		if ((appID == 0 || get<0>(it.first) == appID)
+				&& (taskID == 0 || get<1>(it.first) == taskID)
+				&& (threadID == 0 || get<2>(it.first) == threadID))
+			found.push_back(it.second);
+
+	return found;
+}
+
+int TraceIndex::getContainerIndex(int appID, int taskID, int threadID) const {
+	auto it = containerIndexes.find(make_tuple(appID, taskID, threadID));
+	return (it == containerIndexes.end()) ? -1 : it->second;
+}
+
+void TraceIndex::forEachRecord(long long start, long long end,
+		const vector<int> & selected,
+		const function<void(const PrvRecord &)> & process) const {
+	vector<bool> kept(containers.size(), selected.empty());
+	for (int container : selected)
+		kept[container] = true;
+
+	PrvRecord record;
+	string error;
+	const char * data = file.getData();
+
+	for (unsigned int blockIndex : findBlocks(start, end, selected)) {
+		const IndexBlock & indexBlock = blocks[blockIndex];
+		const char * line = data + indexBlock.begin;
+		const char * blockEnd = data + indexBlock.end;
+
+		while (line < blockEnd) {
+			const char * lineEnd = (const char *) memchr(line, '\n',
+					blockEnd - line);
+			if (lineEnd == nullptr)
+				lineEnd = blockEnd;
+			const char * next = lineEnd + 1;
+			if (lineEnd > line && lineEnd[-1] == '\r')
+				lineEnd--;
+
+			if (tokenizeRecord(line, lineEnd, record, error) == RECORD_OK) {
+				bool inWindow = (record.category == EVENT_CATEGORY) ?
+						record.time >= start && record.time <= end :
+						record.time <= end && record.endTime >= start;
+
+				bool inSelection = kept[getContainerIndex(record.appID,
+						record.taskID, record.threadID)]
+						|| (record.category == LINK_CATEGORY
+								&& kept[getContainerIndex(record.appIDReceive,
+										record.taskIDReceive,
+										record.threadIDReceive)]);
+
+				if (inWindow && inSelection)
+					process(record);
+			}
+
+			line = next;
+		}
+	}
+}
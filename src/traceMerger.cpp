@@ -0,0 +1,309 @@
+/*
+ * traceMerger.cpp
+ *
+ *  Conversion of several traces into one output, merged by time.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include "include/selfTrace.h"
+#include "include/traceMerger.h"
+
+MergeInput::MergeInput(const string & traceFile, ParaverParser * parser,
+		bool skipErrors) {
+	this->traceFile = traceFile;
+	this->parser = parser;
+	this->skipErrors = skipErrors;
+}
+
+MergeInput::~MergeInput() {
+#ifndef _WIN32
+	stop();
+
+	while (!batches.empty()) {
+		delete batches.front();
+		batches.pop();
+	}
+	for (RecordBatch * batch : freeBatches)
+		delete batch;
+#endif
+
+	delete current;
+	delete parser;
+}
+
+bool MergeInput::open() {
+	const char * line = "";
+	size_t length = 0;
+
+	if (!reader.open(traceFile))
+		return false;
+
+	// Get the first non empty line
+	while (reader.nextLine(line, length) && length == 0) {
+	}
+	header.assign(line, length);
+	traceUnit = ParaverParser::readTraceUnit(header);
+	return true;
+}
+
+void MergeInput::setRecordUnit(int unit) {
+	timeScale = 1;
+	for (int i = unit; i < traceUnit; i++)
+		timeScale *= 10;
+
+	if (timeScale > 1)
+		parser->setRecordUnit(unit);
+}
+
+/**
+ * Tokenize the next records of the trace into a batch
+ *
+ * @return false if there is no more record
+ */
+bool MergeInput::readBatch(RecordBatch & batch) {
+	const char * line;
+	size_t length;
+	string recordError;
+
+	batch.count = 0;
+	if (batch.records.size() < MERGE_BATCH_SIZE)
+		batch.records.resize(MERGE_BATCH_SIZE);
+
+	TraceStage stage = SelfTrace::switchStage(STAGE_TOKENIZE);
+
+	while (batch.count < MERGE_BATCH_SIZE && error.empty()
+			&& reader.nextLine(line, length)) {
+		TokenizeResult result = tokenizeRecord(line, line + length,
+				batch.records[batch.count], recordError);
+
+		if (result == RECORD_MALFORMED) {
+			if (skipErrors) {
+				skippedRecords++;
+				continue;
+			}
+
+			error = "malformed record at line "
+					+ to_string(reader.getLineNumber()) + " (byte offset "
+					+ to_string(reader.getLineOffset()) + "): " + recordError;
+			break;
+		}
+
+		if (result == RECORD_UNSUPPORTED)
+			cerr << "Unsupported type of event: " + string(line, length) << endl;
+
+		if (result == RECORD_OK) {
+			PrvRecord & record = batch.records[batch.count++];
+			if (timeScale > 1) {
+				record.time *= timeScale;
+				record.endTime *= timeScale;
+				record.wantedSendTime *= timeScale;
+				record.wantedReceiveTime *= timeScale;
+			}
+		}
+	}
+
+	SelfTrace::switchStage(stage);
+	return batch.count > 0;
+}
+
+#ifndef _WIN32
+
+void MergeInput::work() {
+	SelfTrace::setThreadName("reader");
+
+	while (true) {
+		RecordBatch * batch;
+		{
+			lock_guard<mutex> guard(lock);
+			if (freeBatches.empty())
+				batch = new RecordBatch();
+			else {
+				batch = freeBatches.back();
+				freeBatches.pop_back();
+			}
+		}
+
+		bool read = readBatch(*batch);
+
+		SelfTrace::switchStage(STAGE_QUEUE_WAIT);
+		unique_lock<mutex> guard(lock);
+		batchTaken.wait(guard, [this] {
+			return stopping || batches.size() < MERGE_QUEUE_LENGTH;
+		});
+
+		if (!read || stopping) {
+			delete batch;
+			batches.push(nullptr);
+			batchReady.notify_one();
+			SelfTrace::switchStage(NO_STAGE);
+			return;
+		}
+
+		batches.push(batch);
+		batchReady.notify_one();
+		SelfTrace::endBatch();
+	}
+}
+
+#endif /* _WIN32 */
+
+void MergeInput::start() {
+#ifndef _WIN32
+	worker = thread(&MergeInput::work, this);
+#endif
+}
+
+void MergeInput::stop() {
+#ifndef _WIN32
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	batchTaken.notify_all();
+
+	if (worker.joinable())
+		worker.join();
+#endif
+}
+
+/**
+ * Give back the converted batch and get the next one
+ *
+ * @return nullptr at the end of the trace
+ */
+RecordBatch * MergeInput::takeBatch() {
+#ifndef _WIN32
+	unique_lock<mutex> guard(lock);
+	if (current != nullptr) {
+		freeBatches.push_back(current);
+		current = nullptr;
+	}
+
+	if (batches.empty()) {
+		TraceStage stage = SelfTrace::switchStage(STAGE_QUEUE_WAIT);
+		batchReady.wait(guard, [this] {
+			return !batches.empty();
+		});
+		SelfTrace::switchStage(stage);
+	}
+	RecordBatch * batch = batches.front();
+	if (batch != nullptr) {
+		batches.pop();
+		batchTaken.notify_one();
+	}
+	return batch;
+#else
+	if (current == nullptr)
+		current = new RecordBatch();
+	return readBatch(*current) ? current : nullptr;
+#endif
+}
+
+bool MergeInput::next() {
+	if (current != nullptr && position < current->count) {
+		position++;
+		return true;
+	}
+
+	RecordBatch * batch = takeBatch();
+	if (batch == nullptr)
+		return false;
+
+	current = batch;
+	position = 1;
+	return true;
+}
+
+TraceMerger::TraceMerger(TraceWriter * writer) {
+	this->writer = writer;
+}
+
+void TraceMerger::addInput(const string & traceFile, ParaverParser * parser,
+		bool skipErrors) {
+	inputs.push_back(
+			unique_ptr<MergeInput>(
+					new MergeInput(traceFile, parser, skipErrors)));
+}
+
+bool TraceMerger::merge(const string & outputFile) {
+	for (auto & input : inputs)
+		if (!input->open()) {
+			cerr << "Error: could not open trace file "
+					<< input->getTraceFile() << endl;
+			return false;
+		}
+
+	// The times are converted into the finest unit of the traces
+	int unit = UNIT_SECONDS;
+	for (auto & input : inputs)
+		unit = min(unit, input->getTraceUnit());
+	for (auto & input : inputs)
+		input->setRecordUnit(unit);
+
+	if (!writer->open(outputFile)) {
+		cerr << "Error: could not open output file " << outputFile << endl;
+		return false;
+	}
+
+	for (auto & input : inputs) {
+		try {
+			input->getParser()->parseHeader(input->getHeader());
+		} catch (const exception & e) {
+			cerr << "Error: malformed header of " << input->getTraceFile()
+					<< ": " << input->getHeader() << endl;
+			writer->setIncomplete();
+			writer->close();
+			return false;
+		}
+	}
+
+	// Time of the next record of each trace, the first trace first on a tie
+	typedef pair<long long, size_t> NextRecord;
+	priority_queue<NextRecord, vector<NextRecord>, greater<NextRecord>> heap;
+
+	for (size_t i = 0; i < inputs.size(); i++) {
+		inputs[i]->start();
+		if (inputs[i]->next())
+			heap.push(make_pair(inputs[i]->getRecord().time, i));
+	}
+
+	bool complete = true;
+	while (!heap.empty()) {
+		size_t number = heap.top().second;
+		MergeInput & input = *inputs[number];
+		heap.pop();
+
+		SelfTrace::switchRecordStage(STAGE_RESOLVE);
+		input.getParser()->parseRecord(input.getRecord());
+		SelfTrace::countRecord();
+
+		if (input.next())
+			heap.push(make_pair(input.getRecord().time, number));
+		else if (!input.getError().empty()) {
+			cerr << "Error: " << input.getError() << " in "
+					<< input.getTraceFile() << endl;
+			cerr << "Use --skip-errors to ignore malformed records." << endl;
+			complete = false;
+			break;
+		}
+	}
+
+	for (auto & input : inputs) {
+		input->stop();
+		SelfTrace::switchStage(STAGE_RESOLVE);
+		input->getParser()->finish();
+
+		if (input->getSkippedRecords() > 0)
+			cerr << "Warning: " << input->getSkippedRecords()
+					<< " malformed records were skipped in "
+					<< input->getTraceFile() << "." << endl;
+	}
+
+	if (!complete)
+		writer->setIncomplete();
+	writer->close();
+	SelfTrace::switchStage(NO_STAGE);
+	return complete;
+}
@@ -0,0 +1,231 @@
+/*
+ * writer.cpp
+ *
+ *  Output backends of the converted trace.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include "include/writer.h"
+#include "include/pajeWriter.h"
+#include "include/sqliteWriter.h"
+
+TraceWriter::~TraceWriter() {
+}
+
+template<typename Format>
+TextWriter<Format>::TextWriter(const CompressionSettings & compression,
+		const TimeFormat & timeFormat) :
+		compression(compression) {
+	output = &file;
+	format.setTimeFormat(timeFormat);
+}
+
+template<typename Format>
+TextWriter<Format>::TextWriter(ostream & stream) {
+	output = &stream;
+}
+
+template<typename Format>
+void TextWriter<Format>::setConfig(shared_ptr<const TraceConfig> config) {
+	format.setConfig(config);
+}
+
+template<typename Format>
+void TextWriter<Format>::setTraceUnit(int unit) {
+	format.setTraceUnit(unit);
+}
+
+template<typename Format>
+void TextWriter<Format>::setUnsortedRecords() {
+	format.setUnsortedRecords();
+}
+
+/**
+ * The output file is ignored when the writer was given a stream
+ */
+template<typename Format>
+bool TextWriter<Format>::open(const string & outputFile) {
+	if (output != &file)
+		return output->good();
+
+	// The standard output is also written by large blocks
+	Compression type = compressionOf(outputFile);
+	if (type != COMPRESSION_NONE || outputFile == STANDARD_STREAM) {
+		string error;
+		compressedBuffer.reset(new CompressedStreamBuffer());
+		if (!compressedBuffer->open(outputFile, type, compression, error)) {
+			cerr << "Error: " << error << endl;
+			compressedBuffer.reset();
+			return false;
+		}
+		compressedFile.reset(new ostream(compressedBuffer.get()));
+		output = compressedFile.get();
+		return true;
+	}
+
+	file.open(outputFile);
+	return file.good();
+}
+
+template<typename Format>
+void TextWriter<Format>::writeContainer(const string & parent,
+		const string & name, const string & kind, long long start,
+		long long end) {
+	format.writeContainer(*output, parent, name, kind, start, end);
+}
+
+template<typename Format>
+void TextWriter<Format>::writeState(State & state) {
+	format.writeState(*output, state);
+}
+
+template<typename Format>
+void TextWriter<Format>::writeEvent(Event & event) {
+	format.writeEvent(*output, event);
+}
+
+template<typename Format>
+void TextWriter<Format>::writeLink(Link & link) {
+	format.writeLink(*output, link);
+}
+
+template<typename Format>
+void TextWriter<Format>::writeVariable(const string & container,
+		const string & name, long long start, long long end, double value) {
+	format.writeVariable(*output, container, name, start, end, value);
+}
+
+template<typename Format>
+void TextWriter<Format>::close() {
+	format.finish(*output);
+
+	if (compressedBuffer) {
+		if (!compressedBuffer->close())
+			cerr << "Error: the compressed output could not be written"
+					<< endl;
+		compressedFile.reset();
+		compressedBuffer.reset();
+		output = &file;
+	} else if (output == &file)
+		file.close();
+	else
+		output->flush();
+}
+
+/**
+ * Container, nameOfParent, name, startTime, endTime, duration, name
+ */
+void PjdumpFormat::writeContainer(ostream & out, const string & parent,
+		const string & name, const string &, long long start, long long end) {
+	out << "Container" << PJDUMP_SEPARATOR;
+	out << parent << PJDUMP_SEPARATOR;
+	out << name << PJDUMP_SEPARATOR;
+	timeFormat.write(out, start);
+	out << PJDUMP_SEPARATOR;
+	timeFormat.write(out, end);
+	out << PJDUMP_SEPARATOR;
+	timeFormat.write(out, end - start);
+	out << PJDUMP_SEPARATOR;
+	out << name << '\n';
+}
+
+/**
+ * State, container, name, startTime, endTime, duration, imbrication, name
+ */
+void PjdumpFormat::writeState(ostream & out, const State & state) {
+	out << state.getTag() << PJDUMP_SEPARATOR;
+	out << state.getContainer() << PJDUMP_SEPARATOR;
+	out << state.getName() << PJDUMP_SEPARATOR;
+	timeFormat.write(out, state.getTimeStamp());
+	out << PJDUMP_SEPARATOR;
+	timeFormat.write(out, state.getEndDate());
+	out << PJDUMP_SEPARATOR;
+	timeFormat.write(out, state.getEndDate() - state.getTimeStamp());
+	out << PJDUMP_SEPARATOR;
+	out << state.getImbrication() << PJDUMP_SEPARATOR;
+	out << state.getName() << '\n';
+}
+
+/**
+ * Event, container, name, time, name
+ */
+void PjdumpFormat::writeEvent(ostream & out, const Event & event) {
+	out << event.getTag() << PJDUMP_SEPARATOR;
+	out << event.getContainer() << PJDUMP_SEPARATOR;
+	out << event.getName() << PJDUMP_SEPARATOR;
+	timeFormat.write(out, event.getTimeStamp());
+	out << PJDUMP_SEPARATOR;
+	out << event.getName() << '\n';
+}
+
+/**
+ * Link, container, Link, startTime, endTime, duration, Link, sender,
+ * receiver
+ */
+void PjdumpFormat::writeLink(ostream & out, const Link & link) {
+	out << link.getTag() << PJDUMP_SEPARATOR;
+	out << link.getContainer() << PJDUMP_SEPARATOR;
+	out << link.getTag() << PJDUMP_SEPARATOR;
+	timeFormat.write(out, link.getTimeStamp());
+	out << PJDUMP_SEPARATOR;
+	timeFormat.write(out, link.getReceiveTimestamp());
+	out << PJDUMP_SEPARATOR;
+	timeFormat.write(out,
+			link.getReceiveTimestamp() - link.getTimeStamp());
+	out << PJDUMP_SEPARATOR;
+	out << link.getTag() << PJDUMP_SEPARATOR;
+	out << link.getContainer() << PJDUMP_SEPARATOR;
+	out << link.getReceiverContainer() << '\n';
+}
+
+/**
+ * The values are doubles, so the counts are only exact up to 2^53
+ */
+int formatVariableValue(double value, char * buffer) {
+	if (value == trunc(value) && fabs(value) < 9.2e18)
+		return snprintf(buffer, VARIABLE_BUFFER_SIZE, "%lld",
+				(long long) value);
+	return snprintf(buffer, VARIABLE_BUFFER_SIZE, "%.15g", value);
+}
+
+/**
+ * Variable, container, type, startTime, endTime, duration, value
+ */
+void PjdumpFormat::writeVariable(ostream & out, const string & container,
+		const string & name, long long start, long long end, double value) {
+	stringstream variable;
+	char number[VARIABLE_BUFFER_SIZE];
+	formatVariableValue(value, number);
+
+	variable << "Variable" << PJDUMP_SEPARATOR;
+	variable << container << PJDUMP_SEPARATOR;
+	variable << name << PJDUMP_SEPARATOR;
+	timeFormat.write(variable, start);
+	variable << PJDUMP_SEPARATOR;
+	timeFormat.write(variable, end);
+	variable << PJDUMP_SEPARATOR;
+	timeFormat.write(variable, end - start);
+	variable << PJDUMP_SEPARATOR;
+	variable << number << '\n';
+
+	out << variable.str();
+}
+
+template class TextWriter<PjdumpFormat>;
+template class TextWriter<PajeFormat>;
+
+TraceWriter * createWriter(const string & format,
+		const CompressionSettings & compression, const TimeFormat & timeFormat) {
+	if (format == PJDUMP_OUTPUT_FORMAT)
+		return new PjdumpWriter(compression, timeFormat);
+	if (format == PAJE_OUTPUT_FORMAT)
+		return new PajeWriter(compression, timeFormat);
+
+#ifdef WITH_SQLITE
+	if (format == SQLITE_OUTPUT_FORMAT)
+		return new SqliteWriter();
+#endif
+
+	return nullptr;
+}